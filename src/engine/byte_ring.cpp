@@ -0,0 +1,137 @@
+/**
+ * Magic Keyboard - Client Input Ring Implementation
+ */
+
+#include "byte_ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace magickeyboard {
+
+namespace {
+
+size_t roundUpPow2(size_t n) {
+  size_t p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+} // namespace
+
+ByteRing::ByteRing(size_t initialBytes, size_t maxBytes)
+    : data_(roundUpPow2(std::max<size_t>(initialBytes, 64))),
+      maxBytes_(std::max(roundUpPow2(maxBytes), data_.size())) {}
+
+bool ByteRing::reserve(size_t need) {
+  if (need <= data_.size())
+    return true;
+  if (need > maxBytes_)
+    return false;
+
+  // Unwrap into the new storage so head_ starts at 0
+  std::vector<uint8_t> grown(roundUpPow2(need));
+  size_t first = std::min(size_, data_.size() - head_);
+  std::memcpy(grown.data(), data_.data() + head_, first);
+  std::memcpy(grown.data() + first, data_.data(), size_ - first);
+  data_.swap(grown);
+  head_ = 0;
+  return true;
+}
+
+ByteRing::ReadStatus ByteRing::fill(int fd, size_t &budget) {
+  bool readAny = false;
+  while (budget > 0) {
+    // Full after reading: let the caller consume first. Full before
+    // reading anything: one message fills the ring, so grow.
+    if (size_ == data_.size() && (readAny || !reserve(size_ * 2)))
+      return ReadStatus::Full;
+
+    // Free space is [tail, end) and then [0, head) when it wraps
+    const size_t cap = data_.size();
+    size_t tail = (head_ + size_) & (cap - 1);
+    size_t free = std::min(cap - size_, budget);
+    iovec iov[2];
+    int count = 1;
+    iov[0].iov_base = data_.data() + tail;
+    iov[0].iov_len = std::min(free, cap - tail);
+    if (iov[0].iov_len < free) {
+      iov[1].iov_base = data_.data();
+      iov[1].iov_len = free - iov[0].iov_len;
+      count = 2;
+    }
+
+    ssize_t n = readv(fd, iov, count);
+    if (n > 0) {
+      size_ += static_cast<size_t>(n);
+      budget -= static_cast<size_t>(n);
+      readAny = true;
+      continue;
+    }
+    if (n == 0)
+      return ReadStatus::Closed;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return ReadStatus::WouldBlock;
+    return ReadStatus::Error;
+  }
+  return ReadStatus::Full;
+}
+
+bool ByteRing::append(std::string_view bytes) {
+  if (!reserve(size_ + bytes.size()))
+    return false;
+  const size_t cap = data_.size();
+  size_t tail = (head_ + size_) & (cap - 1);
+  size_t first = std::min(bytes.size(), cap - tail);
+  std::memcpy(data_.data() + tail, bytes.data(), first);
+  std::memcpy(data_.data(), bytes.data() + first, bytes.size() - first);
+  size_ += bytes.size();
+  return true;
+}
+
+size_t ByteRing::find(char c, size_t from) const {
+  if (from >= size_)
+    return npos;
+  const size_t cap = data_.size();
+  size_t start = (head_ + from) & (cap - 1);
+  size_t remaining = size_ - from;
+
+  // At most two contiguous runs: up to the end of storage, then from 0
+  size_t run = std::min(remaining, cap - start);
+  if (const void *hit = std::memchr(data_.data() + start, c, run))
+    return from + (static_cast<const uint8_t *>(hit) - (data_.data() + start));
+  if (run < remaining) {
+    if (const void *hit = std::memchr(data_.data(), c, remaining - run))
+      return from + run + (static_cast<const uint8_t *>(hit) - data_.data());
+  }
+  return npos;
+}
+
+std::string_view ByteRing::view(size_t offset, size_t len) {
+  len = std::min(len, size_ > offset ? size_ - offset : 0);
+  const size_t cap = data_.size();
+  size_t start = (head_ + offset) & (cap - 1);
+  const char *base = reinterpret_cast<const char *>(data_.data());
+  if (start + len <= cap)
+    return std::string_view(base + start, len);
+
+  size_t first = cap - start;
+  scratch_.assign(base + start, first);
+  scratch_.append(base, len - first);
+  return scratch_;
+}
+
+void ByteRing::consume(size_t n) {
+  n = std::min(n, size_);
+  size_ -= n;
+  // An empty ring restarts at 0 so the next message is unlikely to wrap
+  head_ = size_ ? (head_ + n) & (data_.size() - 1) : 0;
+}
+
+} // namespace magickeyboard
@@ -0,0 +1,99 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Client Input Ring
+ *
+ * Per-client receive buffer for the IPC socket. Reads go straight into
+ * the free space of a power-of-two ring (two iovecs when it wraps) until
+ * the socket would block, so a multi-kilobyte swipe or paste costs a few
+ * large reads instead of one 1 KiB read per wakeup. Consuming a message
+ * just advances the read position: no erase, no memmove, so draining n
+ * bytes is O(n) however many messages they hold.
+ *
+ * Messages are handed out as string_views. One that lies in one piece
+ * (nearly all of them) points into the ring; one that straddles the wrap
+ * is copied once into a scratch buffer.
+ *
+ * The ring grows by doubling while a single message does not fit, up to
+ * a fixed maximum; a client cannot make the engine buffer more than that.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace magickeyboard {
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+namespace input_config {
+// Starting ring size per client
+constexpr size_t INITIAL_BYTES = 16 * 1024;
+// Largest single message (JSON line or frame) accepted; longer ones are
+// skipped whole. Sized for a long clipboard paste.
+constexpr size_t MAX_MESSAGE_BYTES = 1024 * 1024;
+// Bytes read from one client per wakeup before yielding to the event
+// loop (the fd stays readable, so the rest comes on the next wakeup)
+constexpr size_t READ_BUDGET_BYTES = 256 * 1024;
+} // namespace input_config
+
+// ============================================================================
+// Byte Ring
+// ============================================================================
+
+class ByteRing {
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  enum class ReadStatus {
+    WouldBlock, // Drained the socket
+    Full,       // Ring (or budget) exhausted; consume, then read again
+    Closed,     // Peer closed the connection
+    Error,      // errno says why
+  };
+
+  // maxBytes is rounded up to a power of two
+  explicit ByteRing(size_t initialBytes = input_config::INITIAL_BYTES,
+                    size_t maxBytes = 2 * input_config::MAX_MESSAGE_BYTES);
+
+  // Read from fd until it would block, the ring is full at its maximum
+  // size, or budget bytes have been read (budget is decreased)
+  ReadStatus fill(int fd, size_t &budget);
+
+  // Append bytes (tests and benches); false if they do not fit
+  bool append(std::string_view bytes);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return data_.size(); }
+
+  uint8_t at(size_t offset) const {
+    return data_[(head_ + offset) & (data_.size() - 1)];
+  }
+
+  // Offset of the first c at or after from, or npos
+  size_t find(char c, size_t from = 0) const;
+
+  // Bytes [offset, offset + len) in one piece. Valid until the next
+  // view(), fill() or append().
+  std::string_view view(size_t offset, size_t len);
+
+  // Drop n bytes from the front
+  void consume(size_t n);
+
+private:
+  // Grow to hold at least need bytes; false if that exceeds the maximum
+  bool reserve(size_t need);
+
+  std::vector<uint8_t> data_; // Power-of-two size
+  size_t head_ = 0;           // Index of the oldest byte
+  size_t size_ = 0;
+  size_t maxBytes_;
+  std::string scratch_; // Views of messages that wrap
+};
+
+} // namespace magickeyboard
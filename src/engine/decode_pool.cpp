@@ -0,0 +1,91 @@
+/**
+ * Magic Keyboard - Decode Worker Pool Implementation
+ */
+
+#include "decode_pool.h"
+
+#include <algorithm>
+
+namespace magickeyboard {
+
+// ============================================================================
+// Task Group
+// ============================================================================
+
+void TaskGroup::add(size_t n) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_ += n;
+}
+
+void TaskGroup::done() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pending_ > 0)
+    pending_--;
+  if (pending_ == 0)
+    cv_.notify_all();
+}
+
+bool TaskGroup::waitUntil(Clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cv_.wait_until(lock, deadline, [this] { return pending_ == 0; });
+}
+
+size_t TaskGroup::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_;
+}
+
+// ============================================================================
+// Decode Pool
+// ============================================================================
+
+DecodePool::DecodePool(unsigned threads) {
+  if (threads == 0) {
+    unsigned hw = std::thread::hardware_concurrency();
+    threads = std::clamp(hw > 1 ? hw - 1 : 1u, 1u, 4u);
+  }
+
+  workers_.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    workers_.emplace_back([this] { workerLoop(); });
+  }
+}
+
+DecodePool::~DecodePool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+
+  for (auto &t : workers_) {
+    if (t.joinable())
+      t.join();
+  }
+}
+
+void DecodePool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void DecodePool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      // Drain remaining work before exiting so TaskGroups always complete
+      if (queue_.empty())
+        return;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    task();
+  }
+}
+
+} // namespace magickeyboard
@@ -0,0 +1,144 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Decode Worker Pool
+ *
+ * Small fixed-size thread pool for running recognition work off the
+ * caller's thread. Tasks are plain closures; callers that need to wait
+ * for a batch use a TaskGroup with a deadline so they never block longer
+ * than their latency budget.
+ *
+ * Tasks must not capture anything that can die before the pool does:
+ * the pool is declared after the engines it serves and joins on
+ * destruction.
+ *
+ * Mailbox is the lock-free hand-off between the event loop and the swipe
+ * worker, where only the newest request matters.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace magickeyboard {
+
+// ============================================================================
+// Task Group (countdown latch with deadline)
+// ============================================================================
+
+class TaskGroup {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Register n tasks that will each call done() exactly once
+  void add(size_t n = 1);
+
+  // Mark one task finished
+  void done();
+
+  // Wait until all tasks finished or the deadline passes.
+  // Returns true if every task finished in time.
+  bool waitUntil(Clock::time_point deadline);
+
+  // Number of tasks still outstanding
+  size_t pending() const;
+
+private:
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t pending_ = 0;
+};
+
+// ============================================================================
+// Decode Pool
+// ============================================================================
+
+class DecodePool {
+public:
+  // threads = 0 picks hardware_concurrency - 1, clamped to [1, 4]
+  explicit DecodePool(unsigned threads = 0);
+  ~DecodePool();
+
+  DecodePool(const DecodePool &) = delete;
+  DecodePool &operator=(const DecodePool &) = delete;
+
+  // Queue a task; runs on the next free worker
+  void submit(std::function<void()> task);
+
+  size_t threadCount() const { return workers_.size(); }
+
+private:
+  void workerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> queue_;
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+// ============================================================================
+// Mailbox (lock-free single-slot hand-off)
+// ============================================================================
+
+// One producer, one consumer. put() replaces whatever is still waiting, so
+// a consumer that falls behind only ever sees the newest item; the
+// replaced one is handed back to the producer. Neither side takes a lock:
+// the slot is an atomic pointer, and the consumer sleeps on an atomic
+// counter (a futex) that put() and close() bump.
+template <typename T> class Mailbox {
+public:
+  Mailbox() = default;
+  ~Mailbox() { delete slot_.exchange(nullptr); }
+  Mailbox(const Mailbox &) = delete;
+  Mailbox &operator=(const Mailbox &) = delete;
+
+  // Returns the unconsumed item this one replaced, if any
+  std::unique_ptr<T> put(std::unique_ptr<T> item) {
+    std::unique_ptr<T> replaced(
+        slot_.exchange(item.release(), std::memory_order_acq_rel));
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
+    return replaced;
+  }
+
+  // The waiting item, or null
+  std::unique_ptr<T> take() {
+    return std::unique_ptr<T>(
+        slot_.exchange(nullptr, std::memory_order_acq_rel));
+  }
+
+  // Block until an item is waiting or close() is called. Returns false
+  // once closed.
+  bool wait() {
+    while (!closed_.load(std::memory_order_acquire)) {
+      uint32_t seen = signal_.load(std::memory_order_acquire);
+      if (slot_.load(std::memory_order_acquire))
+        return true;
+      signal_.wait(seen, std::memory_order_acquire);
+    }
+    return false;
+  }
+
+  // Wake the consumer for good
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_all();
+  }
+
+private:
+  std::atomic<T *> slot_{nullptr};
+  std::atomic<uint32_t> signal_{0};
+  std::atomic<bool> closed_{false};
+};
+
+} // namespace magickeyboard
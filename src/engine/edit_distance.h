@@ -0,0 +1,128 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Bounded Edit Distance
+ *
+ * Levenshtein distance for the key-sequence matchers (MagicKeyboardEngine
+ * and swipe::SwipeEngine). The shorter string is encoded as a 64-bit match
+ * mask per character and the DP columns are advanced a whole word at a time
+ * (Myers 1999, in Hyyrö's Levenshtein formulation), so a comparison is
+ * O(n) word operations with no allocation. Strings whose shorter side is
+ * longer than 64 characters fall back to the classic DP.
+ *
+ * Both functions return the exact distance when it is <= limit, and
+ * limit + 1 otherwise.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+namespace editdist {
+
+// Longest pattern handled bit-parallel
+constexpr size_t MAX_BITS = 64;
+
+namespace detail {
+
+inline unsigned char fold(char c, bool foldCase) {
+  auto u = static_cast<unsigned char>(c);
+  return foldCase ? static_cast<unsigned char>(std::tolower(u)) : u;
+}
+
+} // namespace detail
+
+// Row-by-row DP with early exit once a whole row exceeds limit. Kept as
+// the reference and the fallback for very long strings.
+inline int boundedDP(std::string_view s1, std::string_view s2, int limit,
+                     bool foldCase = false) {
+  int n = static_cast<int>(s1.length());
+  int m = static_cast<int>(s2.length());
+  if (std::abs(n - m) > limit)
+    return limit + 1;
+
+  std::vector<int> prev(m + 1);
+  std::vector<int> curr(m + 1);
+  for (int j = 0; j <= m; ++j)
+    prev[j] = j;
+
+  for (int i = 1; i <= n; ++i) {
+    curr[0] = i;
+    int minRow = curr[0];
+    for (int j = 1; j <= m; ++j) {
+      int cost = detail::fold(s1[i - 1], foldCase) ==
+                         detail::fold(s2[j - 1], foldCase)
+                     ? 0
+                     : 1;
+      curr[j] = std::min({curr[j - 1] + 1, prev[j] + 1, prev[j - 1] + cost});
+      minRow = std::min(minRow, curr[j]);
+    }
+    if (minRow > limit)
+      return limit + 1;
+    std::swap(prev, curr);
+  }
+  return std::min(prev[m], limit + 1);
+}
+
+// Bit-parallel bounded Levenshtein distance
+inline int bounded(std::string_view s1, std::string_view s2, int limit,
+                   bool foldCase = false) {
+  // Edit distance is symmetric: the shorter string becomes the pattern
+  std::string_view pattern = s1.length() <= s2.length() ? s1 : s2;
+  std::string_view text = s1.length() <= s2.length() ? s2 : s1;
+  int m = static_cast<int>(pattern.length());
+  int n = static_cast<int>(text.length());
+
+  if (n - m > limit)
+    return limit + 1;
+  if (m == 0)
+    return n;
+  if (pattern.length() > MAX_BITS)
+    return boundedDP(s1, s2, limit, foldCase);
+
+  // Match masks. Only entries for characters in either string are read,
+  // so only those are cleared; the rest of the table stays uninitialized.
+  uint64_t peq[256];
+  for (char c : text)
+    peq[detail::fold(c, foldCase)] = 0;
+  for (char c : pattern)
+    peq[detail::fold(c, foldCase)] = 0;
+  for (int i = 0; i < m; ++i)
+    peq[detail::fold(pattern[i], foldCase)] |= uint64_t{1} << i;
+
+  // Vertical deltas of the current column, all +1 at the start (D[i][0] =
+  // i). Bits above the pattern length carry junk that never flows down.
+  uint64_t pv = ~uint64_t{0};
+  uint64_t mv = 0;
+  const uint64_t last = uint64_t{1} << (m - 1);
+  int score = m;
+
+  for (int j = 0; j < n; ++j) {
+    uint64_t eq = peq[detail::fold(text[j], foldCase)];
+    uint64_t xv = eq | mv;
+    uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+
+    if (ph & last)
+      score++;
+    else if (mh & last)
+      score--;
+
+    // Top row is D[0][j] = j, so a +1 horizontal delta shifts in
+    ph = (ph << 1) | 1;
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+
+    // Each remaining column can lower the score by at most one
+    if (score - (n - j - 1) > limit)
+      return limit + 1;
+  }
+  return std::min(score, limit + 1);
+}
+
+} // namespace editdist
@@ -0,0 +1,120 @@
+/**
+ * Edit Distance Benchmark
+ *
+ * Compares the bit-parallel bounded edit distance against the row DP it
+ * replaced: checks that both agree on every pair, then times each over
+ * noisy key sequences matched against the whole dictionary.
+ * Run: g++ -O2 -std=c++17 edit_distance_bench.cpp -o edit_distance_bench
+ * && ./edit_distance_bench [../../data/dict/words.txt]
+ */
+
+#include "edit_distance.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int LIMIT = 7; // Same cap as the key-sequence matchers
+constexpr int QUERIES = 200;
+constexpr int ROUNDS = 5;
+
+// Swipe-like noise: doubled letters, dropped letters, neighbour slips
+std::string perturb(const std::string &word, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> op(0, 5);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::string out;
+  for (char c : word) {
+    switch (op(rng)) {
+    case 0:
+      out += c;
+      out += c;
+      break;
+    case 1:
+      break;
+    case 2:
+      out += static_cast<char>(letter(rng));
+      break;
+    default:
+      out += c;
+    }
+  }
+  return out.empty() ? word : out;
+}
+
+template <typename F>
+double nsPerPair(F distance, const std::vector<std::string> &queries,
+                 const std::vector<std::string> &words, long long &sink) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (const auto &q : queries) {
+      for (const auto &w : words) {
+        sink += distance(q, w);
+      }
+    }
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count();
+  return static_cast<double>(ns) / (ROUNDS * queries.size() * words.size());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "../../data/dict/words.txt";
+  std::ifstream file(path);
+  std::vector<std::string> words;
+  std::string word;
+  while (file >> word) {
+    words.push_back(word);
+  }
+  if (words.empty()) {
+    std::fprintf(stderr, "No words loaded from %s\n", path);
+    return 1;
+  }
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> pick(0, words.size() - 1);
+  std::vector<std::string> queries;
+  for (int i = 0; i < QUERIES; ++i) {
+    queries.push_back(perturb(words[pick(rng)], rng));
+  }
+
+  // Correctness: identical results on every pair, both case modes
+  size_t mismatches = 0;
+  for (const auto &q : queries) {
+    for (const auto &w : words) {
+      for (bool fold : {false, true}) {
+        if (editdist::bounded(q, w, LIMIT, fold) !=
+            editdist::boundedDP(q, w, LIMIT, fold)) {
+          if (mismatches++ < 5)
+            std::printf("MISMATCH '%s' '%s'\n", q.c_str(), w.c_str());
+        }
+      }
+    }
+  }
+
+  long long sink = 0;
+  double dp = nsPerPair(
+      [](const std::string &a, const std::string &b) {
+        return editdist::boundedDP(a, b, LIMIT);
+      },
+      queries, words, sink);
+  double bits = nsPerPair(
+      [](const std::string &a, const std::string &b) {
+        return editdist::bounded(a, b, LIMIT);
+      },
+      queries, words, sink);
+
+  std::printf("%zu words x %d queries, limit %d\n", words.size(), QUERIES,
+              LIMIT);
+  std::printf("  row DP:       %7.1f ns/pair\n", dp);
+  std::printf("  bit-parallel: %7.1f ns/pair (%.1fx)\n", bits, dp / bits);
+  std::printf("  mismatches:   %zu (checksum %lld)\n", mismatches, sink);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Input Hold
+ *
+ * Keeps taps in order behind a swipe that is still being decoded. A swipe
+ * is decoded off the event loop, and its result commits text (the top
+ * candidate, when the next key is a space or a letter), so a key tapped
+ * before the result is back has to wait for it: applied straight away it
+ * would either land ahead of the swiped word or throw the swipe away.
+ *
+ * The engine asks hold() for every key and shortcut action. While a swipe
+ * is pending, or anything is already held, the input is queued instead.
+ * Once the swipe's result has been applied (or the swipe abandoned)
+ * release() hands the queue back in arrival order. Input from the priority
+ * lane is also queued while older stream messages (a swipe path, a paste,
+ * a picked candidate) are still buffered, since it is read ahead of them.
+ * Nothing waits forever: once the oldest held input is hold_config::MAX_MS
+ * old, expire() drops the swipe and applies the queue regardless.
+ * Event loop only.
+ */
+
+#include <chrono>
+#include <deque>
+#include <string>
+
+namespace magickeyboard {
+
+namespace hold_config {
+// Longest input waits for a swipe's result (or for buffered stream
+// messages) before it is applied anyway and the swipe dropped
+constexpr int MAX_MS = 300;
+} // namespace hold_config
+
+class InputHold {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Input {
+    std::string name;    // Key name, or shortcut action
+    bool action = false; // A shortcut action (copy, paste, ...)
+    bool lane = false;   // From the priority lane
+  };
+
+  // A swipe was queued for decoding; input waits for its result
+  void swipeStarted() { swipePending_ = true; }
+  // Its result was applied, or it was cancelled
+  void swipeFinished() { swipePending_ = false; }
+  bool swipePending() const { return swipePending_; }
+
+  // Queue input if it has to wait. False: apply it now. streamBacklog:
+  // stream messages are buffered that lane input must not overtake.
+  bool hold(Input input, bool streamBacklog = false,
+            Clock::time_point now = Clock::now()) {
+    if (!swipePending_ && queue_.empty() && !(input.lane && streamBacklog))
+      return false;
+    if (queue_.empty())
+      heldSince_ = now;
+    queue_.push_back(std::move(input));
+    held_++;
+    return true;
+  }
+
+  // When the oldest held input has waited hold_config::MAX_MS; only
+  // meaningful while something is held
+  Clock::time_point deadline() const {
+    return heldSince_ + std::chrono::milliseconds(hold_config::MAX_MS);
+  }
+  bool overdue(Clock::time_point now = Clock::now()) const {
+    return !queue_.empty() && now >= deadline();
+  }
+
+  // Hand held input to apply, oldest first, while no swipe is pending,
+  // stopping at lane input while streamBacklog. apply must not call
+  // hold() for what it is given. A release() from inside apply is a
+  // no-op; the outer one carries on in order.
+  template <typename Apply>
+  void release(Apply &&apply, bool streamBacklog = false) {
+    if (releasing_)
+      return;
+    releasing_ = true;
+    while (!queue_.empty() && !swipePending_ &&
+           !(queue_.front().lane && streamBacklog)) {
+      Input input = std::move(queue_.front());
+      queue_.pop_front();
+      apply(input);
+    }
+    releasing_ = false;
+  }
+
+  // The cap: once overdue(), stop waiting on the swipe and apply
+  // everything held, stream backlog or not. True if it fired; the caller
+  // drops the swipe's result.
+  template <typename Apply>
+  bool expire(Apply &&apply, Clock::time_point now = Clock::now()) {
+    if (!overdue(now))
+      return false;
+    swipePending_ = false;
+    release(apply, false);
+    return true;
+  }
+
+  void clear() { queue_.clear(); }
+  bool empty() const { return queue_.empty(); }
+  size_t size() const { return queue_.size(); }
+  // Inputs that have had to wait, ever
+  unsigned long long held() const { return held_; }
+
+private:
+  std::deque<Input> queue_;
+  Clock::time_point heldSince_; // When the oldest held input arrived
+  bool swipePending_ = false;
+  bool releasing_ = false;
+  unsigned long long held_ = 0;
+};
+
+} // namespace magickeyboard
@@ -0,0 +1,223 @@
+/**
+ * Input Hold Test
+ *
+ * Keys and actions tapped while a swipe is still decoding go through
+ * InputHold: they wait for the swipe's result, come back out in arrival
+ * order, and never wait longer than hold_config::MAX_MS. A key read early
+ * from the priority lane must also wait for the stream messages buffered
+ * ahead of it.
+ * Run: g++ -std=c++17 input_hold_test.cpp -o input_hold_test
+ * && ./input_hold_test
+ */
+
+#include "input_hold.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace magickeyboard;
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define YELLOW "\033[33m"
+#define RESET "\033[0m"
+
+int testsRun = 0;
+int testsPassed = 0;
+
+void runTest(const std::string &name, void (*fn)()) {
+  testsRun++;
+  try {
+    fn();
+    testsPassed++;
+    std::cout << GREEN << "✓ " << RESET << name << std::endl;
+  } catch (const std::exception &e) {
+    std::cout << RED << "✗ " << RESET << name << ": " << e.what() << std::endl;
+  }
+}
+
+#define ASSERT_TRUE(cond)                                                      \
+  if (!(cond))                                                                 \
+  throw std::runtime_error("Assertion failed: " #cond)
+#define ASSERT_EQ(a, b)                                                        \
+  if ((a) != (b))                                                              \
+  throw std::runtime_error("Assertion failed: " #a " == " #b)
+
+using Clock = InputHold::Clock;
+const auto CAP = std::chrono::milliseconds(hold_config::MAX_MS);
+const auto TICK = std::chrono::milliseconds(1);
+
+// Records what the hold hands back, as the engine's applyHeldInput does
+struct Applied {
+  std::string order;
+  void operator()(const InputHold::Input &in) {
+    order += in.action ? "[" + in.name + "]" : in.name;
+  }
+};
+
+void test_noSwipeAppliesAtOnce() {
+  InputHold hold;
+  ASSERT_TRUE(!hold.hold({"a"}));
+  ASSERT_TRUE(hold.empty());
+  ASSERT_EQ(hold.held(), 0u);
+}
+
+void test_swipeHoldsUntilFinished() {
+  InputHold hold;
+  Applied applied;
+  hold.swipeStarted();
+  ASSERT_TRUE(hold.hold({"space"})); // Tapped before the decode finished
+  hold.release(applied);
+  ASSERT_EQ(applied.order, ""); // Still decoding
+  hold.swipeFinished();
+  hold.release(applied);
+  ASSERT_EQ(applied.order, "space");
+  ASSERT_TRUE(hold.empty());
+  ASSERT_EQ(hold.held(), 1u);
+}
+
+void test_keysAndActionsKeepOrder() {
+  InputHold hold;
+  Applied applied;
+  hold.swipeStarted();
+  hold.hold({"s"});
+  hold.hold({"copy", true});
+  hold.hold({"space"});
+  ASSERT_EQ(hold.size(), 3u);
+  hold.swipeFinished();
+  hold.release(applied);
+  ASSERT_EQ(applied.order, "s[copy]space");
+}
+
+void test_inputBehindHeldInputWaits() {
+  // Once anything is held, later input queues behind it even without a
+  // swipe, or it would overtake
+  InputHold hold;
+  Applied applied;
+  hold.swipeStarted();
+  hold.hold({"a"});
+  hold.swipeFinished();
+  ASSERT_TRUE(hold.hold({"b"}));
+  hold.release(applied);
+  ASSERT_EQ(applied.order, "ab");
+}
+
+void test_releaseStopsAtNextSwipe() {
+  // A swipe started from inside apply holds everything after it
+  InputHold hold;
+  std::string order;
+  hold.swipeStarted();
+  hold.hold({"a"});
+  hold.hold({"b"});
+  hold.swipeFinished();
+  hold.release([&](const InputHold::Input &in) {
+    order += in.name;
+    hold.swipeStarted();
+  });
+  ASSERT_EQ(order, "a");
+  ASSERT_EQ(hold.size(), 1u);
+}
+
+void test_nestedReleaseKeepsOrder() {
+  InputHold hold;
+  std::string order;
+  hold.swipeStarted();
+  hold.hold({"a"});
+  hold.hold({"b"});
+  hold.swipeFinished();
+  hold.release([&](const InputHold::Input &in) {
+    order += in.name;
+    // Applying a key may cancel a swipe, which releases again
+    hold.release([&](const InputHold::Input &inner) { order += inner.name; });
+  });
+  ASSERT_EQ(order, "ab");
+}
+
+void test_laneKeyWaitsForStreamBacklog() {
+  InputHold hold;
+  Applied applied;
+  ASSERT_TRUE(!hold.hold({"x"}, true)); // Stream input is the backlog
+  ASSERT_TRUE(hold.hold({"a", false, true}, true));
+  ASSERT_TRUE(hold.hold({"b"}, true)); // Behind a held key
+  hold.release(applied, true);
+  ASSERT_EQ(applied.order, ""); // The buffered message is still being handled
+  applied.order += "[paste]";
+  hold.release(applied, false);
+  ASSERT_EQ(applied.order, "[paste]ab");
+}
+
+void test_laneKeyWithoutBacklog() {
+  InputHold hold;
+  ASSERT_TRUE(!hold.hold({"a", false, true}, false));
+}
+
+void test_capFromOldestHeldInput() {
+  InputHold hold;
+  auto t0 = Clock::now();
+  hold.swipeStarted();
+  hold.hold({"a"}, false, t0);
+  hold.hold({"b"}, false, t0 + CAP / 2); // Does not push the deadline
+  ASSERT_TRUE(hold.deadline() == t0 + CAP);
+  ASSERT_TRUE(!hold.overdue(t0 + CAP - TICK));
+  ASSERT_TRUE(hold.overdue(t0 + CAP));
+}
+
+void test_capAppliesPastSwipeAndBacklog() {
+  InputHold hold;
+  Applied applied;
+  auto t0 = Clock::now();
+  hold.swipeStarted();
+  hold.hold({"a", false, true}, true, t0);
+  hold.hold({"space"}, true, t0);
+
+  ASSERT_TRUE(!hold.expire(applied, t0 + CAP - TICK));
+  ASSERT_EQ(applied.order, "");
+  ASSERT_TRUE(hold.swipePending());
+
+  ASSERT_TRUE(hold.expire(applied, t0 + CAP));
+  ASSERT_EQ(applied.order, "aspace");
+  ASSERT_TRUE(hold.empty());
+  ASSERT_TRUE(!hold.swipePending()); // The swipe was given up on
+  ASSERT_TRUE(!hold.overdue(t0 + CAP * 2));
+}
+
+void test_capRestartsAfterRelease() {
+  InputHold hold;
+  Applied applied;
+  auto t0 = Clock::now();
+  hold.swipeStarted();
+  hold.hold({"a"}, false, t0);
+  hold.swipeFinished();
+  hold.release(applied);
+
+  auto t1 = t0 + CAP * 2;
+  hold.swipeStarted();
+  hold.hold({"b"}, false, t1);
+  ASSERT_TRUE(!hold.overdue(t1 + CAP - TICK));
+  ASSERT_TRUE(!hold.expire(applied, t1 + CAP - TICK));
+  ASSERT_TRUE(hold.expire(applied, t1 + CAP));
+  ASSERT_EQ(applied.order, "ab");
+}
+
+int main() {
+  std::cout << YELLOW << "\n=== Input Hold Tests ===" << RESET << "\n\n";
+
+  runTest("noSwipeAppliesAtOnce", test_noSwipeAppliesAtOnce);
+  runTest("swipeHoldsUntilFinished", test_swipeHoldsUntilFinished);
+  runTest("keysAndActionsKeepOrder", test_keysAndActionsKeepOrder);
+  runTest("inputBehindHeldInputWaits", test_inputBehindHeldInputWaits);
+  runTest("releaseStopsAtNextSwipe", test_releaseStopsAtNextSwipe);
+  runTest("nestedReleaseKeepsOrder", test_nestedReleaseKeepsOrder);
+  runTest("laneKeyWaitsForStreamBacklog", test_laneKeyWaitsForStreamBacklog);
+  runTest("laneKeyWithoutBacklog", test_laneKeyWithoutBacklog);
+  runTest("capFromOldestHeldInput", test_capFromOldestHeldInput);
+  runTest("capAppliesPastSwipeAndBacklog", test_capAppliesPastSwipeAndBacklog);
+  runTest("capRestartsAfterRelease", test_capRestartsAfterRelease);
+
+  std::cout << "\n"
+            << YELLOW << "Results: " << RESET << testsPassed << "/" << testsRun
+            << " passed\n\n";
+
+  return (testsPassed == testsRun) ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include "BigramIndex.h"
+#include "Lexicon.h"
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+
+namespace magickeyboard::lexicon {
+
+namespace {
+
+void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+uint32_t getVarint(const uint8_t *&p) {
+  uint32_t v = 0;
+  int shift = 0;
+  while (*p & 0x80) {
+    v |= static_cast<uint32_t>(*p++ & 0x7f) << shift;
+    shift += 7;
+  }
+  return v | static_cast<uint32_t>(*p++) << shift;
+}
+
+int letter(char c) {
+  int l = std::tolower(static_cast<unsigned char>(c)) - 'a';
+  return l >= 0 && l < 26 ? l : -1;
+}
+
+} // namespace
+
+void BigramIndex::terms(std::string_view s, std::vector<int> &out) {
+  out.clear();
+  for (size_t i = 0; i + 1 < s.length(); ++i) {
+    int a = letter(s[i]);
+    int b = letter(s[i + 1]);
+    if (a >= 0 && b >= 0)
+      out.push_back(a * 26 + b);
+  }
+  if (!s.empty() && letter(s.front()) >= 0)
+    out.push_back(26 * 26 + letter(s.front()));
+  if (!s.empty() && letter(s.back()) >= 0)
+    out.push_back(26 * 26 + 26 + letter(s.back()));
+
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void BigramIndex::build(const Lexicon &lexicon) {
+  std::vector<std::vector<uint32_t>> lists(TERM_COUNT);
+  std::vector<int> t;
+  for (uint32_t id = 0; id < lexicon.size(); ++id) {
+    terms(lexicon.word(id), t);
+    for (int term : t)
+      lists[term].push_back(id);
+  }
+
+  postings_.clear();
+  offsets_.assign(1, 0);
+  docCount_.clear();
+  for (const auto &list : lists) {
+    uint32_t prev = 0;
+    for (uint32_t id : list) {
+      putVarint(postings_, id - prev);
+      prev = id;
+    }
+    offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+    docCount_.push_back(static_cast<uint32_t>(list.size()));
+  }
+  postings_.shrink_to_fit();
+  wordCount_ = lexicon.size();
+}
+
+std::vector<BigramIndex::ScoredWord>
+BigramIndex::topK(const std::string &query, size_t k,
+                  uint32_t minScore) const {
+  if (k == 0 || wordCount_ == 0)
+    return {};
+
+  std::vector<int> qt;
+  terms(query, qt);
+  std::sort(qt.begin(), qt.end(),
+            [this](int a, int b) { return docCount_[a] < docCount_[b]; });
+
+  // Accumulated scores, sorted by word id
+  std::vector<ScoredWord> acc;
+  std::vector<ScoredWord> next;
+  std::vector<uint32_t> scores;
+
+  for (size_t i = 0; i < qt.size(); ++i) {
+    // Best score the k-th word already has
+    uint32_t kth = 0;
+    if (acc.size() >= k) {
+      scores.clear();
+      for (const auto &sw : acc)
+        scores.push_back(sw.score);
+      std::nth_element(scores.begin(), scores.begin() + (k - 1), scores.end(),
+                       std::greater<uint32_t>());
+      kth = scores[k - 1];
+    }
+
+    // A word first seen now scores at most the number of terms left
+    uint32_t remaining = static_cast<uint32_t>(qt.size() - i);
+    bool admitNew = remaining >= std::max(minScore, kth);
+    if (!admitNew && acc.empty())
+      break;
+
+    const uint8_t *p = postings_.data() + offsets_[qt[i]];
+    const uint8_t *end = postings_.data() + offsets_[qt[i] + 1];
+    next.clear();
+    size_t a = 0;
+    uint32_t id = 0;
+    while (p < end) {
+      // Past the last gathered word nothing more can be updated
+      if (!admitNew && a == acc.size())
+        break;
+      id += getVarint(p);
+      while (a < acc.size() && static_cast<uint32_t>(acc[a].wordId) < id)
+        next.push_back(acc[a++]);
+      if (a < acc.size() && static_cast<uint32_t>(acc[a].wordId) == id) {
+        next.push_back({acc[a].wordId, acc[a].score + 1});
+        a++;
+      } else if (admitNew) {
+        next.push_back({static_cast<int>(id), 1});
+      }
+    }
+    while (a < acc.size())
+      next.push_back(acc[a++]);
+    acc.swap(next);
+  }
+
+  acc.erase(std::remove_if(acc.begin(), acc.end(),
+                           [minScore](const ScoredWord &sw) {
+                             return sw.score < minScore;
+                           }),
+            acc.end());
+  auto better = [](const ScoredWord &x, const ScoredWord &y) {
+    if (x.score != y.score)
+      return x.score > y.score;
+    return x.wordId < y.wordId;
+  };
+  if (acc.size() > k) {
+    std::partial_sort(acc.begin(), acc.begin() + k, acc.end(), better);
+    acc.resize(k);
+  } else {
+    std::sort(acc.begin(), acc.end(), better);
+  }
+  return acc;
+}
+
+} // namespace magickeyboard::lexicon
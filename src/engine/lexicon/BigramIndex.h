@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace magickeyboard::lexicon {
+
+class Lexicon;
+
+// Inverted index from letter bigrams to word ids, for retrieving words
+// that share most of a key sequence's bigrams even when its first or last
+// key is wrong. Positional anchors (first letter, last letter) are indexed
+// as extra terms so that ends still count when they do match.
+//
+// Posting lists are sorted word ids stored as varint-coded gaps.
+class BigramIndex {
+public:
+    struct ScoredWord {
+        int wordId;
+        uint32_t score; // Distinct query terms the word contains
+    };
+
+    // Index every word of the lexicon under its lexicon id
+    void build(const Lexicon& lexicon);
+
+    // Up to k words with the highest overlap, best first (ties: lower id).
+    // Words matching fewer than minScore terms are never returned.
+    //
+    // Terms are merged rarest first. Once the terms left could no longer
+    // lift an unseen word to minScore or to the current k-th best score,
+    // later postings only update words already gathered (max-score
+    // pruning) and are decoded no further than the last of them.
+    std::vector<ScoredWord> topK(const std::string& query, size_t k,
+                                 uint32_t minScore) const;
+
+    size_t wordCount() const { return wordCount_; }
+    size_t postingBytes() const { return postings_.size(); }
+
+private:
+    // 26*26 bigrams, then 26 first-letter and 26 last-letter anchors
+    static constexpr int TERM_COUNT = 26 * 26 + 26 + 26;
+
+    static void terms(std::string_view s, std::vector<int>& out);
+
+    std::vector<uint8_t> postings_;  // All lists, back to back
+    std::vector<uint32_t> offsets_;  // TERM_COUNT + 1 byte offsets
+    std::vector<uint32_t> docCount_; // Ids per term
+    size_t wordCount_ = 0;
+};
+
+} // namespace magickeyboard::lexicon
@@ -0,0 +1,80 @@
+#include "Lexicon.h"
+
+namespace magickeyboard::lexicon {
+
+namespace {
+
+int letter(char c) {
+  return c >= 'a' && c <= 'z' ? c - 'a' : -1;
+}
+
+} // namespace
+
+void Lexicon::Builder::reserve(size_t words, size_t bytes) {
+  text_.reserve(bytes);
+  offset_.reserve(words + 1);
+  frequency_.reserve(words);
+}
+
+uint32_t Lexicon::Builder::add(std::string_view word, uint32_t frequency) {
+  text_.append(word);
+  offset_.push_back(static_cast<uint32_t>(text_.size()));
+  frequency_.push_back(frequency);
+  return static_cast<uint32_t>(frequency_.size() - 1);
+}
+
+std::vector<Trie::Entry> Lexicon::Builder::trieEntries() const {
+  std::vector<Trie::Entry> entries;
+  entries.reserve(size());
+  for (uint32_t id = 0; id < size(); ++id)
+    entries.push_back({std::string(word(id)), frequency_[id],
+                       static_cast<int>(id)});
+  return entries;
+}
+
+std::shared_ptr<const Lexicon>
+Lexicon::Builder::build(std::unique_ptr<Trie> trie) {
+  std::shared_ptr<Lexicon> lex(new Lexicon());
+  lex->text_ = std::move(text_);
+  lex->text_.shrink_to_fit();
+  lex->offset_ = std::move(offset_);
+  lex->frequency_ = std::move(frequency_);
+  lex->trie_ = std::move(trie);
+  text_.clear();
+  offset_.assign(1, 0);
+  frequency_.clear();
+
+  // Counting sort of ids by (first, last) letter; words that do not start
+  // and end with a-z are in no bucket
+  constexpr size_t BUCKETS = 26 * 26;
+  std::vector<int> bucketOf(lex->size(), -1);
+  lex->bucketStart_.assign(BUCKETS + 1, 0);
+  for (uint32_t id = 0; id < lex->size(); ++id) {
+    if (lex->length(id) == 0)
+      continue;
+    int f = letter(lex->first(id)), l = letter(lex->last(id));
+    if (f < 0 || l < 0)
+      continue;
+    bucketOf[id] = f * 26 + l;
+    lex->bucketStart_[bucketOf[id] + 1]++;
+  }
+  for (size_t b = 0; b < BUCKETS; ++b)
+    lex->bucketStart_[b + 1] += lex->bucketStart_[b];
+  lex->bucketIds_.resize(lex->bucketStart_[BUCKETS]);
+  std::vector<uint32_t> fill(lex->bucketStart_.begin(),
+                             lex->bucketStart_.end() - 1);
+  for (uint32_t id = 0; id < lex->size(); ++id) {
+    if (bucketOf[id] >= 0)
+      lex->bucketIds_[fill[bucketOf[id]]++] = id;
+  }
+  return lex;
+}
+
+size_t Lexicon::memoryBytes() const {
+  return text_.capacity() +
+         (offset_.capacity() + frequency_.capacity() +
+          bucketStart_.capacity() + bucketIds_.capacity()) *
+             sizeof(uint32_t);
+}
+
+} // namespace magickeyboard::lexicon
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Trie.h"
+
+namespace magickeyboard::lexicon {
+
+// The dictionary every decoder reads, loaded once and never modified.
+//
+// Words are stored back to back in one arena and addressed by id (their
+// position in the source list). Per-word data lives in flat columns
+// indexed by id: frequency, first and last letter, length. The
+// first/last-letter buckets are one id array with 26*26 + 1 offsets, and
+// the trie's word ids are these ids. Decoders keep ids and look words up
+// here instead of holding their own copies.
+//
+// A Lexicon is built with Lexicon::Builder and handed out as
+// shared_ptr<const Lexicon>: whoever still holds a pointer keeps the whole
+// thing alive, so it can be shared across threads without locking.
+class Lexicon {
+public:
+    class Builder {
+    public:
+        void reserve(size_t words, size_t bytes);
+
+        // Append a word (already normalized by the caller); returns its id
+        uint32_t add(std::string_view word, uint32_t frequency);
+
+        size_t size() const { return frequency_.size(); }
+        std::string_view word(uint32_t id) const {
+            return std::string_view(text_).substr(
+                offset_[id], offset_[id + 1] - offset_[id]);
+        }
+
+        // Entries for Trie::build(), with ids matching the lexicon's
+        std::vector<Trie::Entry> trieEntries() const;
+
+        // Freeze the words added so far. trie may be null for decoders
+        // that do no prefix or fuzzy search. The builder is left empty.
+        std::shared_ptr<const Lexicon> build(std::unique_ptr<Trie> trie);
+
+    private:
+        std::string text_;
+        std::vector<uint32_t> offset_{0};
+        std::vector<uint32_t> frequency_;
+    };
+
+    size_t size() const { return frequency_.size(); }
+    bool empty() const { return frequency_.empty(); }
+
+    std::string_view word(uint32_t id) const {
+        return std::string_view(text_).substr(
+            offset_[id], offset_[id + 1] - offset_[id]);
+    }
+    uint32_t frequency(uint32_t id) const { return frequency_[id]; }
+    uint32_t length(uint32_t id) const {
+        return offset_[id + 1] - offset_[id];
+    }
+    char first(uint32_t id) const { return text_[offset_[id]]; }
+    char last(uint32_t id) const { return text_[offset_[id + 1] - 1]; }
+
+    // Ids of the words starting with letter f and ending with letter l
+    // (both 0-25), in id order
+    std::span<const uint32_t> bucket(int f, int l) const {
+        size_t b = static_cast<size_t>(f) * 26 + l;
+        return std::span<const uint32_t>(bucketIds_).subspan(
+            bucketStart_[b], bucketStart_[b + 1] - bucketStart_[b]);
+    }
+
+    // Null if built without one
+    const Trie* trie() const { return trie_.get(); }
+
+    // Arena, columns and buckets (the trie reports its own)
+    size_t memoryBytes() const;
+
+private:
+    Lexicon() = default;
+
+    std::string text_;
+    std::vector<uint32_t> offset_;    // size() + 1 arena offsets
+    std::vector<uint32_t> frequency_; // By id
+    std::vector<uint32_t> bucketStart_; // 26*26 + 1 offsets into bucketIds_
+    std::vector<uint32_t> bucketIds_;
+    std::unique_ptr<Trie> trie_;
+};
+
+} // namespace magickeyboard::lexicon
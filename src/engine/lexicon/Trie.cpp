@@ -1,17 +1,57 @@
 #include "Trie.h"
 #include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace magickeyboard::lexicon {
 
-TrieNode::TrieNode() {
-  std::fill(std::begin(children), std::end(children), -1);
-}
+namespace {
+
+// Image header, in 32-bit words
+constexpr uint32_t MAGIC = 0x57444b4d; // "MKDW"
+constexpr uint32_t VERSION = 1;
+enum Header {
+  H_MAGIC,
+  H_VERSION,
+  H_STATES,
+  H_SLOTS,
+  H_WORDS,
+  H_STAMP_LO,
+  H_STAMP_HI,
+  H_RESERVED,
+  HEADER_WORDS
+};
+
+// Placement gives up on the free slots after this many tries and appends
+constexpr size_t MAX_FREE_PROBES = 64;
 
-Trie::Trie() {
-  // Initialize root node
-  nodes_.emplace_back();
+struct BuildState {
+  bool terminal = false;
+  std::vector<std::pair<uint8_t, uint32_t>> edges; // Sorted by label
+};
+
+} // namespace
+
+EditCosts::EditCosts() {
+  for (int q = 0; q < 27; ++q) {
+    for (int w = 0; w < 27; ++w)
+      substitute[q][w] = q == w ? 0.0f : 1.0f;
+    insert[q] = 1.0f;
+  }
 }
 
+Trie::Trie() { build({}); }
+
+Trie::~Trie() { unmap(); }
+
 int Trie::charToIndex(char c) {
   if (c >= 'a' && c <= 'z')
     return c - 'a';
@@ -20,36 +60,538 @@ int Trie::charToIndex(char c) {
   return -1;
 }
 
-void Trie::insert(const std::string &word, uint32_t freq) {
-  int curr = 0; // Root index
-  for (char c : word) {
-    int idx = charToIndex(c);
-    if (idx == -1)
-      continue; // Skip invalid chars
+void Trie::build(std::vector<Entry> entries) {
+  // Normalize, then sort; stable so the last of a repeated word is last
+  for (auto &e : entries) {
+    std::string key;
+    for (char c : e.word) {
+      int idx = charToIndex(c);
+      if (idx != -1)
+        key += static_cast<char>(idx);
+    }
+    e.word = std::move(key);
+  }
+  std::stable_sort(
+      entries.begin(), entries.end(),
+      [](const Entry &a, const Entry &b) { return a.word < b.word; });
+  std::vector<Entry> words;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (i + 1 < entries.size() && entries[i + 1].word == entries[i].word)
+      continue;
+    words.push_back(std::move(entries[i]));
+  }
+
+  // ---- Minimal DAWG from sorted input (Daciuk et al. 2000) ----
+  // path holds the states of the previous word. Once the next word leaves
+  // it, the abandoned tail is final: each state is replaced by an
+  // equivalent registered one, or registered itself.
+  std::vector<BuildState> states(1);
+  std::unordered_map<std::string, uint32_t> registry;
+  std::vector<uint32_t> path{0};
+
+  auto signature = [&states](uint32_t s) {
+    std::string key(1, states[s].terminal ? '1' : '0');
+    for (const auto &[label, child] : states[s].edges) {
+      key += static_cast<char>(label);
+      key.append(reinterpret_cast<const char *>(&child), sizeof(child));
+    }
+    return key;
+  };
+  auto minimize = [&](size_t depth) {
+    while (path.size() > depth + 1) {
+      uint32_t child = path.back();
+      path.pop_back();
+      auto [it, inserted] = registry.emplace(signature(child), child);
+      if (!inserted)
+        states[path.back()].edges.back().second = it->second;
+    }
+  };
+
+  const std::string *prev = nullptr;
+  for (const auto &w : words) {
+    size_t common = 0;
+    if (prev) {
+      while (common < prev->size() && common < w.word.size() &&
+             (*prev)[common] == w.word[common])
+        common++;
+    }
+    minimize(common);
+    for (size_t i = common; i < w.word.size(); ++i) {
+      uint32_t id = static_cast<uint32_t>(states.size());
+      states.emplace_back();
+      states[path.back()].edges.push_back(
+          {static_cast<uint8_t>(w.word[i]), id});
+      path.push_back(id);
+    }
+    states[path.back()].terminal = true;
+    prev = &w.word;
+  }
+  minimize(0);
+
+  // Renumber the states still reachable, breadth first (root stays 0)
+  std::vector<uint32_t> order{0};
+  std::vector<uint32_t> newId(states.size(), UINT32_MAX);
+  newId[0] = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    for (const auto &edge : states[order[i]].edges) {
+      if (newId[edge.second] == UINT32_MAX) {
+        newId[edge.second] = static_cast<uint32_t>(order.size());
+        order.push_back(edge.second);
+      }
+    }
+  }
+  const uint32_t stateCount = static_cast<uint32_t>(order.size());
+
+  // Words below each state; children are numbered after their parents
+  // only along some path, so count in reverse topological order
+  std::vector<uint32_t> below(stateCount, UINT32_MAX);
+  std::vector<uint32_t> stack{0};
+  while (!stack.empty()) {
+    uint32_t s = stack.back();
+    const auto &st = states[order[s]];
+    bool ready = true;
+    for (const auto &edge : st.edges) {
+      if (below[newId[edge.second]] == UINT32_MAX) {
+        stack.push_back(newId[edge.second]);
+        ready = false;
+      }
+    }
+    if (!ready)
+      continue;
+    stack.pop_back();
+    uint32_t n = st.terminal ? 1 : 0;
+    for (const auto &edge : st.edges)
+      n += below[newId[edge.second]];
+    below[s] = n;
+  }
+
+  // ---- Double-array placement ----
+  std::vector<int32_t> base(stateCount, 0);
+  std::vector<uint32_t> check, next, rank;
+  std::vector<uint32_t> freeSlots; // Sorted
+  for (uint32_t s = 0; s < stateCount; ++s) {
+    const auto &st = states[order[s]];
+    if (st.edges.empty())
+      continue;
+
+    auto fits = [&](int64_t b) {
+      for (const auto &edge : st.edges) {
+        size_t slot = static_cast<size_t>(b + edge.first);
+        if (slot < check.size() && check[slot] != 0)
+          return false;
+      }
+      return true;
+    };
+    const int first = st.edges.front().first;
+    int64_t b = -1;
+    for (size_t i = 0; i < freeSlots.size() && i < MAX_FREE_PROBES; ++i) {
+      int64_t candidate = static_cast<int64_t>(freeSlots[i]) - first;
+      if (candidate >= 0 && fits(candidate)) {
+        b = candidate;
+        break;
+      }
+    }
+    if (b < 0) {
+      b = std::max<int64_t>(0, static_cast<int64_t>(check.size()) - first);
+      while (!fits(b))
+        b++;
+    }
+
+    base[s] = static_cast<int32_t>(b);
+    size_t top = static_cast<size_t>(b) + st.edges.back().first + 1;
+    for (size_t slot = check.size(); slot < top; ++slot)
+      freeSlots.push_back(static_cast<uint32_t>(slot));
+    if (check.size() < top) {
+      check.resize(top, 0);
+      next.resize(top, 0);
+      rank.resize(top, 0);
+    }
+    uint32_t ranked = st.terminal ? 1 : 0;
+    for (const auto &edge : st.edges) {
+      size_t slot = static_cast<size_t>(b) + edge.first;
+      check[slot] = s + 1;
+      next[slot] = newId[edge.second];
+      rank[slot] = ranked;
+      ranked += below[newId[edge.second]];
+    }
+    freeSlots.erase(std::remove_if(freeSlots.begin(), freeSlots.end(),
+                                   [&check](uint32_t slot) {
+                                     return check[slot] != 0;
+                                   }),
+                    freeSlots.end());
+  }
+  const uint32_t slotCount = static_cast<uint32_t>(check.size());
+  const uint32_t wordCount = static_cast<uint32_t>(words.size());
+
+  // ---- Flatten into the image ----
+  unmap();
+  image_.assign(HEADER_WORDS, 0);
+  image_[H_MAGIC] = MAGIC;
+  image_[H_VERSION] = VERSION;
+  image_[H_STATES] = stateCount;
+  image_[H_SLOTS] = slotCount;
+  image_[H_WORDS] = wordCount;
+  image_.reserve(HEADER_WORDS + 2 * stateCount + 3 * slotCount +
+                 2 * wordCount);
+  for (uint32_t s = 0; s < stateCount; ++s)
+    image_.push_back(static_cast<uint32_t>(base[s]));
+  for (uint32_t s = 0; s < stateCount; ++s)
+    image_.push_back(below[s] | (states[order[s]].terminal ? TERMINAL : 0));
+  image_.insert(image_.end(), check.begin(), check.end());
+  image_.insert(image_.end(), next.begin(), next.end());
+  image_.insert(image_.end(), rank.begin(), rank.end());
+  for (const auto &w : words)
+    image_.push_back(w.frequency);
+  for (const auto &w : words)
+    image_.push_back(static_cast<uint32_t>(w.wordId));
+  attach(image_.data(), image_.size());
+  buildRangeMax();
+}
+
+bool Trie::attach(const uint32_t *image, size_t words) {
+  if (words < HEADER_WORDS || image[H_MAGIC] != MAGIC ||
+      image[H_VERSION] != VERSION)
+    return false;
+  const uint64_t states = image[H_STATES];
+  const uint64_t slots = image[H_SLOTS];
+  const uint64_t count = image[H_WORDS];
+  if (states == 0 ||
+      words != HEADER_WORDS + 2 * states + 3 * slots + 2 * count)
+    return false;
+
+  const uint32_t *p = image + HEADER_WORDS;
+  const int32_t *base = reinterpret_cast<const int32_t *>(p);
+  const uint32_t *below = p + states;
+  const uint32_t *check = below + states;
+  const uint32_t *next = check + slots;
+  const uint32_t *rank = next + slots;
+
+  // Enough checking that a damaged file cannot send a walk out of bounds
+  if ((below[0] & ~TERMINAL) != count)
+    return false;
+  for (uint64_t i = 0; i < slots; ++i) {
+    if (check[i] > states || next[i] >= states)
+      return false;
+    if (check[i] != 0 &&
+        rank[i] + (below[next[i]] & ~TERMINAL) > (below[check[i] - 1] &
+                                                  ~TERMINAL))
+      return false;
+  }
+  for (uint64_t s = 0; s < states; ++s) {
+    if (base[s] < 0)
+      return false;
+  }
+
+  // A state's count must be exactly its own word plus its children's,
+  // and every state but an empty root must lead to a word. Counts then
+  // never grow along an edge, but a chain of single-child states keeps
+  // the same count, so a loop is ruled out by a topological pass: a
+  // cyclic image would send completion and fuzzy walks round forever.
+  std::vector<uint64_t> sum(states, 0);
+  std::vector<uint32_t> indegree(states, 0);
+  for (uint64_t i = 0; i < slots; ++i) {
+    if (check[i] == 0)
+      continue;
+    sum[check[i] - 1] += below[next[i]] & ~TERMINAL;
+    indegree[next[i]]++;
+  }
+  for (uint64_t s = 0; s < states; ++s) {
+    const uint32_t n = below[s] & ~TERMINAL;
+    if (n != sum[s] + ((below[s] & TERMINAL) ? 1 : 0) || (n == 0 && s != 0))
+      return false;
+  }
+  std::vector<uint32_t> ready;
+  for (uint64_t s = 0; s < states; ++s) {
+    if (indegree[s] == 0)
+      ready.push_back(static_cast<uint32_t>(s));
+  }
+  uint64_t sorted = 0;
+  while (!ready.empty()) {
+    const uint32_t s = ready.back();
+    ready.pop_back();
+    sorted++;
+    for (int c = 0; c < 27; ++c) {
+      const uint64_t slot = static_cast<uint64_t>(base[s]) + c;
+      if (slot < slots && check[slot] == s + 1 &&
+          --indegree[next[slot]] == 0)
+        ready.push_back(next[slot]);
+    }
+  }
+  if (sorted != states)
+    return false;
+
+  imageWords_ = words;
+  stateCount_ = static_cast<uint32_t>(states);
+  slotCount_ = static_cast<uint32_t>(slots);
+  wordCount_ = static_cast<uint32_t>(count);
+  stateBase_ = base;
+  stateWords_ = below;
+  slotCheck_ = check;
+  slotNext_ = next;
+  slotRank_ = rank;
+  frequency_ = rank + slots;
+  wordId_ = reinterpret_cast<const int32_t *>(frequency_ + count);
+  return true;
+}
+
+void Trie::unmap() {
+  if (mapping_) {
+    munmap(mapping_, mappingBytes_);
+    mapping_ = nullptr;
+    mappingBytes_ = 0;
+  }
+}
+
+bool Trie::save(const std::string &path, uint64_t stamp) const {
+  const uint32_t *image =
+      mapping_ ? static_cast<const uint32_t *>(mapping_) : image_.data();
+  std::vector<uint32_t> header(image, image + HEADER_WORDS);
+  header[H_STAMP_LO] = static_cast<uint32_t>(stamp);
+  header[H_STAMP_HI] = static_cast<uint32_t>(stamp >> 32);
 
-    if (nodes_[curr].children[idx] == -1) {
-      nodes_[curr].children[idx] = static_cast<int>(nodes_.size());
-      nodes_.emplace_back();
+  // Written aside and renamed over, so a reader never maps a partial file
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    file.write(reinterpret_cast<const char *>(header.data()),
+               HEADER_WORDS * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char *>(image + HEADER_WORDS),
+               (imageWords_ - HEADER_WORDS) * sizeof(uint32_t));
+    if (!file.good()) {
+      std::remove(tmp.c_str());
+      return false;
     }
-    curr = nodes_[curr].children[idx];
   }
-  nodes_[curr].isTerminal = true;
-  nodes_[curr].frequency = freq;
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool Trie::load(const std::string &path, uint64_t stamp) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+      st.st_size % sizeof(uint32_t) != 0) {
+    close(fd);
+    return false;
+  }
+  size_t bytes = static_cast<size_t>(st.st_size);
+  void *map = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const uint32_t *image = static_cast<const uint32_t *>(map);
+  if (bytes < HEADER_WORDS * sizeof(uint32_t) ||
+      (image[H_STAMP_LO] |
+       static_cast<uint64_t>(image[H_STAMP_HI]) << 32) != stamp) {
+    munmap(map, bytes);
+    return false;
+  }
+
+  // Keep the current contents if the file does not check out
+  std::vector<uint32_t> previous;
+  previous.swap(image_);
+  void *oldMapping = mapping_;
+  size_t oldBytes = mappingBytes_;
+  if (!attach(image, bytes / sizeof(uint32_t))) {
+    munmap(map, bytes);
+    image_.swap(previous);
+    return false;
+  }
+  if (oldMapping)
+    munmap(oldMapping, oldBytes);
+  mapping_ = map;
+  mappingBytes_ = bytes;
+  buildRangeMax();
+  return true;
 }
 
 bool Trie::contains(const std::string &word) const {
-  int curr = 0;
+  uint32_t state = 0;
   for (char c : word) {
     int idx = charToIndex(c);
     if (idx == -1)
       return false;
 
-    if (nodes_[curr].children[idx] == -1) {
+    int64_t slot = next(state, idx);
+    if (slot < 0)
       return false;
+    state = slotNext_[slot];
+  }
+  return terminal(state);
+}
+
+void Trie::buildRangeMax() {
+  blockMax_.clear();
+  const uint32_t blocks = (wordCount_ + RANGE_BLOCK - 1) / RANGE_BLOCK;
+  if (blocks == 0)
+    return;
+
+  std::vector<uint32_t> level(blocks);
+  for (uint32_t b = 0; b < blocks; ++b) {
+    uint32_t lo = b * RANGE_BLOCK;
+    uint32_t hi = std::min(wordCount_, lo + RANGE_BLOCK);
+    uint32_t best = lo;
+    for (uint32_t r = lo + 1; r < hi; ++r) {
+      if (higher(r, best))
+        best = r;
+    }
+    level[b] = best;
+  }
+  blockMax_.push_back(std::move(level));
+
+  // Level j: winner of the 2^j blocks starting at each block
+  for (uint32_t span = 2; span <= blocks; span *= 2) {
+    const auto &prev = blockMax_.back();
+    std::vector<uint32_t> level(blocks - span + 1);
+    for (uint32_t b = 0; b < level.size(); ++b) {
+      uint32_t x = prev[b], y = prev[b + span / 2];
+      level[b] = higher(y, x) ? y : x;
+    }
+    blockMax_.push_back(std::move(level));
+  }
+}
+
+uint32_t Trie::rangeMax(uint32_t lo, uint32_t hi) const {
+  auto scan = [this](uint32_t from, uint32_t to, uint32_t best) {
+    for (uint32_t r = from; r < to; ++r) {
+      if (higher(r, best))
+        best = r;
     }
-    curr = nodes_[curr].children[idx];
+    return best;
+  };
+
+  uint32_t firstBlock = lo / RANGE_BLOCK;
+  uint32_t lastBlock = (hi - 1) / RANGE_BLOCK;
+  if (firstBlock == lastBlock)
+    return scan(lo + 1, hi, lo);
+
+  uint32_t best = scan(lo + 1, (firstBlock + 1) * RANGE_BLOCK, lo);
+  best = scan(lastBlock * RANGE_BLOCK, hi, best);
+  if (firstBlock + 1 < lastBlock) {
+    // Two overlapping power-of-two runs cover the whole blocks between
+    uint32_t a = firstBlock + 1, b = lastBlock - 1;
+    uint32_t j = 0;
+    while ((2u << j) <= b - a + 1)
+      j++;
+    for (uint32_t r : {blockMax_[j][a], blockMax_[j][b + 1 - (1u << j)]}) {
+      if (higher(r, best))
+        best = r;
+    }
+  }
+  return best;
+}
+
+std::vector<Completion> Trie::completeTopK(const std::string &prefix,
+                                           size_t k) const {
+  std::vector<Completion> out;
+  uint32_t state = 0, rank = 0;
+  for (char c : prefix) {
+    int idx = charToIndex(c);
+    if (idx == -1)
+      return out;
+    int64_t slot = next(state, idx);
+    if (slot < 0)
+      return out;
+    state = slotNext_[slot];
+    rank += slotRank_[slot];
+  }
+
+  // Ranges of unreported ranks, ordered by the best word each holds
+  struct Range {
+    uint32_t lo, hi, best;
+  };
+  auto worse = [this](const Range &a, const Range &b) {
+    return higher(b.best, a.best);
+  };
+  std::priority_queue<Range, std::vector<Range>, decltype(worse)> heap(
+      worse);
+  uint32_t end = rank + (stateWords_[state] & ~TERMINAL);
+  if (rank < end)
+    heap.push({rank, end, rangeMax(rank, end)});
+
+  while (!heap.empty() && out.size() < k) {
+    Range r = heap.top();
+    heap.pop();
+    out.push_back({wordId_[r.best], frequency_[r.best]});
+    if (r.lo < r.best)
+      heap.push({r.lo, r.best, rangeMax(r.lo, r.best)});
+    if (r.best + 1 < r.hi)
+      heap.push({r.best + 1, r.hi, rangeMax(r.best + 1, r.hi)});
+  }
+  return out;
+}
+
+std::vector<FuzzyMatch> Trie::fuzzySearch(const std::string &query,
+                                          float maxCost,
+                                          const EditCosts &costs) const {
+  std::vector<int> q;
+  q.reserve(query.size());
+  for (char c : query)
+    q.push_back(charToIndex(c)); // -1: never matches, substitutes at 1
+
+  // rows holds one DP row of query.size() + 1 cells per trie depth. Row 0
+  // (the root) is the cost of dropping the first j query chars.
+  const size_t width = q.size() + 1;
+  std::vector<float> rows(width * 16);
+  for (size_t j = 0; j < width; ++j)
+    rows[j] = j * costs.remove;
+
+  std::vector<FuzzyMatch> out;
+  if (rows[width - 1] <= maxCost && terminal(0))
+    out.push_back({wordId_[0], frequency_[0], rows[width - 1]});
+  fuzzyWalk(0, 0, 0, q, maxCost, costs, rows, out);
+
+  std::sort(out.begin(), out.end(),
+            [](const FuzzyMatch &a, const FuzzyMatch &b) {
+              if (a.cost != b.cost)
+                return a.cost < b.cost;
+              return a.frequency > b.frequency;
+            });
+  return out;
+}
+
+void Trie::fuzzyWalk(uint32_t state, uint32_t rank, size_t depth,
+                     const std::vector<int> &query, float maxCost,
+                     const EditCosts &costs, std::vector<float> &rows,
+                     std::vector<FuzzyMatch> &out) const {
+  const size_t width = query.size() + 1;
+  if (rows.size() < (depth + 2) * width)
+    rows.resize(rows.size() * 2);
+
+  for (int c = 0; c < 27; ++c) {
+    int64_t slot = next(state, c);
+    if (slot < 0)
+      continue;
+
+    const float *prev = &rows[depth * width];
+    float *curr = &rows[(depth + 1) * width];
+
+    curr[0] = prev[0] + costs.insert[c];
+    float best = curr[0];
+    for (size_t j = 1; j < width; ++j) {
+      int qc = query[j - 1];
+      float sub = qc < 0 ? 1.0f : costs.substitute[qc][c];
+      curr[j] = std::min({prev[j] + costs.insert[c],
+                          curr[j - 1] + costs.remove, prev[j - 1] + sub});
+      best = std::min(best, curr[j]);
+    }
+
+    // Costs only grow along a branch: nothing below can come back
+    if (best > maxCost)
+      continue;
+
+    uint32_t child = slotNext_[slot];
+    uint32_t childRank = rank + slotRank_[slot];
+    if (terminal(child) && curr[width - 1] <= maxCost)
+      out.push_back(
+          {wordId_[childRank], frequency_[childRank], curr[width - 1]});
+
+    fuzzyWalk(child, childRank, depth + 1, query, maxCost, costs, rows, out);
   }
-  return nodes_[curr].isTerminal;
 }
 
 } // namespace magickeyboard::lexicon
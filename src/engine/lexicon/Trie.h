@@ -7,33 +7,149 @@
 
 namespace magickeyboard::lexicon {
 
-struct TrieNode {
-    // Linked list or fixed array? Fixed array 27 is requested (a-z + ')
-    // Using index into nodes vector
-    int children[27]; 
-    bool isTerminal = false;
-    uint32_t frequency = 0;
-
-    TrieNode();
+// Weighted edit costs for fuzzySearch, indexed by charToIndex()
+struct EditCosts {
+    float substitute[27][27]; // [query char][word char]
+    float insert[27];         // Word has a char the query lacks
+    float remove = 1.0f;      // Query has a char the word lacks
+
+    // Plain Levenshtein: every edit costs 1, matches 0
+    EditCosts();
+};
+
+struct FuzzyMatch {
+    int wordId;
+    uint32_t frequency;
+    float cost;
+};
+
+struct Completion {
+    int wordId;
+    uint32_t frequency;
 };
 
+// Read-only lexicon over a-z and '.
+//
+// Words are built in bulk into a minimal DAWG: shared suffixes ("-ing",
+// "-tion") are stored once. A word's frequency and id cannot live on a
+// shared state, so every state also counts the words below it; walking a
+// word sums those counts into its rank in sorted order, which indexes the
+// side arrays.
+//
+// Transitions are laid out as a double array. The slot for state s and
+// letter c is base[s] + c, owned by s when check[slot] says so. A lookup
+// is one index and one compare per letter, with no child lists.
+//
+// The whole structure is a single flat image of 32-bit words, so it can
+// be saved once and mmap'ed back without parsing or copying.
 class Trie {
 public:
+    struct Entry {
+        std::string word;
+        uint32_t frequency;
+        int wordId; // Caller's id, returned by searches
+    };
+
     Trie();
-    
-    // Insert a word with frequency
-    void insert(const std::string& word, uint32_t freq);
-    
+    ~Trie();
+    Trie(const Trie&) = delete;
+    Trie& operator=(const Trie&) = delete;
+
+    // Replace the contents with these words, in any order. Characters
+    // outside a-z and ' are skipped; for a repeated word the last entry
+    // wins.
+    void build(std::vector<Entry> entries);
+
+    // Write the image to path (atomically, via rename). stamp identifies
+    // the source data and is checked by load().
+    bool save(const std::string& path, uint64_t stamp) const;
+
+    // Map a saved image read-only. Fails, leaving the trie unchanged, if
+    // the file is missing, malformed or was saved with another stamp.
+    bool load(const std::string& path, uint64_t stamp);
+
     // Check if word exists (exact match)
     bool contains(const std::string& word) const;
 
+    // Every word within maxCost weighted edits of query, cheapest first
+    // (ties: higher frequency first). Walks the trie carrying one DP row
+    // per depth, i.e. a Levenshtein automaton run in lockstep with the
+    // trie, and abandons a branch once no extension can get back under
+    // maxCost. Only nodes that can still match are visited.
+    std::vector<FuzzyMatch> fuzzySearch(const std::string& query,
+                                        float maxCost,
+                                        const EditCosts& costs) const;
+
+    // The k most frequent words starting with prefix (the prefix itself
+    // included), most frequent first; ties go to the alphabetically first.
+    //
+    // A prefix's words are one contiguous run of ranks, so this is a walk
+    // down the prefix and then k best-first pops over that run: each pop
+    // takes the range maximum and splits the range around it. Cost is
+    // O(prefix + k log k) range-max queries, whatever the lexicon size.
+    std::vector<Completion> completeTopK(const std::string& prefix,
+                                         size_t k) const;
+
     // Helper to map char to index (0-26)
     static int charToIndex(char c);
 
-    const std::vector<TrieNode>& nodes() const { return nodes_; }
+    size_t wordCount() const { return wordCount_; }
+    size_t stateCount() const { return stateCount_; }
+    size_t memoryBytes() const { return imageWords_ * sizeof(uint32_t); }
+    bool isMapped() const { return mapping_ != nullptr; }
 
 private:
-    std::vector<TrieNode> nodes_;
+    static constexpr uint32_t TERMINAL = 0x80000000u; // In stateWords_
+
+    // Slot for state's transition on c, or -1
+    int64_t next(uint32_t state, int c) const {
+        int64_t slot = static_cast<int64_t>(stateBase_[state]) + c;
+        if (slot >= static_cast<int64_t>(slotCount_) ||
+            slotCheck_[slot] != state + 1)
+            return -1;
+        return slot;
+    }
+    bool terminal(uint32_t state) const {
+        return stateWords_[state] & TERMINAL;
+    }
+
+    // Point the arrays into image (owned or mapped); false if malformed
+    bool attach(const uint32_t* image, size_t words);
+    void unmap();
+
+    // Range-maximum index over frequency_, for completeTopK. A DAWG state
+    // is shared by many prefixes, so it cannot carry a subtree maximum;
+    // the maximum lives with the rank range instead. Blocks of
+    // RANGE_BLOCK ranks are scanned; whole blocks go through a sparse
+    // table of per-block winners.
+    static constexpr uint32_t RANGE_BLOCK = 32;
+    bool higher(uint32_t a, uint32_t b) const {
+        return frequency_[a] != frequency_[b] ? frequency_[a] > frequency_[b]
+                                              : a < b;
+    }
+    void buildRangeMax();
+    uint32_t rangeMax(uint32_t lo, uint32_t hi) const; // Rank in [lo, hi)
+    std::vector<std::vector<uint32_t>> blockMax_; // [level][first block]
+
+    void fuzzyWalk(uint32_t state, uint32_t rank, size_t depth,
+                   const std::vector<int>& query, float maxCost,
+                   const EditCosts& costs, std::vector<float>& rows,
+                   std::vector<FuzzyMatch>& out) const;
+
+    std::vector<uint32_t> image_; // Built in memory; empty when mapped
+    void* mapping_ = nullptr;
+    size_t mappingBytes_ = 0;
+
+    // Views into the image
+    size_t imageWords_ = 0;
+    uint32_t stateCount_ = 0, slotCount_ = 0, wordCount_ = 0;
+    const int32_t* stateBase_ = nullptr;
+    const uint32_t* stateWords_ = nullptr; // Words below | TERMINAL
+    const uint32_t* slotCheck_ = nullptr;  // Owner state + 1; 0 if free
+    const uint32_t* slotNext_ = nullptr;   // Target state
+    const uint32_t* slotRank_ = nullptr;   // Words ranked before the target
+    const uint32_t* frequency_ = nullptr;  // By rank
+    const int32_t* wordId_ = nullptr;      // By rank
 };
 
 } // namespace magickeyboard::lexicon
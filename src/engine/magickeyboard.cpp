@@ -3,7 +3,9 @@
  * v0.1: Focus-driven show/hide + click-to-commit via Unix socket
  */
 #include "magickeyboard.h"
+#include "edit_distance.h"
 #include "protocol.h"
+#include "swipe_engine.h"
 
 #include <fcitx-utils/event.h>
 #include <fcitx-utils/log.h>
@@ -19,9 +21,11 @@
 #include <fcntl.h>
 #include <fstream>
 #include <map>
-#include <set>
 #include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -39,18 +43,15 @@ MagicKeyboardFactory::create(fcitx::AddonManager *manager) {
 
 MagicKeyboardEngine::MagicKeyboardEngine(fcitx::Instance *instance)
     : instance_(instance) {
-  trie_ = std::make_unique<lexicon::Trie>();
   MKLOG(Info) << "Magic Keyboard engine starting";
 
-  // Initialize settings and user learning data
+  // Settings are small and read by the first keystroke. The dictionary,
+  // layout, templates and learning data load on the reload worker
+  // (warmUp()) so fcitx5 startup is not held up by them.
   SettingsManager::instance().load();
-  UserDataManager::instance().load();
-  MKLOG(Info) << "Loaded " << UserDataManager::instance().getUnigramCount()
-              << " unigrams, " << UserDataManager::instance().getBigramCount()
-              << " bigrams";
-
-  loadLayout("qwerty");
-  loadDictionary();
+  updateShadowMode();
+  startSwipeWorker();
+  startReloadWorker();
   startSocketServer();
 
   // Initialize toggle timer to allow immediate first toggle
@@ -87,7 +88,7 @@ MagicKeyboardEngine::MagicKeyboardEngine(fcitx::Instance *instance)
 
   startWatchdog();
 
-  MKLOG(Info) << "Magic Keyboard engine ready";
+  MKLOG(Info) << "Magic Keyboard engine started, loading in background";
 }
 
 MagicKeyboardEngine::~MagicKeyboardEngine() {
@@ -102,6 +103,12 @@ MagicKeyboardEngine::~MagicKeyboardEngine() {
   watchdogTimer_.reset();
 
   stopSocketServer();
+  stopReloadWorker();
+  stopSwipeWorker();
+
+  if (templatesSinceSave_ > 0) {
+    shark2Engine_.saveUserTemplates(userTemplatesPath());
+  }
 
   if (uiPid_ > 0) {
     kill(uiPid_, SIGTERM);
@@ -137,6 +144,7 @@ void MagicKeyboardEngine::deactivate(const fcitx::InputMethodEntry &,
                                      fcitx::InputContextEvent &) {
   MKLOG(Debug) << "deactivate()";
   currentIC_ = nullptr;
+  clearTypedWord();
 }
 
 void MagicKeyboardEngine::keyEvent(const fcitx::InputMethodEntry &,
@@ -146,8 +154,11 @@ void MagicKeyboardEngine::keyEvent(const fcitx::InputMethodEntry &,
 
 void MagicKeyboardEngine::reset(const fcitx::InputMethodEntry &,
                                 fcitx::InputContextEvent &) {
+  cancelPendingSwipe();
   candidateMode_ = false;
   currentCandidates_.clear();
+  typedWord_.clear();
+  completionPrefix_.clear();
   sendToUI("{\"type\":\"swipe_candidates\",\"candidates\":[]}\n");
 }
 
@@ -227,6 +238,10 @@ void MagicKeyboardEngine::handleFocusIn(fcitx::InputContext *ic) {
   std::string reason;
   int show = shouldShowKeyboard(ic, reason);
 
+  // A word half typed in one field must not be finished in another
+  if (ic != typedWordIC_)
+    clearTypedWord();
+
   MKLOG(Info) << "FocusIn: " << program << " show=" << show << " (" << reason
               << ") state=" << static_cast<int>(visibilityState_);
 
@@ -313,6 +328,7 @@ void MagicKeyboardEngine::handleFocusOut(fcitx::InputContext *ic) {
     // preserved IC
     return;
   }
+  clearTypedWord();
 
   switch (visibilityState_) {
   case VisibilityState::Hidden:
@@ -416,21 +432,86 @@ void MagicKeyboardEngine::executeHide() {
   MKLOG(Debug) << "Keyboard HIDDEN";
 }
 
-void MagicKeyboardEngine::sendToUI(const std::string &msg) {
-  if (clients_.empty()) {
-    return;
+namespace {
+
+// Messages that only carry the latest state: a queued one is replaced by
+// the next instead of both being sent
+std::string_view coalesceKey(std::string_view msg) {
+  static constexpr std::string_view latestOnly[] = {
+      "swipe_candidates", "swipe_keys", "caret_position"};
+  constexpr std::string_view prefix = "{\"type\":\"";
+  if (msg.substr(0, prefix.size()) != prefix)
+    return {};
+  std::string_view rest = msg.substr(prefix.size());
+  for (auto type : latestOnly) {
+    if (rest.size() > type.size() && rest.substr(0, type.size()) == type &&
+        rest[type.size()] == '"')
+      return type;
   }
+  return {};
+}
+
+} // namespace
 
+void MagicKeyboardEngine::sendToUI(const std::string &msg) {
+  // Control clients (magickeyboardctl) only get replies to their requests
   for (auto const &[fd, client] : clients_) {
-    ssize_t n = write(fd, msg.c_str(), msg.size());
-    if (n < 0) {
-      if (errno == EPIPE) {
-        // Normal for fire-and-forget control clients
-        MKLOG(Debug) << "Send failed (EPIPE) to fd " << fd;
-      } else {
-        MKLOG(Warn) << "Send failed to fd " << fd << ": " << strerror(errno);
-      }
+    if (client->role != "ctl")
+      queueMessage(fd, *client, msg);
+  }
+}
+
+void MagicKeyboardEngine::sendToClient(int clientFd, const std::string &msg) {
+  auto it = clients_.find(clientFd);
+  if (it != clients_.end())
+    queueMessage(clientFd, *it->second, msg);
+}
+
+void MagicKeyboardEngine::queueMessage(int fd, Client &client,
+                                       const std::string &msg) {
+  if (size_t dropped = client.out.push(msg, coalesceKey(msg))) {
+    MKLOG(Warn) << "fd " << fd << " is not reading; dropped " << dropped
+                << " queued messages";
+  }
+
+  // Everything queued during this dispatch goes out in one flush
+  if (!flushScheduled_) {
+    flushScheduled_ = true;
+    flushEvent_ = instance_->eventLoop().addDeferEvent(
+        [this](fcitx::EventSource *) {
+          flushScheduled_ = false;
+          if (!shuttingDown_) {
+            for (auto const &[fd, client] : clients_)
+              flushClient(fd, *client);
+          }
+          return true;
+        });
+  }
+}
+
+void MagicKeyboardEngine::flushClient(int fd, Client &client) {
+  if (client.out.empty() && !client.waitingWritable)
+    return;
+
+  auto status = client.out.flush(fd);
+  if (status == OutboundQueue::FlushStatus::Error) {
+    if (errno == EPIPE) {
+      // Normal for fire-and-forget control clients
+      MKLOG(Debug) << "Send failed (EPIPE) to fd " << fd;
+    } else {
+      MKLOG(Warn) << "Send failed to fd " << fd << ": " << strerror(errno);
     }
+    client.out.clear(); // The read side sees the hangup and drops it
+  }
+
+  // Watch for writability only while something is waiting for it
+  bool blocked = status == OutboundQueue::FlushStatus::Blocked;
+  if (blocked != client.waitingWritable && client.event) {
+    client.waitingWritable = blocked;
+    client.event->setEvents(
+        blocked ? fcitx::IOEventFlags(fcitx::IOEventFlag::In) |
+                      fcitx::IOEventFlag::Out
+                : fcitx::IOEventFlags(fcitx::IOEventFlag::In));
   }
 }
 
@@ -507,6 +588,7 @@ fcitx::InputContext *MagicKeyboardEngine::pickTargetInputContext() {
 }
 
 void MagicKeyboardEngine::handleShortcutAction(const std::string &action) {
+  clearTypedWord(); // Undo, paste, select-all: the typed word is stale
   fcitx::InputContext *ic = pickTargetInputContext();
 
   if (!ic) {
@@ -579,6 +661,15 @@ void MagicKeyboardEngine::handleShortcutAction(const std::string &action) {
 }
 
 void MagicKeyboardEngine::handleKeyPress(const std::string &key) {
+  // Behind a swipe still decoding: applied once its result is
+  if (holdInput({key}))
+    return;
+  // A swipe waiting for the data to load was typed past
+  cancelPendingSwipe();
+  applyKeyPress(key);
+}
+
+void MagicKeyboardEngine::applyKeyPress(const std::string &key) {
   // Use pickTargetInputContext to resolve focused or cached fallback
   fcitx::InputContext *ic = pickTargetInputContext();
 
@@ -615,6 +706,7 @@ void MagicKeyboardEngine::handleKeyPress(const std::string &key) {
     } else if (key == "backspace") {
       candidateMode_ = false;
       currentCandidates_.clear();
+      lastSwipePath_.clear(); // Rejected swipe: nothing to learn
       sendToUI("{\"type\":\"swipe_candidates\",\"candidates\":[]}\n");
       return;
     } else if (key == "enter") {
@@ -644,6 +736,8 @@ void MagicKeyboardEngine::handleKeyPress(const std::string &key) {
     }
   }
 
+  trackTypedKey(key, ic);
+
   if (key == "backspace") {
     ic->forwardKey(fcitx::Key(FcitxKey_BackSpace), false);
     ic->forwardKey(fcitx::Key(FcitxKey_BackSpace), true);
@@ -704,8 +798,8 @@ void MagicKeyboardEngine::handleKeyPress(const std::string &key) {
   }
 }
 
-void MagicKeyboardEngine::loadLayout(const std::string &layoutName) {
-  keys_.clear();
+bool MagicKeyboardEngine::loadLayout(EngineState &next,
+                                     const std::string &layoutName) const {
   std::string relPath = "magic-keyboard/layouts/" + layoutName + ".json";
   std::string foundPath = findDataFile(relPath);
 
@@ -715,15 +809,16 @@ void MagicKeyboardEngine::loadLayout(const std::string &layoutName) {
       roots += d + (d == dataDirs().back() ? "" : ", ");
     MKLOG(Error) << "Failed to find layout: " << relPath
                  << " (searched in roots: [" << roots << "])";
-    return;
+    return false;
   }
 
   MKLOG(Info) << "Loading layout from: " << foundPath;
 
+  uint64_t stamp = fileStamp(foundPath);
   std::ifstream f(foundPath);
   if (!f.is_open()) {
     MKLOG(Error) << "Failed to open layout file: " << foundPath;
-    return;
+    return false;
   }
   std::string content((std::istreambuf_iterator<char>(f)),
                       std::istreambuf_iterator<char>());
@@ -748,7 +843,7 @@ void MagicKeyboardEngine::loadLayout(const std::string &layoutName) {
 
   size_t rowsStart = content.find("\"rows\"");
   if (rowsStart == std::string::npos)
-    return;
+    return false;
 
   // Base window width for centering (matches KeyboardWindowV2)
   const double windowWidth = 720.0;
@@ -818,7 +913,7 @@ void MagicKeyboardEngine::loadLayout(const std::string &layoutName) {
 
   // Actually, let's just add centering in the original single-pass loop
   // Reset and do it properly
-  keys_.clear();
+  std::vector<Key> keys;
   pos = rowsStart;
   currentRowY = 0;
   currentRowOffset = 0.0;
@@ -876,55 +971,69 @@ void MagicKeyboardEngine::loadLayout(const std::string &layoutName) {
         k.r.h = keyHeight;
         k.center.x = k.r.x + k.r.w / 2.0;
         k.center.y = k.r.y + k.r.h / 2.0;
-        keys_.push_back(k);
+        keys.push_back(k);
       }
     }
     pos = pos + 1;
   }
 
-  MKLOG(Info) << "Layout loaded: " << keys_.size() << " keys";
+  MKLOG(Info) << "Layout loaded: " << keys.size() << " keys";
+  next.layoutPath = foundPath;
+  next.layoutStamp = stamp;
+  next.keys = std::move(keys);
 
-  // Sync letter key positions to SHARK2 engine
-  int syncCount = 0;
-  for (const auto &k : keys_) {
-    if (k.id.length() == 1 && std::isalpha(k.id[0])) {
-      shark2Engine_.setKeyCenter(k.id[0], k.center.x, k.center.y);
-      syncCount++;
+  std::vector<gesture::KeyGrid::Box> boxes;
+  boxes.reserve(next.keys.size());
+  for (const auto &k : next.keys) {
+    boxes.push_back({k.r.x, k.r.y, k.r.w, k.r.h, k.center.x, k.center.y});
+  }
+  next.keyGrid.build(std::move(boxes));
+
+  // Neighbouring letter keys substitute cheaply in fuzzy retrieval
+  std::memset(next.keyAdjacent, 0, sizeof(next.keyAdjacent));
+  next.editCosts = lexicon::EditCosts();
+  const double adjacentDist = keyseq_config::ADJACENT_PITCHES * keyPitch;
+  for (const auto &a : next.keys) {
+    if (a.id.length() != 1 || !std::isalpha(a.id[0]))
+      continue;
+    for (const auto &b : next.keys) {
+      if (b.id.length() != 1 || !std::isalpha(b.id[0]) || a.id == b.id)
+        continue;
+      double dx = a.center.x - b.center.x;
+      double dy = a.center.y - b.center.y;
+      if (std::sqrt(dx * dx + dy * dy) < adjacentDist) {
+        int ai = std::tolower(a.id[0]) - 'a';
+        int bi = std::tolower(b.id[0]) - 'a';
+        next.keyAdjacent[ai][bi] = true;
+        next.editCosts.substitute[ai][bi] = keyseq_config::ADJACENT_SUB_COST;
+      }
     }
   }
-  MKLOG(Info) << "Synced " << syncCount << " letter keys to SHARK2";
+  return true;
 }
 
 std::vector<std::string>
-MagicKeyboardEngine::mapPathToSequence(const std::vector<Point> &path) {
-  if (path.empty() || keys_.empty())
+MagicKeyboardEngine::mapPathToSequence(const EngineState &state,
+                                       const std::vector<Point> &path) const {
+  if (path.empty() || state.keys.empty())
     return {};
 
   std::vector<std::string> rawSequence;
   const Key *currentKey = nullptr;
   int consecutiveSamples = 0;
 
-  for (const auto &pt : path) {
-    const Key *bestKey = nullptr;
-    double bestDistSq = 1e18;
-
-    // Inside-rect priority
-    for (const auto &k : keys_) {
-      if (k.r.contains(pt)) {
-        bestKey = &k;
-        break;
-      }
-      double dx = k.center.x - pt.x;
-      double dy = k.center.y - pt.y;
-      double d2 = dx * dx + dy * dy;
-      if (d2 < bestDistSq) {
-        bestDistSq = d2;
-        bestKey = &k;
-      }
-    }
+  // Pending key that must win 2 samples in a row before it is accepted.
+  // Per call: this runs on decode workers, possibly several at once.
+  const Key *candidateKey = nullptr;
+  int candidateCount = 0;
 
-    if (!bestKey)
+  for (const auto &pt : path) {
+    // Inside-rect priority, else nearest center
+    auto hit = state.keyGrid.find(pt.x, pt.y);
+    if (hit.index < 0)
       continue;
+    const Key *bestKey = &state.keys[hit.index];
+    double bestDistSq = hit.distSq;
 
     // Hysteresis
     if (currentKey == nullptr) {
@@ -956,9 +1065,6 @@ MagicKeyboardEngine::mapPathToSequence(const std::vector<Point> &path) {
 
       // Re-implementing correctly: require 2 samples for candidate if not
       // dominant
-      static const Key *candidateKey = nullptr;
-      static int candidateCount = 0;
-
       if (accept) {
         currentKey = bestKey;
         rawSequence.push_back(currentKey->id);
@@ -1030,404 +1136,820 @@ MagicKeyboardEngine::mapPathToSequence(const std::vector<Point> &path) {
   return result;
 }
 
-void MagicKeyboardEngine::processLine(const std::string &line, int clientFd) {
-  if (line.find("\"type\":\"key\"") != std::string::npos) {
-    auto pos = line.find("\"text\":\"");
-    if (pos != std::string::npos) {
-      pos += 8;
-      auto end = line.find("\"", pos);
-      if (end != std::string::npos) {
-        handleKeyPress(line.substr(pos, end - pos));
-      }
-    }
-  } else if (line.find("\"type\":\"commit_candidate\"") != std::string::npos) {
-    auto pos = line.find("\"text\":\"");
-    if (pos != std::string::npos) {
-      pos += 8;
-      auto end = line.find("\"", pos);
-      if (end != std::string::npos) {
-        std::string text = line.substr(pos, end - pos);
-        // FIXED: Use pickTargetInputContext to support preserved IC
-        auto *ic = pickTargetInputContext();
-        if (ic) {
-          ic->commitString(text);
-          MKLOG(Info) << "CommitCand word=" << text
-                      << " program=" << ic->program();
-          // Record for adaptive learning
-          recordWordCommit(text);
-          candidateMode_ = false;
-          currentCandidates_.clear();
-          sendToUI("{\"type\":\"swipe_candidates\",\"candidates\":[]}\n");
-        } else {
-          MKLOG(Warn) << "CommitCand: no IC found";
-        }
-      }
-    }
-  } else if (line.find("\"type\":\"settings_request\"") != std::string::npos) {
-    handleSettingsRequest(clientFd);
-  } else if (line.find("\"type\":\"setting_update\"") != std::string::npos) {
-    auto keyPos = line.find("\"key\":\"");
-    auto valPos = line.find("\"value\":");
-    if (keyPos != std::string::npos && valPos != std::string::npos) {
-      keyPos += 7;
-      auto keyEnd = line.find("\"", keyPos);
-      std::string key = line.substr(keyPos, keyEnd - keyPos);
-
-      // Parse value (could be string or number)
-      valPos += 8;
-      std::string value;
-      if (line[valPos] == '"') {
-        valPos++;
-        auto valEnd = line.find("\"", valPos);
-        value = line.substr(valPos, valEnd - valPos);
-      } else {
-        // Numeric value
-        auto valEnd = line.find_first_of(",}", valPos);
-        value = line.substr(valPos, valEnd - valPos);
-        // Trim whitespace
-        while (!value.empty() && std::isspace(value.back()))
-          value.pop_back();
-      }
+void MagicKeyboardEngine::processLine(std::string_view line, int clientFd) {
+  using Handler =
+      void (MagicKeyboardEngine::*)(const ipc::MessageReader &, int);
+  static const std::unordered_map<std::string_view, Handler> handlers = {
+      {"key", &MagicKeyboardEngine::handleKeyMessage},
+      {"commit_candidate", &MagicKeyboardEngine::handleCommitCandidate},
+      {"settings_request", &MagicKeyboardEngine::handleSettingsMessage},
+      {"status", &MagicKeyboardEngine::handleStatus},
+      {"reload", &MagicKeyboardEngine::handleReload},
+      {"shadow_summary", &MagicKeyboardEngine::handleShadowSummary},
+      {"setting_update", &MagicKeyboardEngine::handleSettingUpdateMessage},
+      {"action", &MagicKeyboardEngine::handleActionMessage},
+      {"ui_intent", &MagicKeyboardEngine::handleUiIntent},
+      {"ui_show", &MagicKeyboardEngine::handleUiVisibility},
+      {"ui_hide", &MagicKeyboardEngine::handleUiVisibility},
+      {"ui_toggle", &MagicKeyboardEngine::handleUiVisibility},
+      {"swipe_path", &MagicKeyboardEngine::handleSwipePath},
+      {"hello", &MagicKeyboardEngine::handleHello},
+      {"commit_text", &MagicKeyboardEngine::handleCommitText},
+      {"swipe_ring", &MagicKeyboardEngine::handleSwipeRing},
+      {"forget_word", &MagicKeyboardEngine::handleForgetWord},
+  };
 
-      handleSettingUpdate(key, value);
-    }
-  } else if (line.find("\"type\":\"action\"") != std::string::npos) {
-    auto pos = line.find("\"action\":\"");
-    if (pos != std::string::npos) {
-      pos += 10;
-      auto end = line.find("\"", pos);
-      if (end != std::string::npos) {
-        std::string a = line.substr(pos, end - pos);
-        // Route typing-related actions to key handler for correct state logic
-        if (a == "backspace" || a == "enter" || a == "space" || a == "tab" ||
-            a == "left" || a == "right") {
-          handleKeyPress(a);
-        } else {
-          handleShortcutAction(a);
-        }
-      }
-    }
-  } else if (line.find("\"type\":\"ui_intent\"") != std::string::npos) {
-    // Parse intent (accept "kind" or "intent" for compatibility)
-    auto getVal = [&](const std::string &field) -> std::string {
-      std::string patt = "\"" + field + "\":\"";
-      auto pos = line.find(patt);
-      if (pos == std::string::npos)
-        return "";
-      pos += patt.length();
-      auto end = line.find("\"", pos);
-      return (end != std::string::npos) ? line.substr(pos, end - pos) : "";
-    };
+  // One pass over the line; handlers read fields as views into it
+  if (!message_.parse(line)) {
+    MKLOG(Warn) << "Dropped malformed message (" << line.size()
+                << " bytes): " << line.substr(0, 80);
+    return;
+  }
+  auto it = handlers.find(message_.type());
+  if (it != handlers.end())
+    (this->*it->second)(message_, clientFd);
+}
 
-    std::string kind = getVal("kind");
-    if (kind.empty())
-      kind = getVal("intent");
+void MagicKeyboardEngine::handleKeyMessage(const ipc::MessageReader &msg,
+                                           int) {
+  std::string text;
+  if (msg.string("text", text))
+    handleKeyPress(text);
+}
 
-    bool handled = false;
-    if (kind == "key") {
-      std::string k = getVal("key");
-      if (k.empty())
-        k = getVal("value");
-      if (!k.empty()) {
+void MagicKeyboardEngine::handleCommitCandidate(const ipc::MessageReader &msg,
+                                                int) {
+  std::string text;
+  if (!msg.string("text", text))
+    return;
+  cancelPendingSwipe();
+  // FIXED: Use pickTargetInputContext to support preserved IC
+  auto *ic = pickTargetInputContext();
+  if (ic) {
+    // A picked completion only needs the letters not yet typed
+    bool completion =
+        !candidateMode_ && !completionPrefix_.empty() &&
+        text.compare(0, completionPrefix_.size(), completionPrefix_) == 0;
+    ic->commitString(completion ? text.substr(completionPrefix_.size())
+                                : text);
+    MKLOG(Info) << "CommitCand word=" << text << " program=" << ic->program()
+                << (completion ? " completion=1" : "");
+    // Record for adaptive learning
+    recordWordCommit(text);
+    typedWord_.clear();
+    completionPrefix_.clear();
+    candidateMode_ = false;
+    currentCandidates_.clear();
+    sendToUI("{\"type\":\"swipe_candidates\",\"candidates\":[]}\n");
+  } else {
+    MKLOG(Warn) << "CommitCand: no IC found";
+  }
+}
+
+void MagicKeyboardEngine::handleSettingsMessage(const ipc::MessageReader &,
+                                                int clientFd) {
+  handleSettingsRequest(clientFd);
+}
+
+void MagicKeyboardEngine::handleStatus(const ipc::MessageReader &,
+                                       int clientFd) {
+  // Diagnostics for magickeyboardctl status
+  if (clientFd >= 0) {
+    auto current = state();
+    writer_.begin("status");
+    calibrator_.writeStatus(writer_);
+    writer_.raw("keyseq_cache", keySeqCache_.statsJson())
+        .raw("gesture_cache", gestureCache_.statsJson())
+        .beginObject("swipe_worker")
+        .num("decoded", swipeDecoded_)
+        .num("dropped", swipeDropped_.load())
+        .num("held_keys", inputHold_.held())
+        .endObject()
+        .beginObject("priority_lane")
+        .num("clients", priorityClients_.size())
+        .num("messages", priorityMessages_)
+        .endObject()
+        .beginObject("state")
+        .boolean("ready", ready())
+        .num("version", current ? current->version : 0)
+        .num("reloads", reloads_.load())
+        .num("keys", current ? current->keys.size() : 0)
+        .num("words", current && current->lexicon ? current->lexicon->size()
+                                                  : 0)
+        .endObject();
+    sendToClient(clientFd, writer_.finish());
+  }
+}
+
+void MagicKeyboardEngine::handleShadowSummary(const ipc::MessageReader &,
+                                              int clientFd) {
+  // Diagnostics for magickeyboardctl shadow-summary
+  if (clientFd >= 0) {
+    sendToClient(clientFd, shadow_.summaryJson());
+  }
+}
+
+void MagicKeyboardEngine::handleSettingUpdateMessage(
+    const ipc::MessageReader &msg, int) {
+  std::string key;
+  const auto *value = msg.find("value");
+  if (!msg.string("key", key) || !value)
+    return;
+
+  // Value could be string or number
+  std::string v;
+  if (!msg.string("value", v))
+    v.assign(value->value);
+  handleSettingUpdate(key, v);
+}
+
+void MagicKeyboardEngine::handleActionMessage(const ipc::MessageReader &msg,
+                                              int) {
+  std::string a;
+  if (!msg.string("action", a))
+    return;
+  // Route typing-related actions to key handler for correct state logic
+  if (a == "backspace" || a == "enter" || a == "space" || a == "tab" ||
+      a == "left" || a == "right") {
+    handleKeyPress(a);
+  } else if (!holdInput({a, true})) {
+    handleShortcutAction(a);
+  }
+}
+
+void MagicKeyboardEngine::handleUiIntent(const ipc::MessageReader &msg,
+                                         int clientFd) {
+  // Parse intent (accept "kind" or "intent" for compatibility)
+  auto getVal = [&msg](std::string_view field) -> std::string {
+    std::string v;
+    msg.string(field, v);
+    return v;
+  };
+
+  std::string kind = getVal("kind");
+  if (kind.empty())
+    kind = getVal("intent");
+
+  bool handled = false;
+  if (kind == "key") {
+    std::string k = getVal("key");
+    if (k.empty())
+      k = getVal("value");
+    if (!k.empty()) {
+      auto *lf =
+          instance_ ? instance_->inputContextManager().lastFocusedInputContext()
+                    : nullptr;
+      MKLOG(Info) << "ui_intent key='" << k
+                  << "' currentIC=" << (currentIC_ ? "yes" : "no")
+                  << " lastFocusedIc=" << (lastFocusedIc_ ? "yes" : "no")
+                  << " fcitxLF=" << (lf ? "yes" : "no");
+      handleKeyPress(k);
+      handled = true;
+    }
+  } else if (kind == "action") {
+    std::string a = getVal("action");
+    if (a.empty())
+      a = getVal("value");
+    if (!a.empty()) {
+      // Route typing-related actions to key handler for correct state logic
+      if (a == "backspace" || a == "enter" || a == "space" || a == "tab" ||
+          a == "left" || a == "right") {
         auto *lf =
             instance_
                 ? instance_->inputContextManager().lastFocusedInputContext()
                 : nullptr;
-        MKLOG(Info) << "ui_intent key='" << k
+        MKLOG(Info) << "ui_intent action->key='" << a
                     << "' currentIC=" << (currentIC_ ? "yes" : "no")
                     << " lastFocusedIc=" << (lastFocusedIc_ ? "yes" : "no")
                     << " fcitxLF=" << (lf ? "yes" : "no");
-        handleKeyPress(k);
-        handled = true;
-      }
-    } else if (kind == "action") {
-      std::string a = getVal("action");
-      if (a.empty())
-        a = getVal("value");
-      if (!a.empty()) {
-        // Route typing-related actions to key handler for correct state logic
-        if (a == "backspace" || a == "enter" || a == "space" || a == "tab" ||
-            a == "left" || a == "right") {
-          auto *lf =
-              instance_
-                  ? instance_->inputContextManager().lastFocusedInputContext()
-                  : nullptr;
-          MKLOG(Info) << "ui_intent action->key='" << a
-                      << "' currentIC=" << (currentIC_ ? "yes" : "no")
-                      << " lastFocusedIc=" << (lastFocusedIc_ ? "yes" : "no")
-                      << " fcitxLF=" << (lf ? "yes" : "no");
-          handleKeyPress(a);
-        } else {
-          handleShortcutAction(a);
-        }
-        handled = true;
+        handleKeyPress(a);
+      } else if (!holdInput({a, true})) {
+        handleShortcutAction(a);
       }
+      handled = true;
     }
+  }
 
-    // Relay unhandled intents (e.g. swipe) to UI; suppress handled ones
-    if (!handled) {
-      sendToUI(line + "\n");
-    }
+  // Relay unhandled intents (e.g. swipe) to UI; suppress handled ones
+  if (!handled) {
+    sendToUI(std::string(msg.line()) + "\n");
+  }
 
-    if (clientFd >= 0) {
-      write(clientFd, "{\"ok\":true}\n", 11);
-    }
-  } else if (line.find("\"type\":\"ui_show\"") != std::string::npos ||
-             line.find("\"type\":\"ui_hide\"") != std::string::npos ||
-             line.find("\"type\":\"ui_toggle\"") != std::string::npos) {
-    // Sender-side throttling for toggle (100ms)
-    bool isToggle = line.find("\"type\":\"ui_toggle\"") != std::string::npos;
-    bool shouldSend = true;
+  if (clientFd >= 0) {
+    sendToClient(clientFd, "{\"ok\":true}\n");
+  }
+}
 
-    auto now = std::chrono::steady_clock::now();
-    if (isToggle) {
-      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now - lastToggleTime_)
-                    .count();
-      if (ms < 100) {
-        MKLOG(Debug) << "Ignored rapid toggle (engine side)";
-        shouldSend = false;
-      } else {
-        lastToggleTime_ = now;
-      }
+void MagicKeyboardEngine::handleUiVisibility(const ipc::MessageReader &msg,
+                                             int clientFd) {
+  // Sender-side throttling for toggle (100ms)
+  bool isToggle = msg.type() == "ui_toggle";
+  bool shouldSend = true;
+
+  auto now = std::chrono::steady_clock::now();
+  if (isToggle) {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  now - lastToggleTime_)
+                  .count();
+    if (ms < 100) {
+      MKLOG(Debug) << "Ignored rapid toggle (engine side)";
+      shouldSend = false;
+    } else {
+      lastToggleTime_ = now;
     }
+  }
+
+  // Relay control messages to all clients (UI will handle)
+  if (shouldSend) {
+    sendToUI(std::string(msg.line()) + "\n");
+  }
 
-    // Relay control messages to all clients (UI will handle)
-    if (shouldSend) {
-      sendToUI(line + "\n");
+  // ACcknowledge to the control client (Agent #4 fix)
+  if (clientFd >= 0) {
+    sendToClient(clientFd, "{\"ok\":true}\n");
+  }
+}
+
+void MagicKeyboardEngine::handleSwipePath(const ipc::MessageReader &msg,
+                                          int) {
+  // seq is echoed in the swipe_keys/candidates responses
+  long long seq = 0;
+  msg.number("seq", seq);
+
+  // Points (optional "t" = ms since stroke start, used for pauses), parsed
+  // in one pass into the reused sample buffer
+  pathSamples_.clear();
+  if (const auto *points = msg.find("points")) {
+    if (!ipc::parsePoints(points->value, pathSamples_)) {
+      MKLOG(Warn) << "swipe_path: malformed points, kept "
+                  << pathSamples_.size();
     }
+  }
 
-    // ACcknowledge to the control client (Agent #4 fix)
-    if (clientFd >= 0) {
-      std::string ack = "{\"ok\":true}\n";
-      write(clientFd, ack.c_str(), ack.size());
+  // Check for UI-provided keys first
+  std::string keysString;
+  if (const auto *uiKeys = msg.find("ui_keys")) {
+    std::vector<std::string_view> keys;
+    ipc::parseStrings(uiKeys->value, keys);
+    for (auto key : keys) {
+      if (key.length() == 1 &&
+          std::isalpha(static_cast<unsigned char>(key[0])))
+        keysString += std::tolower(static_cast<unsigned char>(key[0]));
     }
-  } else if (line.find("\"type\":\"swipe_path\"") != std::string::npos) {
-    // Extract sequence number if present using a more robust search
-    long long seq_num = 0;
-    size_t seq_key_pos = line.find("\"seq\":");
-    if (seq_key_pos != std::string::npos) {
-      size_t val_start = seq_key_pos + 6;
-      while (val_start < line.size() &&
-             (std::isspace(line[val_start]) || line[val_start] == ':'))
-        val_start++;
+    MKLOG(Info) << "Swipe keys from UI: " << keysString;
+  }
 
-      size_t val_end = val_start;
-      while (val_end < line.size() && std::isdigit(line[val_end]))
-        val_end++;
+  recognizeSwipe(seq, std::move(keysString));
+}
 
-      if (val_end > val_start) {
-        try {
-          seq_num = std::stoll(line.substr(val_start, val_end - val_start));
-        } catch (...) {
-          MKLOG(Error) << "Failed to parse seq value";
-        }
-      }
+void MagicKeyboardEngine::handleFrame(std::string_view frame, int) {
+  switch (static_cast<ipc::frame::Type>(frame[1])) {
+  case ipc::frame::Type::Key: {
+    std::string_view key = ipc::frame::decodeKey(frame);
+    if (key.empty()) {
+      MKLOG(Warn) << "Key frame with unknown code "
+                  << static_cast<int>(static_cast<uint8_t>(frame[2]));
+      return;
     }
-    // seq_num echoed in swipe_keys/candidates responses below
-
-    // Parse points
-    std::vector<Point> path;
-    size_t pts_pos = line.find("\"points\":[");
-    if (pts_pos != std::string::npos) {
-      size_t search = pts_pos + 10;
-      while (true) {
-        size_t objStart = line.find('{', search);
-        if (objStart == std::string::npos)
-          break;
-        size_t xPos = line.find("\"x\":", objStart);
-        size_t yPos = line.find("\"y\":", objStart);
-        if (xPos == std::string::npos || yPos == std::string::npos)
-          break;
-        double x = std::stod(line.substr(xPos + 4));
-        double y = std::stod(line.substr(yPos + 4));
-        path.push_back({x, y});
-        search = line.find('}', yPos);
-        if (search == std::string::npos)
-          break;
-      }
+    handleKeyPress(std::string(key));
+    return;
+  }
+  case ipc::frame::Type::SwipeF32:
+  case ipc::frame::Type::SwipeI16: {
+    if (!ipc::frame::decodeSwipe(frame, swipeFrame_)) {
+      MKLOG(Warn) << "Dropped malformed swipe frame (" << frame.size()
+                  << " bytes)";
+      return;
     }
-
-    // Check for UI-provided keys first
+    // Swap rather than copy: both buffers keep their capacity
+    pathSamples_.swap(swipeFrame_.points);
     std::string keysString;
-    size_t ui_keys_pos = line.find("\"ui_keys\":[");
-    if (ui_keys_pos != std::string::npos) {
-      // Parse UI-provided keys array
-      size_t arr_start = ui_keys_pos + 11;
-      size_t arr_end = line.find("]", arr_start);
-      if (arr_end != std::string::npos) {
-        std::string arr_content = line.substr(arr_start, arr_end - arr_start);
-        // Parse ["a","b","c"] format
-        size_t pos = 0;
-        while ((pos = arr_content.find("\"", pos)) != std::string::npos) {
-          size_t end = arr_content.find("\"", pos + 1);
-          if (end != std::string::npos && end > pos + 1) {
-            std::string key = arr_content.substr(pos + 1, end - pos - 1);
-            if (key.length() == 1 && std::isalpha(key[0])) {
-              keysString += std::tolower(key[0]);
-            }
-            pos = end + 1;
-          } else {
-            break;
-          }
-        }
-      }
+    for (char c : swipeFrame_.keys) {
+      if (std::isalpha(static_cast<unsigned char>(c)))
+        keysString += std::tolower(static_cast<unsigned char>(c));
+    }
+    if (!keysString.empty())
       MKLOG(Info) << "Swipe keys from UI: " << keysString;
-    } else if (!path.empty()) {
-      // Fallback to coordinate-based mapping
-      auto seq = mapPathToSequence(path);
-      for (const auto &s : seq) {
-        if (s.length() == 1 && std::isalpha(s[0])) {
-          keysString += std::tolower(s[0]);
+    recognizeSwipe(swipeFrame_.seq, std::move(keysString));
+    return;
+  }
+  }
+}
+
+void MagicKeyboardEngine::recognizeSwipe(long long seq_num,
+                                         std::string keysString) {
+  // Everything slow happens on the swipe worker; this only queues the
+  // request, so the IPC callback (which also carries every other
+  // application's keystrokes) returns in microseconds
+
+  // Keys held behind the previous swipe were meant for it; apply them
+  // (dropping that swipe, as if it had been typed past) before this one
+  if (!inputHold_.empty())
+    cancelPendingSwipe();
+
+  auto request = std::make_unique<SwipeRequest>();
+  request->seq = seq_num;
+  request->generation =
+      swipeGeneration_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  request->samples.swap(pathSamples_);
+  request->keys = std::move(keysString);
+  request->context = lastCommittedWord_;
+  request->useShark2 = useShark2_;
+
+  lastSwipePath_.clear();
+  typedWord_.clear();
+  completionPrefix_.clear(); // Swipe candidates replace the completions
+
+  if (auto stale = swipeRequests_.put(std::move(request))) {
+    swipeDropped_++;
+    MKLOG(Debug) << "Swipe seq=" << stale->seq << " superseded by seq="
+                 << seq_num << " before decoding";
+  }
+
+  // Until its result is applied, keys queue up behind it. Not while
+  // warming up: the wait could be seconds, so taps cancel it instead.
+  if (ready() && swipeEventFd_ >= 0)
+    inputHold_.swipeStarted();
+
+  if (!ready()) {
+    // Decoded once loading finishes. The real candidates replace this in
+    // the outbound queue if the UI has not read it yet.
+    writer_.begin("swipe_candidates")
+        .num("seq", seq_num)
+        .str("status", "warming")
+        .beginArray("candidates");
+    sendToUI(writer_.endArray().finish());
+  }
+}
+
+void MagicKeyboardEngine::cancelPendingSwipe() {
+  swipeGeneration_.fetch_add(1, std::memory_order_acq_rel);
+  // Input held for it goes through now, ahead of whatever cancelled it
+  inputHold_.swipeFinished();
+  releaseHeldInput();
+}
+
+bool MagicKeyboardEngine::holdInput(InputHold::Input input) {
+  bool first = inputHold_.empty();
+  input.lane = laneInput_;
+  bool backlog = input.lane && streamBacklog();
+  if (!inputHold_.hold(std::move(input), backlog))
+    return false;
+  if (first && holdTimer_) {
+    holdTimer_->setTime(fcitx::now(CLOCK_MONOTONIC) +
+                        hold_config::MAX_MS * 1000);
+    holdTimer_->setOneShot();
+  }
+  return true;
+}
+
+void MagicKeyboardEngine::releaseHeldInput() {
+  if (shuttingDown_) {
+    inputHold_.clear();
+  } else if (!inputHold_.empty()) {
+    inputHold_.release(
+        [this](const InputHold::Input &input) { applyHeldInput(input); },
+        streamBacklog());
+  }
+  if (inputHold_.empty() && holdTimer_)
+    holdTimer_->setEnabled(false);
+}
+
+void MagicKeyboardEngine::applyHeldInput(const InputHold::Input &input) {
+  if (input.action)
+    handleShortcutAction(input.name);
+  else
+    applyKeyPress(input.name);
+}
+
+bool MagicKeyboardEngine::streamBacklog() const {
+  for (const auto &[fd, client] : clients_) {
+    if (client->role == "ctl")
+      continue;
+    int unread = 0;
+    if (!client->input.empty() ||
+        (ioctl(fd, FIONREAD, &unread) == 0 && unread > 0))
+      return true;
+  }
+  return false;
+}
+
+void MagicKeyboardEngine::startSwipeWorker() {
+  eventLoopThread_ = std::this_thread::get_id();
+  swipeEventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (swipeEventFd_ < 0) {
+    MKLOG(Error) << "eventfd failed: " << strerror(errno)
+                 << "; swipes will not be decoded";
+    return;
+  }
+  swipeResultEvent_ = instance_->eventLoop().addIOEvent(
+      swipeEventFd_, fcitx::IOEventFlag::In,
+      [this](fcitx::EventSource *, int fd, fcitx::IOEventFlags) {
+        uint64_t count;
+        while (read(fd, &count, sizeof(count)) > 0) {
         }
-      }
-      MKLOG(Info) << "Swipe keys from path: " << keysString << " (from "
-                  << seq.size() << " raw keys)";
+        if (!shuttingDown_)
+          applySwipeResult();
+        return true;
+      });
+  swipeWorker_ = std::thread([this]() { swipeWorkerLoop(); });
+
+  // Armed by holdInput(): keys never wait on a swipe for longer
+  holdTimer_ = instance_->eventLoop().addTimeEvent(
+      CLOCK_MONOTONIC, fcitx::now(CLOCK_MONOTONIC), 0,
+      [this](fcitx::EventSourceTime *timer, uint64_t) {
+        if (shuttingDown_ || inputHold_.empty())
+          return true;
+        auto now = InputHold::Clock::now();
+        if (!inputHold_.overdue(now)) {
+          // Early by a clock tick; wait out the rest
+          auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+              inputHold_.deadline() - now);
+          timer->setTime(fcitx::now(CLOCK_MONOTONIC) + left.count() + 1);
+          timer->setOneShot();
+          return true;
+        }
+        MKLOG(Warn) << "Keys held for " << hold_config::MAX_MS
+                    << " ms behind a swipe or stream input; applying "
+                    << inputHold_.size();
+        // The swipe they waited on is dropped, as if typed past
+        swipeGeneration_.fetch_add(1, std::memory_order_acq_rel);
+        inputHold_.expire(
+            [this](const InputHold::Input &input) { applyHeldInput(input); },
+            now);
+        if (inputHold_.empty())
+          timer->setEnabled(false);
+        return true;
+      });
+  holdTimer_->setEnabled(false);
+}
+
+void MagicKeyboardEngine::stopSwipeWorker() {
+  // The worker finishes (or abandons) its current swipe first
+  cancelPendingSwipe();
+  holdTimer_.reset();
+  swipeRequests_.close();
+  if (swipeWorker_.joinable())
+    swipeWorker_.join();
+  swipeResultEvent_.reset();
+  if (swipeEventFd_ >= 0) {
+    close(swipeEventFd_);
+    swipeEventFd_ = -1;
+  }
+}
+
+void MagicKeyboardEngine::swipeWorkerLoop() {
+  while (swipeRequests_.wait()) {
+    auto request = swipeRequests_.take();
+    if (!request)
+      continue;
+    // Swipes made while warming up wait here for the data; only the
+    // latest is kept, the mailbox replaces older ones
+    ready_.wait(false, std::memory_order_acquire);
+    auto result = decodeSwipe(*request);
+    if (!result) {
+      swipeDropped_++;
+      MKLOG(Debug) << "Swipe seq=" << request->seq << " cancelled";
+      continue;
     }
+    if (auto stale = swipeResults_.put(std::move(result)))
+      swipeDropped_++;
+    uint64_t one = 1;
+    if (write(swipeEventFd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      MKLOG(Warn) << "Swipe result wakeup failed: " << strerror(errno);
+  }
+}
 
-    // Try SHARK2 recognition first if we have path points
-    std::vector<Candidate> candidates;
-    bool usedShark2 = false;
+bool MagicKeyboardEngine::swipeSuperseded(const SwipeRequest &request) const {
+  return swipeGeneration_.load(std::memory_order_acquire) !=
+         request.generation;
+}
+
+std::unique_ptr<MagicKeyboardEngine::SwipeResult>
+MagicKeyboardEngine::decodeSwipe(const SwipeRequest &request) {
+  if (swipeSuperseded(request))
+    return nullptr;
+  // The ensemble wait below would stall every application's keystrokes
+  if (std::this_thread::get_id() == eventLoopThread_) {
+    MKLOG(Error) << "decodeSwipe called on the event loop; dropping seq="
+                 << request.seq;
+    return nullptr;
+  }
+
+  std::vector<Point> path;
+  std::vector<double> times;
+  path.reserve(request.samples.size());
+  times.reserve(request.samples.size());
+  for (const auto &p : request.samples) {
+    path.push_back({p.x, p.y});
+    times.push_back(p.t);
+  }
+  // Without ui_keys the path is mapped to keys on the decode worker below
+  std::string keysString = request.keys;
+
+  auto result = std::make_unique<SwipeResult>();
+  result->seq = request.seq;
+  result->generation = request.generation;
+  std::vector<Candidate> candidates;
+
+  // The whole decode uses one snapshot, even if a reload publishes a new
+  // state meanwhile
+  std::shared_ptr<const EngineState> state = this->state();
+
+  // Phrase swipe: the stroke crossed the space bar between letter runs
+  if (request.useShark2 && path.size() >= 3) {
+    std::vector<PhraseDecoder::Sample> samples;
+    samples.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i)
+      samples.push_back({path[i].x, path[i].y, times[i]});
+
+    if (phraseDecoder_.isPhrase(samples)) {
+      auto start = std::chrono::steady_clock::now();
+      auto phrases = phraseDecoder_.decode(
+          samples, request.context, 8, {&swipeGeneration_, request.generation});
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+      for (const auto &p : phrases)
+        candidates.push_back({p.text, p.score});
+      MKLOG(Info) << "Phrase swipe: " << phrases.size() << " phrases top="
+                  << (phrases.empty() ? "?" : phrases[0].text)
+                  << " decode=" << us << "us";
+    }
+  }
 
-    MKLOG(Info) << "SHARK2 check: useShark2=" << useShark2_
-                << " path.size=" << path.size()
-                << " templates=" << shark2Engine_.getTemplateCount();
+  // Single word: SHARK2 and the key-sequence matcher run concurrently on
+  // the decode pool. Whatever has finished by the budget is merged; a
+  // late decoder is left out so a reply is never held back by it.
+  if (candidates.empty() && !swipeSuperseded(request) &&
+      (path.size() >= 3 || !keysString.empty())) {
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    auto deadline =
+        start + std::chrono::milliseconds(ensemble_config::BUDGET_MS);
+
+    // Shared with the workers so a decoder finishing after the deadline
+    // writes into memory that is still alive
+    struct Batch {
+      std::vector<Candidate> shark2;
+      std::vector<Candidate> keySeq;
+      std::string keys;
+      long long shark2Us = 0;
+      long long keySeqUs = 0;
+      bool shark2Complete = true;
+      double shark2Coverage = 1.0;
+      std::atomic<bool> shark2Ready{false};
+      std::atomic<bool> keySeqReady{false};
+      TaskGroup group;
+    };
+    auto batch = std::make_shared<Batch>();
 
-    if (useShark2_ && !path.empty() && path.size() >= 3) {
-      // Convert to SHARK2 point format
-      std::vector<shark2::Point> shark2Path;
+    std::vector<shark2::Point> shark2Path;
+    if (request.useShark2 && path.size() >= 3) {
       shark2Path.reserve(path.size());
       for (const auto &pt : path) {
         shark2Path.emplace_back(pt.x, pt.y);
       }
 
-      MKLOG(Info) << "SHARK2 input: " << shark2Path.size() << " points, first=("
-                  << shark2Path[0].x << "," << shark2Path[0].y << ") last=("
-                  << shark2Path.back().x << "," << shark2Path.back().y << ")";
-
-      auto shark2Results = shark2Engine_.recognize(shark2Path, 8);
-      MKLOG(Info) << "SHARK2 results: " << shark2Results.size()
-                  << " candidates";
-
-      if (!shark2Results.empty()) {
-        usedShark2 = true;
-        for (const auto &r : shark2Results) {
-          candidates.push_back({r.word, r.score});
+      batch->group.add();
+      decodePool_.submit([this, batch, start, state, pts = shark2Path]() {
+        // Anytime decode: best-so-far if the per-swipe budget runs out
+        auto budget =
+            std::chrono::milliseconds(shark2::config::DECODE_BUDGET_MS);
+        auto decodeStart = Clock::now();
+        std::string cacheKey = std::to_string(state->version) + "/" +
+                               std::to_string(shark2Engine_.generation()) +
+                               "|" + gestureFingerprint(pts);
+        if (!gestureCache_.get(cacheKey, batch->shark2)) {
+          auto result =
+              shark2Engine_.recognizeWithDeadline(pts, start + budget, 8);
+          for (const auto &r : result.candidates) {
+            batch->shark2.push_back({r.word, r.score});
+          }
+          batch->shark2Complete = result.complete;
+          batch->shark2Coverage = result.coverage();
+          // A deadline-cut result is only a best guess; don't keep it
+          if (result.complete) {
+            gestureCache_.put(
+                cacheKey, batch->shark2,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - decodeStart)
+                    .count());
+          }
         }
-        MKLOG(Info) << "SHARK2 recognized: top=" << candidates[0].word
-                    << " score=" << candidates[0].score
-                    << " candidates=" << candidates.size();
-      }
+        batch->shark2Us =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - start)
+                .count();
+        batch->shark2Ready.store(true, std::memory_order_release);
+        batch->group.done();
+      });
     }
 
-    // Fall back to key-sequence based matching if SHARK2 didn't work
-    if (candidates.empty() && !keysString.empty()) {
-      candidates = generateCandidates(
-          keysString, path.size() > 0 ? path.size() : keysString.size());
-      MKLOG(Info) << "Fallback to key-sequence matching: " << keysString;
-    }
-
-    if (!candidates.empty()) {
-      // Send keys for debug highlight with sequence echo
-      std::string msgKeys =
-          "{\"type\":\"swipe_keys\",\"seq\":" + std::to_string(seq_num) +
-          ",\"keys\":[";
-      for (size_t i = 0; i < keysString.size(); ++i) {
-        msgKeys += "\"";
-        msgKeys += keysString[i];
-        msgKeys += "\"";
-        if (i < keysString.size() - 1)
-          msgKeys += ",";
-      }
-      msgKeys += "]}\n";
-      sendToUI(msgKeys);
-
-      // Send actual candidates to UI (include sequence)
-      std::string msgCand =
-          "{\"type\":\"swipe_candidates\",\"seq\":" + std::to_string(seq_num) +
-          ",\"candidates\":[";
-      for (size_t i = 0; i < candidates.size(); ++i) {
-        msgCand += "{\"word\":\"" + candidates[i].word +
-                   "\",\"score\":" + std::to_string(candidates[i].score) + "}";
-        if (i < candidates.size() - 1)
-          msgCand += ",";
-      }
-      msgCand += "]}\n";
-      sendToUI(msgCand);
-
-      // Store candidates in engine for selection
-      currentCandidates_ = candidates;
-      candidateMode_ = true;
-    }
-  } else if (line.find("\"type\":\"hello\"") != std::string::npos) {
-    auto pos = line.find("\"role\":\"");
-    if (pos != std::string::npos) {
-      pos += 8;
-      auto end = line.find("\"", pos);
-      if (end != std::string::npos) {
-        std::string role = line.substr(pos, end - pos);
-        auto it = clients_.find(clientFd);
-        if (it != clients_.end()) {
-          it->second->role = role;
-          MKLOG(Info) << "Client " << clientFd
-                      << " identified as role: " << role;
-
-          // Send current settings to UI on connect
-          if (role == "ui") {
-            sendSettingsToUI();
+    batch->group.add();
+    decodePool_.submit([this, batch, start, state, path, keys = keysString,
+                        context = request.context]() {
+      std::string k = keys;
+      if (k.empty()) {
+        for (const auto &s : mapPathToSequence(*state, path)) {
+          if (s.length() == 1 && std::isalpha(s[0])) {
+            k += std::tolower(s[0]);
           }
         }
       }
-    }
-  } else if (line.find("\"type\":\"commit_text\"") != std::string::npos) {
-    // Paste feature: commit arbitrary text from clipboard
-    auto pos = line.find("\"text\":\"");
-    if (pos != std::string::npos) {
-      pos += 8;
-      std::string text;
-      // Parse JSON string with escape sequence handling
-      for (size_t i = pos; i < line.size(); ++i) {
-        if (line[i] == '\\' && i + 1 < line.size()) {
-          char next = line[i + 1];
-          if (next == 'n') {
-            text += '\n';
-            ++i;
-          } else if (next == 'r') {
-            text += '\r';
-            ++i;
-          } else if (next == 't') {
-            text += '\t';
-            ++i;
-          } else if (next == '"') {
-            text += '"';
-            ++i;
-          } else if (next == '\\') {
-            text += '\\';
-            ++i;
-          } else {
-            text += line[i];
-          }
-        } else if (line[i] == '"') {
-          break;
-        } else {
-          text += line[i];
-        }
+      if (!k.empty()) {
+        batch->keySeq = generateCandidates(*state, k, context);
       }
+      batch->keys = std::move(k);
+      batch->keySeqUs =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              Clock::now() - start)
+              .count();
+      batch->keySeqReady.store(true, std::memory_order_release);
+      batch->group.done();
+    });
+
+    // Wait in slices so a newer swipe cancels this one promptly; the
+    // abandoned tasks finish into the shared batch and are discarded
+    const auto poll = std::chrono::milliseconds(swipe_config::CANCEL_POLL_MS);
+    bool allDone = false;
+    while (!allDone && Clock::now() < deadline) {
+      allDone = batch->group.waitUntil(std::min(deadline, Clock::now() + poll));
+      if (!allDone && swipeSuperseded(request))
+        return nullptr;
+    }
 
-      if (text.empty()) {
-        MKLOG(Warn) << "commit_text: empty text";
-      } else {
-        auto *ic = pickTargetInputContext();
-        if (ic) {
-          ic->commitString(text);
-          MKLOG(Info) << "commit_text: pasted len=" << text.size()
-                      << " program=" << ic->program();
-        } else {
-          MKLOG(Warn) << "commit_text: no IC found";
-        }
+    bool shark2Ready = batch->shark2Ready.load(std::memory_order_acquire);
+    bool keySeqReady = batch->keySeqReady.load(std::memory_order_acquire);
+    static const std::vector<Candidate> none;
+    const auto &shark2Results = shark2Ready ? batch->shark2 : none;
+    const auto &keySeqResults = keySeqReady ? batch->keySeq : none;
+
+    if (keySeqReady && keysString.empty()) {
+      keysString = batch->keys;
+    }
+    candidates = mergeEnsemble(shark2Results, keySeqResults);
+
+    // Calibration samples are recorded back on the event loop
+    if (shark2Ready)
+      result->shark2Us = batch->shark2Us;
+
+    if (!shark2Results.empty())
+      result->shark2Path = std::move(shark2Path);
+
+    MKLOG(Info) << "Ensemble: points=" << path.size() << " keys="
+                << keysString << " shark2="
+                << (shark2Ready ? std::to_string(shark2Results.size()) + "@" +
+                                      std::to_string(batch->shark2Us) + "us"
+                                : std::string("late"))
+                << " keyseq="
+                << (keySeqReady ? std::to_string(keySeqResults.size()) + "@" +
+                                      std::to_string(batch->keySeqUs) + "us"
+                                : std::string("late"))
+                << " top=" << (candidates.empty() ? "?" : candidates[0].word)
+                << (allDone ? "" : " (deadline)");
+    if (shark2Ready && !batch->shark2Complete) {
+      MKLOG(Info) << "SHARK2 budget hit: scored "
+                  << static_cast<int>(batch->shark2Coverage * 100)
+                  << "% of candidates";
+    }
+
+    // Shadow trial: hand the same swipe to the background decoders
+    if (shadow_.running() && !candidates.empty()) {
+      ShadowInput input;
+      input.points.reserve(path.size());
+      for (const auto &pt : path) {
+        input.points.emplace_back(pt.x, pt.y);
+      }
+      input.keys = keysString;
+      for (size_t i = 0;
+           i < candidates.size() && i < shadow_config::TOP_K; ++i) {
+        input.liveTop.push_back(candidates[i].word);
       }
+      input.liveUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                         Clock::now() - start)
+                         .count();
+      shadow_.submit(std::move(input));
+    }
+  }
+
+  if (swipeSuperseded(request))
+    return nullptr;
+  result->candidates = std::move(candidates);
+  result->keys = std::move(keysString);
+  return result;
+}
+
+void MagicKeyboardEngine::applySwipeResult() {
+  auto result = swipeResults_.take();
+  if (!result)
+    return;
+  // A newer swipe, a key press or a focus change since the request makes
+  // this result stale; applying it would resurrect old candidates
+  if (result->generation != swipeGeneration_.load(std::memory_order_acquire)) {
+    swipeDropped_++;
+    MKLOG(Debug) << "Dropped stale swipe result seq=" << result->seq;
+    return;
+  }
+  swipeDecoded_++;
+  inputHold_.swipeFinished();
+
+  if (result->shark2Us >= 0)
+    calibrator_.recordLive(result->shark2Us);
+  lastSwipePath_ = std::move(result->shark2Path);
+
+  const auto &candidates = result->candidates;
+  const auto &keysString = result->keys;
+  long long seq_num = result->seq; // Echo the seq that was decoded
+  if (!candidates.empty()) {
+    // Send keys for debug highlight with sequence echo
+    writer_.begin("swipe_keys").num("seq", seq_num).beginArray("keys");
+    for (char k : keysString)
+      writer_.str(std::string_view(&k, 1));
+    sendToUI(writer_.endArray().finish());
+
+    // Send actual candidates to UI (include sequence)
+    writer_.begin("swipe_candidates")
+        .num("seq", seq_num)
+        .beginArray("candidates");
+    for (const auto &c : candidates) {
+      writer_.beginObject()
+          .str("word", c.word)
+          .num("score", c.score)
+          .endObject();
+    }
+    sendToUI(writer_.endArray().finish());
+
+    // Store candidates in engine for selection
+    currentCandidates_ = candidates;
+    candidateMode_ = true;
+  }
+
+  // A space tapped during the decode now commits the top candidate
+  releaseHeldInput();
+}
+
+void MagicKeyboardEngine::handleHello(const ipc::MessageReader &msg,
+                                      int clientFd) {
+  std::string role;
+  if (!msg.string("role", role))
+    return;
+  auto it = clients_.find(clientFd);
+  if (it != clients_.end()) {
+    it->second->role = role;
+    MKLOG(Info) << "Client " << clientFd << " identified as role: " << role;
+
+    // Send current settings to UI on connect
+    if (role == "ui") {
+      sendSettingsToUI();
+    }
+
+    // Priority lane: tell a client that asks where to send its keys
+    int lanes = 0;
+    if (msg.number("lanes", lanes) && lanes >= ipc::LANES_VERSION &&
+        priorityFd_ >= 0) {
+      sendToClient(clientFd, writer_.begin("lanes")
+                                 .num("version", ipc::LANES_VERSION)
+                                 .str("priority", ipc::getPrioritySocketPath())
+                                 .finish());
+    }
+
+    // Binary frames: accept them from this client and tell it so
+    int frames = 0;
+    if (msg.number("frames", frames) && frames >= ipc::frame::VERSION) {
+      it->second->frames = true;
+      sendToClient(clientFd, writer_.begin("frames")
+                                 .num("version", ipc::frame::VERSION)
+                                 .finish());
+      MKLOG(Info) << "Client " << clientFd << " uses binary frames v"
+                  << ipc::frame::VERSION;
+    }
+  }
+}
+
+void MagicKeyboardEngine::handleCommitText(const ipc::MessageReader &msg,
+                                           int) {
+  // Paste feature: commit arbitrary text from clipboard
+  std::string text;
+  if (!msg.string("text", text)) {
+    MKLOG(Warn) << "commit_text: missing text field";
+    return;
+  }
+
+  if (text.empty()) {
+    MKLOG(Warn) << "commit_text: empty text";
+  } else {
+    // Keys tapped before the paste go first
+    if (!inputHold_.empty())
+      cancelPendingSwipe();
+    clearTypedWord(); // The pasted text ends any typed word
+    auto *ic = pickTargetInputContext();
+    if (ic) {
+      ic->commitString(text);
+      MKLOG(Info) << "commit_text: pasted len=" << text.size()
+                  << " program=" << ic->program();
     } else {
-      MKLOG(Warn) << "commit_text: missing text field";
+      MKLOG(Warn) << "commit_text: no IC found";
     }
   }
 }
@@ -1519,37 +2041,46 @@ void MagicKeyboardEngine::startSocketServer() {
           auto client = std::make_unique<Client>();
           client->event = instance_->eventLoop().addIOEvent(
               clientFd, fcitx::IOEventFlag::In,
-              [this, clientFd](fcitx::EventSource *, int, fcitx::IOEventFlags) {
+              [this, clientFd](fcitx::EventSourceIO *, int,
+                               fcitx::IOEventFlags flags) {
                 if (shuttingDown_)
                   return true;
 
                 // Guard: ensure client still exists (could be removed during
                 // teardown)
-                if (clients_.find(clientFd) == clients_.end())
+                auto it = clients_.find(clientFd);
+                if (it == clients_.end())
+                  return true;
+                Client &client = *it->second;
+
+                // Writable again: send what queued up while it was full
+                if (flags.test(fcitx::IOEventFlag::Out))
+                  flushClient(clientFd, client);
+                if (!flags.test(fcitx::IOEventFlag::In) &&
+                    !flags.test(fcitx::IOEventFlag::Hup) &&
+                    !flags.test(fcitx::IOEventFlag::Err))
                   return true;
 
-                char buf[1024];
-                ssize_t n = read(clientFd, buf, sizeof(buf) - 1);
-                if (n > 0) {
-                  buf[n] = '\0';
-                  auto &it = clients_[clientFd];
-                  it->buffer += buf;
-
-                  size_t pos;
-                  while ((pos = it->buffer.find('\n')) != std::string::npos) {
-                    std::string line = it->buffer.substr(0, pos);
-                    it->buffer.erase(0, pos + 1);
-                    if (!line.empty())
-                      processLine(line, clientFd);
-                  }
-                } else if (n == 0) {
-                  auto it = clients_.find(clientFd);
-                  if (it != clients_.end()) {
-                    if (it->second->role == "ui" || it->second->role.empty()) {
-                      MKLOG(Info) << "UI disconnected (fd=" << clientFd << ")";
-                    }
-                    clients_.erase(it);
+                // Read until the socket would block, handing out messages
+                // whenever the ring fills; a bounded budget per wakeup
+                // keeps one chatty client from starving the loop
+                size_t budget = input_config::READ_BUDGET_BYTES;
+                ByteRing::ReadStatus status;
+                do {
+                  status = client.input.fill(clientFd, budget);
+                  drainClientInput(client, clientFd);
+                } while (status == ByteRing::ReadStatus::Full && budget > 0);
+
+                if (status == ByteRing::ReadStatus::Closed ||
+                    status == ByteRing::ReadStatus::Error) {
+                  if (status == ByteRing::ReadStatus::Error)
+                    MKLOG(Warn) << "Read failed on fd " << clientFd << ": "
+                                << strerror(errno);
+                  if (client.role == "ui" || client.role.empty()) {
+                    MKLOG(Info) << "UI disconnected (fd=" << clientFd << ")";
                   }
+                  clients_.erase(it);
+                  releaseHeldInput(); // Nothing more will come from it
                 }
                 return true;
               });
@@ -1558,16 +2089,347 @@ void MagicKeyboardEngine::startSocketServer() {
 
           // Sync visibility state to newly-connected client
           if (visibilityState_ == VisibilityState::Visible) {
-            std::string msg = "{\"type\":\"show\"}\n";
-            write(clientFd, msg.c_str(), msg.size());
+            sendToClient(clientFd, "{\"type\":\"show\"}\n");
           }
         }
         return true;
       });
+
+  startPriorityLane();
+}
+
+void MagicKeyboardEngine::drainClientInput(Client &client, int clientFd) {
+  // Messages are handed out as views into the ring, then consumed
+  ByteRing &in = client.input;
+  while (!in.empty()) {
+    // Rest of an oversized message being skipped
+    if (client.skipBytes > 0) {
+      size_t n = std::min(client.skipBytes, in.size());
+      in.consume(n);
+      client.skipBytes -= n;
+      continue;
+    }
+    if (client.skipLine) {
+      size_t nl = in.find('\n');
+      in.consume(nl == ByteRing::npos ? in.size() : nl + 1);
+      client.skipLine = nl == ByteRing::npos;
+      continue;
+    }
+
+    // Taps queued on the priority lane go ahead of this message
+    servicePriorityLane();
+
+    if (client.frames && in.at(0) == ipc::frame::MARK) {
+      size_t size = ipc::frame::frameSize(
+          in.view(0, std::min(in.size(), ipc::frame::SWIPE_HEADER_BYTES)));
+      if (size == ipc::frame::INVALID) {
+        // No way to find the next message boundary inside binary data
+        MKLOG(Warn) << "Bad frame from fd " << clientFd << ", dropped "
+                    << in.size() << " buffered bytes";
+        in.consume(in.size());
+        break;
+      }
+      if (size == 0)
+        break; // Partial header
+      if (size > input_config::MAX_MESSAGE_BYTES) {
+        MKLOG(Warn) << "Skipping " << size << "-byte frame from fd "
+                    << clientFd;
+        client.skipBytes = size;
+        continue;
+      }
+      if (size > in.size())
+        break; // Partial frame
+      handleFrame(in.view(0, size), clientFd);
+      in.consume(size);
+      client.scanned = 0;
+      continue;
+    }
+
+    // Bytes before client.scanned were searched on an earlier read
+    size_t nl = in.find('\n', client.scanned);
+    if (nl == ByteRing::npos) {
+      client.scanned = in.size();
+      if (in.size() > input_config::MAX_MESSAGE_BYTES) {
+        MKLOG(Warn) << "Skipping line over "
+                    << input_config::MAX_MESSAGE_BYTES << " bytes from fd "
+                    << clientFd;
+        in.consume(in.size());
+        client.skipLine = true;
+        client.scanned = 0;
+      }
+      break;
+    }
+    if (nl > input_config::MAX_MESSAGE_BYTES)
+      MKLOG(Warn) << "Skipping " << nl << "-byte line from fd " << clientFd;
+    else if (nl > 0)
+      processLine(in.view(0, nl), clientFd);
+    in.consume(nl + 1);
+    client.scanned = 0;
+  }
+
+  // Lane taps that were waiting for the messages just handled
+  releaseHeldInput();
+}
+
+void MagicKeyboardEngine::startPriorityLane() {
+  std::string path = ipc::getPrioritySocketPath();
+  unlink(path.c_str());
+
+  priorityFd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       0);
+  if (priorityFd_ < 0) {
+    MKLOG(Warn) << "Priority lane disabled, socket() failed: "
+                << strerror(errno);
+    return;
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  if (bind(priorityFd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(priorityFd_, 1) < 0) {
+    // Keys still work over the stream socket
+    MKLOG(Warn) << "Priority lane disabled: " << strerror(errno);
+    close(priorityFd_);
+    priorityFd_ = -1;
+    return;
+  }
+
+  MKLOG(Info) << "Priority lane listening: " << path;
+
+  priorityEvent_ = instance_->eventLoop().addIOEvent(
+      priorityFd_, fcitx::IOEventFlag::In,
+      [this](fcitx::EventSource *, int fd, fcitx::IOEventFlags) {
+        if (shuttingDown_)
+          return true;
+
+        int laneFd =
+            accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (laneFd < 0)
+          return true;
+        MKLOG(Info) << "Priority lane connected (fd=" << laneFd << ")";
+        priorityClients_[laneFd] = instance_->eventLoop().addIOEvent(
+            laneFd, fcitx::IOEventFlag::In,
+            [this](fcitx::EventSourceIO *, int laneFd, fcitx::IOEventFlags) {
+              if (shuttingDown_)
+                return true;
+              // Erasing destroys this event source: do it last
+              if (priorityClients_.count(laneFd) &&
+                  !readPriorityClient(laneFd)) {
+                MKLOG(Info) << "Priority lane disconnected (fd=" << laneFd
+                            << ")";
+                if (sampleRingLane_ == laneFd)
+                  detachSampleRing();
+                close(laneFd);
+                priorityClients_.erase(laneFd);
+              }
+              return true;
+            });
+        return true;
+      });
+}
+
+void MagicKeyboardEngine::servicePriorityLane() {
+  // Closed lanes are reaped by their own IO callback, which sees the
+  // hangup on its next dispatch
+  for (const auto &entry : priorityClients_)
+    readPriorityClient(entry.first);
+}
+
+bool MagicKeyboardEngine::readPriorityClient(int fd) {
+  // One message per datagram, so no buffering across reads
+  char buf[ipc::PRIORITY_MESSAGE_MAX];
+  std::vector<int> fds;
+  while (true) {
+    bool truncated = false;
+    fds.clear();
+    ssize_t n = ipc::recvWithFds(fd, buf, sizeof(buf), fds, truncated);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (n == 0)
+      return false;
+    std::string_view msg(buf, n);
+
+    // Descriptors only come with the sample ring setup message
+    if (!fds.empty()) {
+      if (!truncated && fds.size() == 2 && message_.parse(msg) &&
+          message_.type() == "sample_ring") {
+        attachSampleRing(fds[0], fds[1], fd);
+      } else {
+        MKLOG(Warn) << "Dropped " << fds.size()
+                    << " unexpected fds on priority lane";
+        for (int f : fds)
+          close(f);
+      }
+      continue;
+    }
+    if (truncated) {
+      MKLOG(Warn) << "Dropped oversized message on priority lane";
+      continue;
+    }
+    priorityMessages_++;
+    handlePriorityMessage(msg, fd);
+  }
+}
+
+void MagicKeyboardEngine::handlePriorityMessage(std::string_view msg,
+                                                int fd) {
+  if (!msg.empty() && msg.back() == '\n')
+    msg.remove_suffix(1);
+  if (msg.empty())
+    return;
+
+  // Key frames and key/action lines only; anything else belongs on the
+  // stream socket, where its ordering against other messages holds
+  if (static_cast<uint8_t>(msg[0]) == ipc::frame::MARK) {
+    if (ipc::frame::frameSize(msg) == msg.size() &&
+        static_cast<ipc::frame::Type>(msg[1]) == ipc::frame::Type::Key) {
+      laneInput_ = true;
+      handleFrame(msg, fd);
+      laneInput_ = false;
+    } else {
+      MKLOG(Warn) << "Dropped non-key frame on priority lane";
+    }
+    return;
+  }
+  if (!message_.parse(msg)) {
+    MKLOG(Warn) << "Dropped malformed message on priority lane: " << msg;
+    return;
+  }
+  laneInput_ = true;
+  if (message_.type() == ipc::msg_type::KEY)
+    handleKeyMessage(message_, fd);
+  else if (message_.type() == ipc::msg_type::ACTION)
+    handleActionMessage(message_, fd);
+  else
+    MKLOG(Warn) << "Dropped \"" << message_.type()
+                << "\" on priority lane";
+  laneInput_ = false;
+}
+
+void MagicKeyboardEngine::attachSampleRing(int memfd, int wakeFd,
+                                           int laneFd) {
+  detachSampleRing();
+  if (!sampleRing_.attach(memfd, wakeFd)) {
+    MKLOG(Warn) << "Rejected sample ring from priority lane fd=" << laneFd;
+    dropSampleRing();
+    return;
+  }
+  sampleRingLane_ = laneFd;
+  sampleRingEvent_ = instance_->eventLoop().addIOEvent(
+      sampleRing_.wakeFd(), fcitx::IOEventFlag::In,
+      [this](fcitx::EventSourceIO *, int, fcitx::IOEventFlags) {
+        if (shuttingDown_)
+          return true;
+        sampleRing_.clearWake();
+        drainSampleRing();
+        return true;
+      });
+  drainSampleRing(); // Arms the ring
+  sendToUI(writer_.begin("sample_ring")
+               .num("version", ipc::sample_ring::VERSION)
+               .finish());
+  MKLOG(Info) << "Swipe samples stream through shared memory (lane fd="
+              << laneFd << ")";
+}
+
+void MagicKeyboardEngine::detachSampleRing() {
+  sampleRingEvent_.reset();
+  sampleRing_.detach();
+  sampleRingLane_ = -1;
+  ringPath_.clear();
+}
+
+void MagicKeyboardEngine::dropSampleRing() {
+  detachSampleRing();
+  sendToUI(writer_.begin("sample_ring").num("version", 0).finish());
+}
+
+void MagicKeyboardEngine::drainSampleRing() {
+  auto take = [this](const ipc::sample_ring::Sample *s, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      // A new stroke id starts a new path
+      if (s[i].stroke != ringStroke_) {
+        ringStroke_ = s[i].stroke;
+        ringPath_.clear();
+      }
+      if (!std::isfinite(s[i].x) || !std::isfinite(s[i].y) ||
+          ringPath_.size() >= ipc::frame::MAX_POINTS)
+        continue;
+      ringPath_.push_back({s[i].x, s[i].y, std::isfinite(s[i].t) ? s[i].t
+                                                                 : -1.0});
+    }
+  };
+  // Sleep only once the ring is empty; samples that land in between are
+  // taken now instead of costing another wakeup
+  do {
+    sampleRing_.consume(take);
+  } while (!sampleRing_.arm());
+
+  if (sampleRing_.corrupt()) {
+    MKLOG(Warn) << "Sample ring indices out of range, detaching";
+    dropSampleRing();
+  }
+}
+
+void MagicKeyboardEngine::handleSwipeRing(const ipc::MessageReader &msg,
+                                          int) {
+  long long seq = 0, count = 0;
+  msg.number("seq", seq);
+  msg.number("count", count);
+  // The stroke is lost on this side; the UI still has its path
+  auto resend = [this, seq](const char *why) {
+    MKLOG(Warn) << "swipe_ring seq=" << seq << " " << why
+                << ", asking for the path";
+    sendToUI(writer_.begin("swipe_resend").num("seq", seq).finish());
+  };
+  if (!sampleRing_.attached()) {
+    // Detached before the UI heard; make sure it stops using the ring
+    sendToUI(writer_.begin("sample_ring").num("version", 0).finish());
+    resend("arrived with no ring attached");
+    return;
+  }
+
+  // Everything the UI published before sending this is in the ring
+  drainSampleRing();
+  if (!sampleRing_.attached()) {
+    resend("lost with the ring"); // Found corrupt while draining
+    return;
+  }
+  if (ringStroke_ != static_cast<uint32_t>(seq) || ringPath_.empty()) {
+    resend("has no samples");
+    return;
+  }
+  if (static_cast<long long>(ringPath_.size()) != count)
+    MKLOG(Warn) << "swipe_ring seq=" << seq << " expected " << count
+                << " samples, have " << ringPath_.size();
+  pathSamples_.swap(ringPath_);
+  ringPath_.clear();
+  recognizeSwipe(seq, std::string());
+}
+
+void MagicKeyboardEngine::stopPriorityLane() {
+  detachSampleRing();
+  for (const auto &[fd, event] : priorityClients_)
+    close(fd);
+  priorityClients_.clear();
+  priorityEvent_.reset();
+
+  if (priorityFd_ >= 0) {
+    close(priorityFd_);
+    unlink(ipc::getPrioritySocketPath().c_str());
+    priorityFd_ = -1;
+  }
 }
 
 void MagicKeyboardEngine::stopSocketServer() {
   // HARDENED ORDER: kill event sources first to stop callbacks
+  stopPriorityLane();
   for (auto const &[fd, client] : clients_) {
     client->event.reset();
     close(fd);
@@ -1611,21 +2473,183 @@ void MagicKeyboardEngine::launchUI() {
   }
 }
 
-void MagicKeyboardEngine::loadDictionary() {
-  dictionary_.clear();
-  for (int i = 0; i < 26; ++i)
-    for (int j = 0; j < 26; ++j)
-      buckets_[i][j].clear();
+void MagicKeyboardEngine::requestReload(std::string reason, bool userData) {
+  auto request = std::make_unique<ReloadRequest>();
+  request->reason = std::move(reason);
+  request->userData = userData;
+  if (auto replaced = reloadRequests_.put(std::move(request))) {
+    // Not started yet: fold it into the newer request, or put it back if
+    // the worker took that one meanwhile
+    auto pending = reloadRequests_.take();
+    if (!pending) {
+      if (!replaced->userData)
+        return;
+      pending = std::move(replaced);
+    } else {
+      pending->userData = pending->userData || replaced->userData;
+    }
+    reloadRequests_.put(std::move(pending));
+  }
+}
 
-  // Try new format first: words_en.txt (word freq)
-  std::string wordRelPath = "magic-keyboard/dict/words_en.txt";
-  std::string foundWordPath = findDataFile(wordRelPath);
+void MagicKeyboardEngine::startReloadWorker() {
+  reloadWorker_ = std::thread([this]() { reloadWorkerLoop(); });
 
-  if (foundWordPath.empty()) {
+  // Edits to the loaded files are picked up without a restart
+  reloadWatch_ = instance_->eventLoop().addTimeEvent(
+      CLOCK_MONOTONIC,
+      fcitx::now(CLOCK_MONOTONIC) + reload_config::WATCH_MS * 1000, 0,
+      [this](fcitx::EventSourceTime *source, uint64_t) {
+        if (shuttingDown_)
+          return false;
+        auto current = state();
+        if (current &&
+            (fileStamp(current->layoutPath) != current->layoutStamp ||
+             fileStamp(current->dictionaryPath) != current->dictionaryStamp))
+          requestReload("file changed");
+        source->setTime(fcitx::now(CLOCK_MONOTONIC) +
+                        reload_config::WATCH_MS * 1000);
+        return true;
+      });
+}
+
+void MagicKeyboardEngine::stopReloadWorker() {
+  reloadWatch_.reset();
+  // A reload in progress is finished first
+  reloadRequests_.close();
+  if (reloadWorker_.joinable())
+    reloadWorker_.join();
+}
+
+void MagicKeyboardEngine::warmUp() {
+  auto start = std::chrono::steady_clock::now();
+  UserDataManager::instance().load();
+  MKLOG(Info) << "Loaded " << UserDataManager::instance().getUnigramCount()
+              << " unigrams, " << UserDataManager::instance().getBigramCount()
+              << " bigrams";
+
+  reload({"startup"});
+  if (shark2Engine_.loadUserTemplates(userTemplatesPath())) {
+    MKLOG(Info) << "Loaded " << shark2Engine_.getUserTemplateCount()
+                << " personal gesture templates";
+  }
+  calibrator_.start(calibrationWords());
+
+  // Releases a swipe the worker is holding until now
+  ready_.store(true, std::memory_order_release);
+  ready_.notify_all();
+  MKLOG(Info) << "Magic Keyboard engine ready in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " ms";
+}
+
+void MagicKeyboardEngine::reloadWorkerLoop() {
+  warmUp();
+  while (reloadRequests_.wait()) {
+    if (auto request = reloadRequests_.take())
+      reload(*request);
+  }
+}
+
+void MagicKeyboardEngine::reload(const ReloadRequest &request) {
+  auto start = std::chrono::steady_clock::now();
+  if (request.userData) {
+    UserDataManager::instance().load();
+    MKLOG(Info) << "Reloaded " << UserDataManager::instance().getUnigramCount()
+                << " unigrams, "
+                << UserDataManager::instance().getBigramCount()
+                << " bigrams";
+  }
+
+  // Start from the current state; only what changed is rebuilt, the rest
+  // (usually the lexicon) is shared with it
+  auto current = state();
+  auto next = current ? std::make_shared<EngineState>(*current)
+                      : std::make_shared<EngineState>();
+
+  std::string layout = SettingsManager::instance().get().activeLayout;
+  if (!loadLayout(*next, layout) && layout != "qwerty") {
+    MKLOG(Warn) << "Layout " << layout << " unavailable, using qwerty";
+    loadLayout(*next, "qwerty");
+  }
+  bool layoutChanged = !current || next->layoutPath != current->layoutPath ||
+                       next->layoutStamp != current->layoutStamp;
+
+  std::string dictionaryPath = findDictionary();
+  if (!current || dictionaryPath != current->dictionaryPath ||
+      fileStamp(dictionaryPath) != current->dictionaryStamp)
+    loadDictionary(*next);
+  bool dictionaryChanged = !current || next->lexicon != current->lexicon;
+
+  if (!layoutChanged && !dictionaryChanged) {
+    MKLOG(Debug) << "Reload (" << request.reason << "): nothing changed";
+    return;
+  }
+
+  // SHARK2 swaps its templates and key centers in together; decodes keep
+  // running on the old ones until then
+  if (useShark2_) {
+    shark2::Shark2Engine::KeyCenters centers;
+    for (const auto &k : next->keys) {
+      if (k.id.length() == 1 && std::isalpha(k.id[0]))
+        centers[std::tolower(k.id[0])] = {k.center.x, k.center.y};
+    }
+    size_t syncCount = centers.size();
+    shark2Engine_.setKeyboardSize(580, 200); // Match compact UI
+    if (centers.empty())
+      shark2Engine_.loadLexicon(next->lexicon);
+    else
+      shark2Engine_.loadLexicon(next->lexicon, std::move(centers));
+    MKLOG(Info) << "SHARK2 engine loaded " << shark2Engine_.getTemplateCount()
+                << " templates, " << syncCount << " letter keys";
+    loadUserWords(); // A load resets the overlay
+  }
+
+  // Space key bounds drive phrase-swipe segmentation
+  phraseDecoder_.clearSpaceKey();
+  for (const auto &k : next->keys) {
+    if (k.id == "space") {
+      phraseDecoder_.setSpaceKey(k.r.x, k.r.y, k.r.w, k.r.h);
+      break;
+    }
+  }
+
+  next->version = layoutVersion_.fetch_add(1) + 1;
+  state_.store(std::move(next), std::memory_order_release);
+  invalidateResultCaches();
+  reloads_++;
+  MKLOG(Info) << "Engine state published (" << request.reason
+              << "): layout " << (layoutChanged ? "reloaded" : "kept")
+              << ", dictionary " << (dictionaryChanged ? "reloaded" : "kept")
+              << " in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " ms";
+}
+
+void MagicKeyboardEngine::handleReload(const ipc::MessageReader &, int) {
+  // magickeyboardctl reload: re-read everything, learning data included
+  requestReload("requested", true);
+}
+
+std::string MagicKeyboardEngine::findDictionary() const {
+  // Try new format first: words_en.txt (word freq)
+  std::string path = findDataFile("magic-keyboard/dict/words_en.txt");
+  if (path.empty()) {
     // Fallback to legacy path if new one missing
-    wordRelPath = "magic-keyboard/dict/words.txt";
-    foundWordPath = findDataFile(wordRelPath);
+    path = findDataFile("magic-keyboard/dict/words.txt");
   }
+  return path;
+}
+
+void MagicKeyboardEngine::loadDictionary(EngineState &next) const {
+  lexicon::Lexicon::Builder words;
+  std::string foundWordPath = findDictionary();
+  next.dictionaryPath = foundWordPath;
+  next.dictionaryStamp = fileStamp(foundWordPath);
 
   if (foundWordPath.empty()) {
     std::string roots;
@@ -1641,23 +2665,13 @@ void MagicKeyboardEngine::loadDictionary() {
         {"and", 25000},  {"a", 20000},    {"in", 15000},     {"hello", 1000},
         {"world", 1000}, {"magic", 1000}, {"keyboard", 1000}};
 
-    for (const auto &p : fallbacks) {
-      trie_->insert(p.first, p.second);
-
-      DictWord dw;
-      dw.word = p.first;
-      dw.freq = p.second;
-      dw.len = (int)p.first.length();
-      dw.first = p.first[0];
-      dw.last = p.first.back();
-      dictionary_.push_back(dw);
-
-      int fidx = dw.first - 'a';
-      int lidx = dw.last - 'a';
-      if (fidx >= 0 && fidx < 26 && lidx >= 0 && lidx < 26) {
-        buckets_[fidx][lidx].push_back((int)dictionary_.size() - 1);
-      }
-    }
+    for (const auto &p : fallbacks)
+      words.add(p.first, static_cast<uint32_t>(p.second));
+    auto trie = buildTrie(words, "");
+    next.lexicon = words.build(std::move(trie));
+    auto bigrams = std::make_shared<lexicon::BigramIndex>();
+    bigrams->build(*next.lexicon);
+    next.bigramIndex = std::move(bigrams);
     return;
   }
 
@@ -1714,76 +2728,27 @@ void MagicKeyboardEngine::loadDictionary() {
     for (auto &c : word)
       c = std::tolower(c);
 
-    // Insert into Trie
-    trie_->insert(word, freq);
-
-    // Insert into vector (for candidate iteration)
-    DictWord dw;
-    dw.word = word;
-    dw.freq = freq;
-    dw.len = (int)word.length();
-    dw.first = word[0];
-    dw.last = word.back();
-    dictionary_.push_back(dw);
-
-    int fidx = dw.first - 'a';
-    int lidx = dw.last - 'a';
-    if (fidx >= 0 && fidx < 26 && lidx >= 0 && lidx < 26) {
-      buckets_[fidx][lidx].push_back((int)dictionary_.size() - 1);
-    }
+    // One copy of the word, in the lexicon's arena; the trie, buckets and
+    // SHARK2 templates all refer to it by id
+    words.add(word, freq);
     loadedWords++;
   }
 
-  MKLOG(Info) << "Loaded " << loadedWords << " words into Trie and Vector";
+  auto trie = buildTrie(words, foundWordPath);
+  next.lexicon = words.build(std::move(trie));
+  MKLOG(Info) << "Loaded " << loadedWords << " words ("
+              << next.lexicon->memoryBytes() / 1024 << " KiB lexicon)";
 
-  // Initialize SHARK2 engine with the same dictionary
-  if (useShark2_) {
-    std::vector<std::pair<std::string, uint32_t>> shark2Words;
-    shark2Words.reserve(dictionary_.size());
-    for (const auto &dw : dictionary_) {
-      // SHARK2 expects frequency rank (lower = better), not raw frequency
-      // Convert: higher raw freq -> lower rank
-      uint32_t rank = dw.freq > 0 ? (100000 / (dw.freq + 1)) : 50000;
-      shark2Words.emplace_back(dw.word, rank);
-    }
-    shark2Engine_.setKeyboardSize(580, 200); // Match compact UI
-    shark2Engine_.loadDictionaryWithFrequency(shark2Words);
-    MKLOG(Info) << "SHARK2 engine loaded " << shark2Engine_.getTemplateCount()
-                << " templates";
-  }
-}
-
-// Keyboard adjacency map for QWERTY layout
-static const std::vector<std::vector<char>> adjacentKeys = {
-    {'q', 's', 'z', 'w'},           // a
-    {'v', 'g', 'h', 'n'},           // b
-    {'x', 'd', 'f', 'v'},           // c
-    {'s', 'e', 'r', 'f', 'c', 'x'}, // d
-    {'w', 's', 'd', 'r'},           // e
-    {'d', 'r', 't', 'g', 'v', 'c'}, // f
-    {'f', 't', 'y', 'h', 'b', 'v'}, // g
-    {'g', 'y', 'u', 'j', 'n', 'b'}, // h
-    {'u', 'j', 'k', 'o'},           // i
-    {'h', 'u', 'i', 'k', 'm', 'n'}, // j
-    {'j', 'i', 'o', 'l', 'm'},      // k
-    {'k', 'o', 'p'},                // l
-    {'n', 'j', 'k'},                // m
-    {'b', 'h', 'j', 'm'},           // n
-    {'i', 'k', 'l', 'p'},           // o
-    {'o', 'l'},                     // p
-    {'w', 'a', 's'},                // q
-    {'e', 'd', 'f', 't'},           // r
-    {'a', 'w', 'e', 'd', 'x', 'z'}, // s
-    {'r', 'f', 'g', 'y'},           // t
-    {'y', 'h', 'j', 'i'},           // u
-    {'c', 'f', 'g', 'b'},           // v
-    {'q', 'a', 's', 'e'},           // w
-    {'z', 's', 'd', 'c'},           // x
-    {'t', 'g', 'h', 'u'},           // y
-    {'a', 's', 'x'},                // z
-};
-
-std::vector<int> MagicKeyboardEngine::getShortlist(const std::string &keys) {
+  auto bigrams = std::make_shared<lexicon::BigramIndex>();
+  bigrams->build(*next.lexicon);
+  MKLOG(Info) << "Bigram index: " << bigrams->wordCount() << " words, "
+              << bigrams->postingBytes() << " posting bytes";
+  next.bigramIndex = std::move(bigrams);
+}
+
+std::vector<uint32_t>
+MagicKeyboardEngine::getShortlist(const EngineState &state,
+                                  const std::string &keys) const {
   if (keys.empty())
     return {};
 
@@ -1794,53 +2759,50 @@ std::vector<int> MagicKeyboardEngine::getShortlist(const std::string &keys) {
   if (fidx < 0 || fidx >= 26 || lidx < 0 || lidx >= 26)
     return {};
 
-  std::vector<int> result;
+  const lexicon::Lexicon &lex = *state.lexicon;
+  std::vector<uint32_t> result;
+  std::vector<bool> seen(lex.size(), false);
   int targetLen = (int)keys.length();
 
-  // Collect first/last letter candidates including adjacent keys
-  std::vector<int> firstCandidates = {fidx};
-  std::vector<int> lastCandidates = {lidx};
-
-  // Add adjacent keys for first letter
-  for (char adj : adjacentKeys[fidx]) {
-    int adjIdx = adj - 'a';
-    if (adjIdx >= 0 && adjIdx < 26)
-      firstCandidates.push_back(adjIdx);
-  }
-
-  // Add adjacent keys for last letter
-  for (char adj : adjacentKeys[lidx]) {
-    int adjIdx = adj - 'a';
-    if (adjIdx >= 0 && adjIdx < 26)
-      lastCandidates.push_back(adjIdx);
-  }
-
-  // Search all combinations of first/last candidates
-  std::set<int> seen;
-  for (int fi : firstCandidates) {
-    for (int li : lastCandidates) {
-      for (int idx : buckets_[fi][li]) {
-        if (seen.count(idx))
+  // 1. First/last letter buckets, including layout-adjacent keys. Cheap,
+  // and tolerant of the extra keys a swipe passes over mid-word.
+  for (int fi = 0; fi < 26; ++fi) {
+    if (fi != fidx && !state.keyAdjacent[fidx][fi])
+      continue;
+    for (int li = 0; li < 26; ++li) {
+      if (li != lidx && !state.keyAdjacent[lidx][li])
+        continue;
+      for (uint32_t idx : lex.bucket(fi, li)) {
+        if (seen[idx])
           continue;
-        const auto &dw = dictionary_[idx];
         // Allow ±4 length difference for more flexibility
-        if (std::abs(dw.len - targetLen) <= 4) {
+        if (std::abs(static_cast<int>(lex.length(idx)) - targetLen) <= 4) {
           result.push_back(idx);
-          seen.insert(idx);
+          seen[idx] = true;
         }
       }
     }
   }
 
-  // If still no results, do a broader search with just length filtering
-  if (result.empty() && keys.length() >= 3) {
-    for (size_t i = 0; i < dictionary_.size(); ++i) {
-      const auto &dw = dictionary_[i];
-      if (std::abs(dw.len - targetLen) <= 2) {
-        result.push_back(i);
-        if (result.size() > 500)
-          break; // Cap for performance
-      }
+  // 2. Everything within a few weighted edits, whatever its ends. Walks
+  // only the trie branches that can still match; no dictionary scan.
+  for (const auto &m : lex.trie()->fuzzySearch(
+           keys, keyseq_config::FUZZY_MAX_COST, state.editCosts)) {
+    if (m.wordId >= 0 && static_cast<size_t>(m.wordId) < lex.size() &&
+        !seen[m.wordId]) {
+      result.push_back(m.wordId);
+      seen[m.wordId] = true;
+    }
+  }
+
+  // 3. Words sharing most of the sequence's bigrams, for swipes whose
+  // first or last key is off by more than a neighbour
+  for (const auto &sw :
+       state.bigramIndex->topK(keys, keyseq_config::BIGRAM_TOP_K,
+                               keyseq_config::BIGRAM_MIN_OVERLAP)) {
+    if (static_cast<size_t>(sw.wordId) < lex.size() && !seen[sw.wordId]) {
+      result.push_back(sw.wordId);
+      seen[sw.wordId] = true;
     }
   }
 
@@ -1848,15 +2810,31 @@ std::vector<int> MagicKeyboardEngine::getShortlist(const std::string &keys) {
 }
 
 std::vector<MagicKeyboardEngine::Candidate>
-MagicKeyboardEngine::generateCandidates(const std::string &keys,
-                                        size_t pointsCount) {
-  auto start = std::chrono::steady_clock::now();
-  auto shortlist = getShortlist(keys);
+MagicKeyboardEngine::generateCandidates(const EngineState &state,
+                                        const std::string &keys,
+                                        const std::string &previousWord) const {
+  // Shortlist with context-free scores; cached, since the same words are
+  // swiped again and again
+  std::string cacheKey = std::to_string(state.version) + "|" + keys;
   std::vector<Candidate> candidates;
+  if (!keySeqCache_.get(cacheKey, candidates)) {
+    auto start = std::chrono::steady_clock::now();
+    const lexicon::Lexicon &lex = *state.lexicon;
+    for (uint32_t id : getShortlist(state, keys)) {
+      std::string_view word = lex.word(id);
+      candidates.push_back(
+          {std::string(word), scoreCandidate(keys, word, lex.frequency(id))});
+    }
+    keySeqCache_.put(cacheKey, candidates,
+                     std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+  }
 
-  for (int idx : shortlist) {
-    const auto &dw = dictionary_[idx];
-    candidates.push_back({dw.word, scoreCandidate(keys, dw)});
+  // Adaptive learning boost, always current
+  auto &userData = UserDataManager::instance();
+  for (auto &c : candidates) {
+    c.score += userData.getLearningBoost(c.word, previousWord);
   }
 
   std::sort(
@@ -1866,59 +2844,60 @@ MagicKeyboardEngine::generateCandidates(const std::string &keys,
   if (candidates.size() > 8)
     candidates.resize(8);
 
-  currentCandidates_ = candidates;
-  candidateMode_ = !candidates.empty();
-
-  auto end = std::chrono::steady_clock::now();
-  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
-                .count();
-
-  MKLOG(Info) << "SwipeCand layout=qwerty points=" << pointsCount
-              << " keys=" << keys.length() << " shortlist=" << shortlist.size()
-              << " cand=" << candidates.size()
-              << " top=" << (candidates.empty() ? "?" : candidates[0].word)
-              << " gen=" << ms << "ms"
-              << " dict=" << dictionary_.size();
-
   return candidates;
 }
 
-int MagicKeyboardEngine::levenshtein(const std::string &s1,
-                                     const std::string &s2, int limit) {
-  int n = s1.length();
-  int m = s2.length();
-  if (std::abs(n - m) > limit)
-    return limit + 1;
-
-  std::vector<int> prev(m + 1);
-  std::vector<int> curr(m + 1);
+std::vector<MagicKeyboardEngine::Candidate>
+MagicKeyboardEngine::mergeEnsemble(const std::vector<Candidate> &shark2,
+                                   const std::vector<Candidate> &keySeq) {
+  // The two decoders score on unrelated scales, so each list is min-max
+  // normalized to [0, 1] and weighted. A word both decoders propose gets
+  // both shares and naturally outranks a word only one of them found.
+  std::vector<Candidate> merged;
+  auto fold = [&merged](const std::vector<Candidate> &list, double weight) {
+    if (list.empty())
+      return;
+    auto [lo, hi] = std::minmax_element(
+        list.begin(), list.end(), [](const Candidate &a, const Candidate &b) {
+          return a.score < b.score;
+        });
+    double range = hi->score - lo->score;
+    for (const auto &c : list) {
+      double norm = range > 1e-9 ? (c.score - lo->score) / range : 1.0;
+      auto it =
+          std::find_if(merged.begin(), merged.end(),
+                       [&c](const Candidate &m) { return m.word == c.word; });
+      if (it != merged.end())
+        it->score += weight * norm;
+      else
+        merged.push_back({c.word, weight * norm});
+    }
+  };
+  fold(shark2, ensemble_config::SHARK2_WEIGHT);
+  fold(keySeq, ensemble_config::KEYSEQ_WEIGHT);
 
-  for (int j = 0; j <= m; ++j)
-    prev[j] = j;
+  std::stable_sort(
+      merged.begin(), merged.end(),
+      [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+  if (merged.size() > 8)
+    merged.resize(8);
+  return merged;
+}
 
-  for (int i = 1; i <= n; ++i) {
-    curr[0] = i;
-    int minRow = curr[0];
-    for (int j = 1; j <= m; ++j) {
-      int cost = (s1[i - 1] == s2[j - 1]) ? 0 : 1;
-      curr[j] = std::min({curr[j - 1] + 1, prev[j] + 1, prev[j - 1] + cost});
-      minRow = std::min(minRow, curr[j]);
-    }
-    if (minRow > limit)
-      return limit + 1;
-    prev = curr;
-  }
-  return prev[m];
+int MagicKeyboardEngine::levenshtein(std::string_view s1, std::string_view s2,
+                                     int limit) const {
+  return editdist::bounded(s1, s2, limit);
 }
 
 double MagicKeyboardEngine::scoreCandidate(const std::string &keys,
-                                           const DictWord &dw) {
+                                           std::string_view word,
+                                           uint32_t freq) const {
   // 1. Edit distance (capped at 7)
-  int dist = levenshtein(keys, dw.word, 7);
+  int dist = levenshtein(keys, word, 7);
 
   // 2. Bigram overlap
   // Use a small fixed array for matches (uint16_t: a*26 + b)
-  auto getBigrams = [](const std::string &s) {
+  auto getBigrams = [](std::string_view s) {
     std::vector<uint16_t> b;
     for (size_t i = 0; i + 1 < s.length(); ++i) {
       if (std::isalpha(s[i]) && std::isalpha(s[i + 1])) {
@@ -1930,7 +2909,7 @@ double MagicKeyboardEngine::scoreCandidate(const std::string &keys,
   };
 
   auto b1 = getBigrams(keys);
-  auto b2 = getBigrams(dw.word);
+  auto b2 = getBigrams(word);
   int overlaps = 0;
   for (auto bg1 : b1) {
     for (auto bg2 : b2) {
@@ -1943,42 +2922,339 @@ double MagicKeyboardEngine::scoreCandidate(const std::string &keys,
 
   // 3. Frequency component
   // Using log(freq) for scaling. Adding 1 to avoid log(0).
-  double freqScore = std::log(dw.freq + 1);
+  double freqScore = std::log(freq + 1);
 
   // 4. Geometry Score (Approximate)
   // Distance is bad, overlaps are good.
   double geomScore = 1.0 * overlaps - 2.2 * dist;
 
-  // 5. Adaptive learning boost
-  double learningBoost =
-      UserDataManager::instance().getLearningBoost(dw.word, lastCommittedWord_);
-
   // Final formula: blend geometry and frequency
-  // totalScore = geomScore * 0.7 + freqScore * 0.3 + learning
-  return geomScore * 0.7 + freqScore * 0.3 + learningBoost;
+  // totalScore = geomScore * 0.7 + freqScore * 0.3 (+ learning, added by
+  // generateCandidates)
+  return geomScore * 0.7 + freqScore * 0.3;
 }
 
 void MagicKeyboardEngine::recordWordCommit(const std::string &word) {
   if (word.empty())
     return;
+  if (!learningAllowed(pickTargetInputContext())) {
+    lastCommittedWord_.clear(); // Nor use it as bigram context
+    lastSwipePath_.clear();
+    return;
+  }
 
-  // Record for learning
-  UserDataManager::instance().recordCommit(word, lastCommittedWord_);
-  lastCommittedWord_ = word;
+  // Phrase candidates commit several words at once; learn each in order so
+  // the bigram chain stays intact
+  size_t start = 0;
+  while (start < word.size()) {
+    size_t end = word.find(' ', start);
+    if (end == std::string::npos)
+      end = word.size();
+    if (end > start) {
+      std::string w = word.substr(start, end - start);
+      UserDataManager::instance().recordCommit(w, lastCommittedWord_);
+      lastCommittedWord_ = w;
+      learnUserWord(w);
+    }
+    start = end + 1;
+  }
 
   MKLOG(Debug) << "Recorded commit: " << word
                << " (unigrams=" << UserDataManager::instance().getUnigramCount()
                << ")";
+
+  // Personal template: only for words the user commits often, so one-off
+  // picks don't crowd out the bounded store
+  if (!lastSwipePath_.empty() && word.find(' ') == std::string::npos &&
+      UserDataManager::instance().getWordCount(word) >=
+          learn_config::TEMPLATE_MIN_COMMITS) {
+    shark2Engine_.learnTemplate(word, lastSwipePath_);
+    if (++templatesSinceSave_ >= learn_config::AUTO_SAVE_INTERVAL) {
+      shark2Engine_.saveUserTemplates(userTemplatesPath());
+      templatesSinceSave_ = 0;
+    }
+  }
+  lastSwipePath_.clear();
+}
+
+bool MagicKeyboardEngine::learningAllowed(fcitx::InputContext *ic) const {
+  if (!ic)
+    return false;
+  // fcitx has no "no prediction" hint; NoSpellCheck is the closest
+  auto caps = ic->capabilityFlags();
+  return !caps.test(fcitx::CapabilityFlag::Password) &&
+         !caps.test(fcitx::CapabilityFlag::Sensitive) &&
+         !caps.test(fcitx::CapabilityFlag::NoSpellCheck);
+}
+
+void MagicKeyboardEngine::trackTypedKey(const std::string &key,
+                                        fcitx::InputContext *ic) {
+  bool allowed = learningAllowed(ic);
+  if (ic != typedWordIC_ || !allowed) {
+    typedWordIC_ = ic;
+    clearTypedWord();
+  }
+  if (!allowed)
+    return; // Not even completions: they would echo the field's text
+  if (key.length() == 1 && std::isalpha(static_cast<unsigned char>(key[0]))) {
+    typedWord_ += std::tolower(static_cast<unsigned char>(key[0]));
+    updateCompletions();
+    return;
+  }
+  if (key == "backspace") {
+    if (!typedWord_.empty())
+      typedWord_.pop_back();
+    updateCompletions();
+    return;
+  }
+
+  std::string word = std::move(typedWord_);
+  typedWord_.clear();
+  updateCompletions();
+  // Caret moves leave a partial word behind; only real breaks commit
+  bool isBreak = key == "space" || key == "enter" || key == "tab" ||
+                 key.length() == 1;
+  if (isBreak && word.length() >= 2)
+    recordWordCommit(word);
+}
+
+void MagicKeyboardEngine::clearTypedWord() {
+  if (typedWord_.empty())
+    return;
+  typedWord_.clear();
+  updateCompletions();
+}
+
+void MagicKeyboardEngine::updateCompletions() {
+  // Runs on every tapped key: a prefix walk plus k range-max pops
+  std::vector<std::string> words;
+  auto current = state(); // Null while warming up
+  if (current && typedWord_.length() >= completion_config::MIN_PREFIX) {
+    const lexicon::Lexicon &lex = *current->lexicon;
+    for (const auto &c :
+         lex.trie()->completeTopK(typedWord_, completion_config::COUNT + 1)) {
+      if (c.wordId < 0 || static_cast<size_t>(c.wordId) >= lex.size())
+        continue;
+      std::string_view word = lex.word(c.wordId);
+      if (word != typedWord_ && words.size() < completion_config::COUNT)
+        words.emplace_back(word);
+    }
+  }
+
+  if (words.empty()) {
+    if (!completionPrefix_.empty()) {
+      completionPrefix_.clear();
+      sendToUI("{\"type\":\"swipe_candidates\",\"candidates\":[]}\n");
+    }
+    return;
+  }
+
+  completionPrefix_ = typedWord_;
+  writer_.begin("swipe_candidates").beginArray("candidates");
+  for (const auto &word : words)
+    writer_.beginObject().str("word", word).endObject();
+  sendToUI(writer_.endArray().finish());
+}
+
+void MagicKeyboardEngine::learnUserWord(const std::string &word) {
+  if (UserDataManager::instance().getWordCount(word) <
+          learn_config::OVERLAY_MIN_COMMITS ||
+      shark2Engine_.hasWord(word))
+    return;
+  if (!shark2Engine_.addWord(word))
+    return;
+
+  MKLOG(Info) << "Overlay: added '" << word << "' ("
+              << shark2Engine_.getOverlaySize() << " pending merge)";
+  scheduleOverlayMerge();
+}
+
+void MagicKeyboardEngine::handleForgetWord(const ipc::MessageReader &msg,
+                                           int) {
+  std::string word;
+  if (!msg.string("word", word) || word.empty()) {
+    MKLOG(Warn) << "forget_word: missing word";
+    return;
+  }
+
+  // Learning data goes for good; a dictionary word is only hidden from
+  // swipes until the next reload rebuilds the templates
+  bool learned = UserDataManager::instance().forgetWord(word);
+  bool removed = shark2Engine_.removeWord(word);
+  MKLOG(Info) << "forget_word: '" << word << "' learned=" << learned
+              << " removed=" << removed;
+  if (removed)
+    scheduleOverlayMerge();
+}
+
+void MagicKeyboardEngine::scheduleOverlayMerge() {
+  // Fold the overlay into the base lexicon off the event loop
+  if (shark2Engine_.overlayNeedsMerge() &&
+      !overlayMergePending_.exchange(true)) {
+    decodePool_.submit([this]() {
+      shark2Engine_.mergeOverlay();
+      overlayMergePending_ = false;
+    });
+  }
+}
+
+void MagicKeyboardEngine::loadUserWords() {
+  size_t added = 0;
+  for (const auto &word : UserDataManager::instance().getWordsWithCount(
+           learn_config::OVERLAY_MIN_COMMITS)) {
+    if (!shark2Engine_.hasWord(word) && shark2Engine_.addWord(word))
+      added++;
+  }
+  if (added > 0 && shark2Engine_.mergeOverlay()) {
+    MKLOG(Info) << "Merged " << added << " user words into the lexicon";
+  }
+}
+
+uint64_t MagicKeyboardEngine::fileStamp(const std::string &path) {
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st) != 0)
+    return 0;
+  return std::hash<std::string>{}(std::to_string(st.st_size) + "|" +
+                                  std::to_string(st.st_mtim.tv_sec) + "." +
+                                  std::to_string(st.st_mtim.tv_nsec));
+}
+
+std::unique_ptr<lexicon::Trie>
+MagicKeyboardEngine::buildTrie(const lexicon::Lexicon::Builder &words,
+                               const std::string &sourcePath) const {
+  // The compiled trie is cached in the user data dir and mmap'ed on later
+  // starts. The stamp ties it to this exact source file; word ids are
+  // lexicon ids, which only change when the file does.
+  auto trie = std::make_unique<lexicon::Trie>();
+  uint64_t stamp = 0;
+  struct stat st;
+  if (!sourcePath.empty() && stat(sourcePath.c_str(), &st) == 0) {
+    stamp = std::hash<std::string>{}(
+        sourcePath + "|" + std::to_string(st.st_size) + "|" +
+        std::to_string(st.st_mtim.tv_sec) + "." +
+        std::to_string(st.st_mtim.tv_nsec) + "|" +
+        std::to_string(words.size()));
+  }
+  std::string cachePath =
+      SettingsManager::instance().getUserDataDir() + "/lexicon.dawg";
+
+  if (stamp != 0 && trie->load(cachePath, stamp)) {
+    MKLOG(Info) << "Mapped compiled lexicon " << cachePath << " ("
+                << trie->wordCount() << " words)";
+    return trie;
+  }
+
+  trie->build(words.trieEntries());
+  MKLOG(Info) << "Built lexicon DAWG: " << trie->wordCount() << " words, "
+              << trie->stateCount() << " states, "
+              << trie->memoryBytes() / 1024 << " KiB";
+  if (stamp != 0 && !trie->save(cachePath, stamp)) {
+    MKLOG(Warn) << "Could not cache compiled lexicon at " << cachePath;
+  }
+  return trie;
+}
+
+void MagicKeyboardEngine::invalidateResultCaches() {
+  // A new state's version alone already retires every entry; clearing
+  // frees them now instead of as they age out
+  keySeqCache_.clear();
+  gestureCache_.clear();
+}
+
+std::string MagicKeyboardEngine::userTemplatesPath() const {
+  return SettingsManager::instance().getUserDataDir() + "/templates.dat";
 }
 
 void MagicKeyboardEngine::handleSettingsRequest(int clientFd) {
   sendSettingsToUI();
 }
 
+std::vector<std::string> MagicKeyboardEngine::calibrationWords() const {
+  // Most frequent words of 3+ letters: the swipes users actually make
+  auto current = state();
+  const lexicon::Lexicon &lex = *current->lexicon;
+  std::vector<uint32_t> ids;
+  for (uint32_t id = 0; id < lex.size(); ++id) {
+    if (lex.length(id) >= 3)
+      ids.push_back(id);
+  }
+  size_t n = std::min<size_t>(ids.size(), calib_config::BENCH_SWIPES);
+  std::partial_sort(ids.begin(), ids.begin() + n, ids.end(),
+                    [&lex](uint32_t a, uint32_t b) {
+                      return lex.frequency(a) > lex.frequency(b);
+                    });
+
+  std::vector<std::string> result;
+  for (size_t i = 0; i < n; ++i)
+    result.emplace_back(lex.word(ids[i]));
+  return result;
+}
+
+void MagicKeyboardEngine::updateShadowMode() {
+  bool wanted = SettingsManager::instance().get().shadowDecoder;
+  if (wanted == shadow_.running())
+    return;
+
+  if (!wanted) {
+    shadow_.stop();
+    MKLOG(Info) << "Shadow decoder stopped";
+    return;
+  }
+
+  std::string layoutPath = findDataFile("magic-keyboard/layouts/qwerty.json");
+  std::string wordsPath = findDataFile("magic-keyboard/dict/words.txt");
+  std::string freqPath = findDataFile("magic-keyboard/dict/freq.tsv");
+  if (layoutPath.empty() || wordsPath.empty()) {
+    MKLOG(Warn) << "Shadow decoder: legacy layout/dictionary not found";
+    return;
+  }
+
+  // Legacy SwipeEngine, owned by the shadow thread's closures. It loads on
+  // that thread so enabling shadow mode never stalls the event loop.
+  auto legacy = std::make_shared<swipe::SwipeEngine>();
+  ShadowDecoder decoder;
+  decoder.name = "legacy";
+  decoder.init = [legacy, layoutPath, wordsPath, freqPath]() {
+    return legacy->loadLayout(layoutPath) &&
+           legacy->loadDictionary(wordsPath, freqPath);
+  };
+  decoder.decode = [legacy](const ShadowInput &input) {
+    std::vector<swipe::Point> pts;
+    pts.reserve(input.points.size());
+    for (const auto &[x, y] : input.points) {
+      pts.push_back({x, y});
+    }
+
+    std::string keys;
+    for (const auto &k : legacy->mapPathToSequence(pts)) {
+      if (k.length() == 1 && std::isalpha(k[0])) {
+        keys += std::tolower(k[0]);
+      }
+    }
+    if (keys.empty()) {
+      keys = input.keys;
+    }
+
+    std::vector<std::string> words;
+    for (const auto &c : legacy->generateCandidates(keys)) {
+      words.push_back(c.word);
+    }
+    return words;
+  };
+
+  shadow_.start({decoder},
+                SettingsManager::instance().getUserDataDir() + "/shadow.log",
+                "ensemble");
+  MKLOG(Info) << "Shadow decoder started: legacy vs ensemble";
+}
+
 void MagicKeyboardEngine::handleSettingUpdate(const std::string &key,
                                               const std::string &value) {
   if (SettingsManager::instance().setSingle(key, value)) {
     MKLOG(Info) << "Setting updated: " << key << " = " << value;
+    if (key == "active_layout")
+      requestReload("active_layout");
+    updateShadowMode();
     sendSettingsToUI();
   } else {
     MKLOG(Warn) << "Unknown or invalid setting: " << key;
@@ -1988,35 +3264,18 @@ void MagicKeyboardEngine::handleSettingUpdate(const std::string &key,
 void MagicKeyboardEngine::sendSettingsToUI() {
   Settings s = SettingsManager::instance().get();
 
-  std::string msg = "{\"type\":\"settings\","
-                    "\"swipe_threshold_px\":" +
-                    std::to_string(s.swipeThresholdPx) +
-                    ","
-                    "\"jitter_filter\":" +
-                    std::to_string(s.jitterFilter) +
-                    ","
-                    "\"path_smoothing\":" +
-                    std::to_string(s.pathSmoothing) +
-                    ","
-                    "\"key_attraction_radius\":" +
-                    std::to_string(s.keyAttractionRadius) +
-                    ","
-                    "\"window_opacity\":" +
-                    std::to_string(s.windowOpacity) +
-                    ","
-                    "\"window_scale\":" +
-                    std::to_string(s.windowScale) +
-                    ","
-                    "\"snap_to_caret_mode\":" +
-                    std::to_string(s.snapToCaretMode) +
-                    ","
-                    "\"active_theme\":\"" +
-                    s.activeTheme +
-                    "\","
-                    "\"active_layout\":\"" +
-                    s.activeLayout + "\"}\n";
-
-  sendToUI(msg);
+  // Theme and layout names are user-settable; the writer escapes them
+  sendToUI(writer_.begin("settings")
+               .num("swipe_threshold_px", s.swipeThresholdPx)
+               .num("jitter_filter", s.jitterFilter)
+               .num("path_smoothing", s.pathSmoothing)
+               .num("key_attraction_radius", s.keyAttractionRadius)
+               .num("window_opacity", s.windowOpacity)
+               .num("window_scale", s.windowScale)
+               .num("snap_to_caret_mode", s.snapToCaretMode)
+               .str("active_theme", s.activeTheme)
+               .str("active_layout", s.activeLayout)
+               .finish());
 }
 
 void MagicKeyboardEngine::sendCaretPosition(fcitx::InputContext *ic) {
@@ -2037,30 +3296,21 @@ void MagicKeyboardEngine::sendCaretPosition(fcitx::InputContext *ic) {
                       cursorRect.left() != 0 || cursorRect.top() != 0);
 
   if (hasPosition) {
-    std::string msg = "{\"type\":\"caret_position\","
-                      "\"x\":" +
-                      std::to_string(cursorRect.left()) +
-                      ","
-                      "\"y\":" +
-                      std::to_string(cursorRect.top()) +
-                      ","
-                      "\"width\":" +
-                      std::to_string(cursorRect.width()) +
-                      ","
-                      "\"height\":" +
-                      std::to_string(cursorRect.height()) +
-                      ","
-                      "\"mode\":" +
-                      std::to_string(s.snapToCaretMode) + "}\n";
-    sendToUI(msg);
+    sendToUI(writer_.begin("caret_position")
+                 .num("x", cursorRect.left())
+                 .num("y", cursorRect.top())
+                 .num("width", cursorRect.width())
+                 .num("height", cursorRect.height())
+                 .num("mode", s.snapToCaretMode)
+                 .finish());
     MKLOG(Debug) << "Caret position: " << cursorRect.left() << ","
                  << cursorRect.top();
   } else {
     // No cursor position available - send fallback message
-    std::string msg =
-        "{\"type\":\"caret_position\",\"available\":false,\"mode\":" +
-        std::to_string(s.snapToCaretMode) + "}\n";
-    sendToUI(msg);
+    sendToUI(writer_.begin("caret_position")
+                 .boolean("available", false)
+                 .num("mode", s.snapToCaretMode)
+                 .finish());
   }
 }
 
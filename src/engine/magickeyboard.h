@@ -8,15 +8,31 @@
 #include <fcitx/inputmethodengine.h>
 #include <fcitx/instance.h>
 
+#include "binary_frames.h"
+#include "byte_ring.h"
+#include "decode_pool.h"
+#include "gesture/key_grid.h"
+#include "input_hold.h"
+#include "json_lines.h"
+#include "lexicon/BigramIndex.h"
+#include "lexicon/Lexicon.h"
 #include "lexicon/Trie.h"
+#include "outbound_queue.h"
+#include "phrase_decoder.h"
+#include "result_cache.h"
+#include "sample_ring.h"
 #include "settings.h"
+#include "shadow_eval.h"
 #include "shark2.h"
+#include "tier_calibration.h"
 #include "user_data.h"
 
 #include <atomic>
 #include <chrono>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 namespace magickeyboard {
@@ -30,6 +46,51 @@ enum class VisibilityState {
   PendingHide  // FocusOut received, waiting debounce before hiding
 };
 
+// Single-word decoder ensemble: SHARK2 and the key-sequence matcher run
+// concurrently and their lists are merged
+namespace ensemble_config {
+// Wall-clock budget before returning whatever has finished
+constexpr int BUDGET_MS = 40;
+// Share of the merged score each decoder contributes (after normalizing)
+constexpr double SHARK2_WEIGHT = 0.6;
+constexpr double KEYSEQ_WEIGHT = 0.4;
+} // namespace ensemble_config
+
+// Swipe decoding runs on its own worker, off the fcitx event loop
+namespace swipe_config {
+// How often a decode waiting on the pool checks whether a newer swipe (or
+// a key press) has made it stale
+constexpr int CANCEL_POLL_MS = 2;
+} // namespace swipe_config
+
+// Key-sequence candidate retrieval
+namespace keyseq_config {
+// Letter keys whose centers are closer than this many key pitches are
+// layout neighbours
+constexpr double ADJACENT_PITCHES = 1.5;
+// Substituting a neighbouring key costs this instead of a full edit
+constexpr float ADJACENT_SUB_COST = 0.5f;
+// Weighted edit bound for fuzzy trie retrieval
+constexpr float FUZZY_MAX_COST = 2.0f;
+// Bigram-index retrieval: best matches kept, and the fewest shared terms
+// (bigrams plus first/last anchors) a word needs to qualify
+constexpr size_t BIGRAM_TOP_K = 32;
+constexpr uint32_t BIGRAM_MIN_OVERLAP = 2;
+} // namespace keyseq_config
+
+// Hot reload of layout, dictionary and learning data
+namespace reload_config {
+// How often the loaded layout and dictionary files are checked for edits
+constexpr int WATCH_MS = 2000;
+} // namespace reload_config
+
+// Tap-typing word completion
+namespace completion_config {
+// Completions shown, and letters typed before any are offered
+constexpr size_t COUNT = 5;
+constexpr size_t MIN_PREFIX = 2;
+} // namespace completion_config
+
 class MagicKeyboardEngine : public fcitx::InputMethodEngineV2 {
 public:
   explicit MagicKeyboardEngine(fcitx::Instance *instance);
@@ -60,8 +121,34 @@ private:
   void executeHide();
 
   void sendToUI(const std::string &msg);
+  // Keys and shortcut actions wait in inputHold_ while a swipe decodes
   void handleKeyPress(const std::string &key);
-  void processLine(const std::string &line, int clientFd);
+  void applyKeyPress(const std::string &key);
+  // Parse one message and dispatch it on its "type"
+  void processLine(std::string_view line, int clientFd);
+  ipc::MessageReader message_;              // Reused for every line
+  ipc::MessageWriter writer_;               // Reused for outgoing lines
+  std::vector<ipc::PathSample> pathSamples_; // Reused swipe_path buffer
+
+  // Message handlers (processLine's dispatch table)
+  void handleKeyMessage(const ipc::MessageReader &msg, int clientFd);
+  void handleCommitCandidate(const ipc::MessageReader &msg, int clientFd);
+  void handleSettingsMessage(const ipc::MessageReader &msg, int clientFd);
+  void handleStatus(const ipc::MessageReader &msg, int clientFd);
+  void handleShadowSummary(const ipc::MessageReader &msg, int clientFd);
+  void handleSettingUpdateMessage(const ipc::MessageReader &msg,
+                                  int clientFd);
+  void handleActionMessage(const ipc::MessageReader &msg, int clientFd);
+  void handleUiIntent(const ipc::MessageReader &msg, int clientFd);
+  void handleUiVisibility(const ipc::MessageReader &msg, int clientFd);
+  void handleSwipePath(const ipc::MessageReader &msg, int clientFd);
+  void handleFrame(std::string_view frame, int clientFd); // Binary frame
+  ipc::frame::Swipe swipeFrame_; // Reused swipe frame buffer
+  // Queue the swipe in pathSamples_ for the swipe worker
+  void recognizeSwipe(long long seq_num, std::string keysString);
+  void handleHello(const ipc::MessageReader &msg, int clientFd);
+  void handleCommitText(const ipc::MessageReader &msg, int clientFd);
+
   void startSocketServer();
   void stopSocketServer();
   void launchUI();
@@ -79,6 +166,24 @@ private:
   void handleSettingUpdate(const std::string &key, const std::string &value);
   void sendSettingsToUI();
   void recordWordCommit(const std::string &word);
+  // False for fields whose text must not be learned: passwords, sensitive
+  // input, and fields that opt out of spell checking
+  bool learningAllowed(fcitx::InputContext *ic) const;
+  // Tapped letters accumulate into typedWord_; a break key commits it
+  void trackTypedKey(const std::string &key, fcitx::InputContext *ic);
+  // Drop the partly typed word (focus change, shortcut, paste)
+  void clearTypedWord();
+  // Offer the most frequent completions of typedWord_ in the candidate bar
+  void updateCompletions();
+  // Make a repeatedly committed out-of-dictionary word swipeable
+  void learnUserWord(const std::string &word);
+  void loadUserWords();
+  // magickeyboardctl forget: drop a word's learning data and stop
+  // proposing it
+  void handleForgetWord(const ipc::MessageReader &msg, int clientFd);
+  // Fold overlay adds and removals into the base lexicon on the decode
+  // pool once enough have piled up
+  void scheduleOverlayMerge();
 
   // === Snap-to-caret positioning ===
   void sendCaretPosition(fcitx::InputContext *ic);
@@ -117,11 +222,60 @@ private:
   // Socket event sources
   std::unique_ptr<fcitx::EventSource> serverEvent_;
   struct Client {
-    std::unique_ptr<fcitx::EventSource> event;
-    std::string buffer;
+    std::unique_ptr<fcitx::EventSourceIO> event;
+    OutboundQueue out;
+    bool waitingWritable = false; // Out added to event's flags
+    ByteRing input;
+    size_t scanned = 0;    // Leading input bytes known to hold no newline
+    size_t skipBytes = 0;  // Rest of an oversized frame to discard
+    bool skipLine = false; // Discarding an oversized line up to its '\n'
     std::string role;
+    bool frames = false; // Negotiated binary frames (binary_frames.h)
   };
   std::unordered_map<int, std::unique_ptr<Client>> clients_;
+  // Hand complete lines and frames in client's input to their handlers,
+  // skipping any over input_config::MAX_MESSAGE_BYTES
+  void drainClientInput(Client &client, int clientFd);
+
+  // Outgoing messages are queued per client and flushed once per event
+  // loop dispatch (outbound_queue.h). sendToUI() skips control clients.
+  void sendToClient(int clientFd, const std::string &msg);
+  void queueMessage(int fd, Client &client, const std::string &msg);
+  void flushClient(int fd, Client &client);
+  std::unique_ptr<fcitx::EventSource> flushEvent_;
+  bool flushScheduled_ = false;
+
+  // Priority lane (protocol.h): a SOCK_SEQPACKET socket carrying only key
+  // and action messages, read before every message on the stream sockets.
+  // What it carries is held (inputHold_) behind stream messages that were
+  // already buffered.
+  void startPriorityLane();
+  void stopPriorityLane();
+  // Handle whatever the lane clients have queued
+  void servicePriorityLane();
+  // Drain one lane client; false once it has closed
+  bool readPriorityClient(int fd);
+  void handlePriorityMessage(std::string_view msg, int fd);
+  int priorityFd_ = -1;
+  std::unique_ptr<fcitx::EventSource> priorityEvent_;
+  std::unordered_map<int, std::unique_ptr<fcitx::EventSourceIO>>
+      priorityClients_;
+  unsigned long long priorityMessages_ = 0;
+
+  // Swipe samples streamed through shared memory (sample_ring.h). The UI
+  // attaches the ring over its priority lane; it is detached with it.
+  void attachSampleRing(int memfd, int wakeFd, int laneFd);
+  void detachSampleRing();
+  // Detach and tell the UI to send paths again (sample_ring version 0)
+  void dropSampleRing();
+  // Move newly published samples into ringPath_, then wait for more
+  void drainSampleRing();
+  void handleSwipeRing(const ipc::MessageReader &msg, int clientFd);
+  ipc::SampleRingReader sampleRing_;
+  std::unique_ptr<fcitx::EventSourceIO> sampleRingEvent_;
+  int sampleRingLane_ = -1;
+  uint32_t ringStroke_ = 0;               // Stroke ringPath_ belongs to
+  std::vector<ipc::PathSample> ringPath_; // Samples of the stroke so far
 
   int serverFd_ = -1;
 
@@ -151,22 +305,59 @@ private:
     Rect r;
     Point center;
   };
-  std::vector<Key> keys_;
 
   // v0.2.3 Dictionary engine
-  struct DictWord {
-    std::string word;
-    uint32_t freq;
-    char first, last;
-    int len;
-  };
   struct Candidate {
     std::string word;
     double score;
   };
-  std::vector<DictWord> dictionary_;
-  std::unique_ptr<lexicon::Trie> trie_;
-  std::vector<int> buckets_[26][26];
+
+  // Everything the decoders read that a reload replaces: key geometry,
+  // the lexicon and the indexes over them. Built whole off the event loop
+  // and published by swapping state_ (RCU style): a decode keeps the
+  // snapshot it started with, and the old one is freed once the last
+  // such decode drops it. Never modified after publication.
+  struct EngineState {
+    uint64_t version = 0; // Prefix of result-cache keys
+    std::string layoutPath;
+    uint64_t layoutStamp = 0; // fileStamp() when loaded
+    std::vector<Key> keys;
+    gesture::KeyGrid keyGrid; // Hit-test index over keys
+    // Letter adjacency derived from the layout, and the fuzzy-retrieval
+    // edit costs built from it
+    bool keyAdjacent[26][26] = {};
+    lexicon::EditCosts editCosts;
+    std::string dictionaryPath; // Empty for the built-in fallback
+    uint64_t dictionaryStamp = 0;
+    // Words, frequencies, first/last buckets and trie, shared with SHARK2
+    std::shared_ptr<const lexicon::Lexicon> lexicon;
+    std::shared_ptr<const lexicon::BigramIndex> bigramIndex; // Lexicon ids
+  };
+  std::atomic<std::shared_ptr<const EngineState>> state_;
+  std::shared_ptr<const EngineState> state() const {
+    return state_.load(std::memory_order_acquire);
+  }
+  // Parse a layout into next; false (next untouched) if it is missing
+  bool loadLayout(EngineState &next, const std::string &layoutName) const;
+  // Load the dictionary, or the built-in fallback, into next
+  void loadDictionary(EngineState &next) const;
+  std::string findDictionary() const;
+  // Build the trie for words, or map the cached copy compiled from
+  // sourcePath
+  std::unique_ptr<lexicon::Trie>
+  buildTrie(const lexicon::Lexicon::Builder &words,
+            const std::string &sourcePath) const;
+  // Size and mtime of a file folded into one value; 0 if it is missing
+  static uint64_t fileStamp(const std::string &path);
+
+  // Recent decode results. Keys carry the state's version (a new one for
+  // every published state) so stale entries are never matched.
+  std::atomic<uint64_t> layoutVersion_{0}; // Last version handed out
+  mutable ResultCache<std::vector<Candidate>> keySeqCache_{
+      cache_config::KEYSEQ_ENTRIES};
+  ResultCache<std::vector<Candidate>> gestureCache_{
+      cache_config::GESTURE_ENTRIES};
+  void invalidateResultCaches();
 
   std::vector<Candidate> currentCandidates_;
   bool candidateMode_ = false;
@@ -175,19 +366,143 @@ private:
   // SHARK2 engine for gesture recognition
   shark2::Shark2Engine shark2Engine_;
   bool useShark2_ = true; // Enable SHARK2 algorithm
+  // Set while a queued merge task is pending; the task clears it
+  std::atomic<bool> overlayMergePending_{false};
+
+  // Workers for parallel decoding. Declared after the engines and flags
+  // they use so queued tasks are drained before those are destroyed.
+  DecodePool decodePool_;
+
+  // Multi-word phrase swipe (splits at space-key passes and pauses)
+  PhraseDecoder phraseDecoder_{shark2Engine_, decodePool_};
+
+  // Picks the SHARK2 quality tier for this CPU (background benchmark plus
+  // live latency drift)
+  TierCalibrator calibrator_{shark2Engine_, decodePool_};
+  std::vector<std::string> calibrationWords() const;
+
+  // Shadow-mode decoder trials (settings: shadow_decoder)
+  ShadowEvaluator shadow_;
+  void updateShadowMode();
+
+  // Swipe worker. recognizeSwipe() hands a request over through a
+  // lock-free mailbox and returns; the worker decodes it and posts the
+  // result back through another mailbox, waking the event loop with an
+  // eventfd. swipeGeneration_ is bumped by every new swipe and by
+  // anything that makes pending candidates stale (commit, reset); a
+  // request or result from an older generation is dropped, and a decode
+  // in progress gives up at its next check. Keys tapped meanwhile are
+  // held until the result is applied (input_hold.h).
+  struct SwipeRequest {
+    long long seq = 0;
+    uint64_t generation = 0;
+    std::vector<ipc::PathSample> samples;
+    std::string keys;    // From ui_keys; empty to map the path
+    std::string context; // lastCommittedWord_ when sent
+    bool useShark2 = true;
+  };
+  struct SwipeResult {
+    long long seq = 0;
+    uint64_t generation = 0;
+    std::vector<Candidate> candidates;
+    std::string keys;
+    std::vector<shark2::Point> shark2Path; // Becomes lastSwipePath_
+    long long shark2Us = -1;               // For the calibrator; -1 if late
+  };
+  std::atomic<uint64_t> swipeGeneration_{0};
+  Mailbox<SwipeRequest> swipeRequests_;
+  Mailbox<SwipeResult> swipeResults_;
+  int swipeEventFd_ = -1;
+  std::unique_ptr<fcitx::EventSource> swipeResultEvent_;
+  std::thread swipeWorker_;
+  unsigned long long swipeDecoded_ = 0;           // Event loop only
+  std::atomic<unsigned long long> swipeDropped_{0}; // Superseded or stale
+  void startSwipeWorker();
+  void stopSwipeWorker();
+  void cancelPendingSwipe();
+  void swipeWorkerLoop();
+  bool swipeSuperseded(const SwipeRequest &request) const;
+  // Swipe worker only: waits up to ensemble_config::BUDGET_MS for the
+  // decode pool. The event loop never waits; it gets the result from
+  // swipeResults_ when the eventfd fires.
+  std::unique_ptr<SwipeResult> decodeSwipe(const SwipeRequest &request);
+  void applySwipeResult(); // Event loop side
+  std::thread::id eventLoopThread_; // Set before the worker starts
+  InputHold inputHold_;
+  // Fires at inputHold_.deadline() to apply the InputHold cap
+  std::unique_ptr<fcitx::EventSourceTime> holdTimer_;
+  bool holdInput(InputHold::Input input); // True if queued
+  void releaseHeldInput();
+  void applyHeldInput(const InputHold::Input &input);
+  // Stream input not yet handled: buffered in a client's ring or unread
+  // on its socket
+  bool streamBacklog() const;
+  bool laneInput_ = false; // Dispatching a priority lane message
 
   // Learning context
   std::string lastCommittedWord_;
-
-  void loadLayout(const std::string &layoutName);
-  void loadDictionary();
-  std::vector<std::string> mapPathToSequence(const std::vector<Point> &path);
-  std::vector<int> getShortlist(const std::string &keys);
-  std::vector<Candidate> generateCandidates(const std::string &keys,
-                                            size_t pointsCount);
-
-  int levenshtein(const std::string &s1, const std::string &s2, int limit);
-  double scoreCandidate(const std::string &keys, const DictWord &dw);
+  std::string typedWord_;
+  // Context typedWord_ was typed into; compared only, never dereferenced
+  const fcitx::InputContext *typedWordIC_ = nullptr;
+  std::string completionPrefix_; // typedWord_ the shown completions extend
+
+  // Path of the last single-word swipe, learned as a personal template
+  // when one of its candidates is committed
+  std::vector<shark2::Point> lastSwipePath_;
+  int templatesSinceSave_ = 0;
+  std::string userTemplatesPath() const;
+
+  // Hot reload. requestReload() hands a request to the reload worker
+  // (through a mailbox, so a burst of requests collapses into one), which
+  // builds the next EngineState, re-reading only the files that changed,
+  // retemplates SHARK2 if the key centers or lexicon changed, and
+  // publishes it. Typing and swiping carry on against the old state
+  // meanwhile. Triggered by an active_layout change, by reloadWatch_
+  // seeing a loaded file change, and by the "reload" control message.
+  struct ReloadRequest {
+    std::string reason;    // For the log
+    bool userData = false; // Also re-read the learning data
+  };
+  void requestReload(std::string reason, bool userData = false);
+  void startReloadWorker();
+  void stopReloadWorker();
+  void reloadWorkerLoop();
+  // Build and publish the next state on the calling thread
+  void reload(const ReloadRequest &request);
+  // Startup load, the reload worker's first job: learning data, the
+  // first EngineState, SHARK2 templates. The constructor returns before
+  // it finishes; until ready_ is set there is no state(), taps commit
+  // without completions and swipes wait on the swipe worker.
+  void warmUp();
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+  std::atomic<bool> ready_{false};
+  void handleReload(const ipc::MessageReader &msg, int clientFd);
+  Mailbox<ReloadRequest> reloadRequests_;
+  std::thread reloadWorker_;
+  std::unique_ptr<fcitx::EventSource> reloadWatch_;
+  std::atomic<unsigned long long> reloads_{0}; // States published
+
+  // Key-sequence decoder. Const, with context and state passed in: these
+  // run on decode workers alongside SHARK2.
+  std::vector<std::string>
+  mapPathToSequence(const EngineState &state,
+                    const std::vector<Point> &path) const;
+  std::vector<uint32_t> getShortlist(const EngineState &state,
+                                     const std::string &keys) const;
+  std::vector<Candidate>
+  generateCandidates(const EngineState &state, const std::string &keys,
+                     const std::string &previousWord) const;
+
+  int levenshtein(std::string_view s1, std::string_view s2, int limit) const;
+  // Context-free part of a candidate's score; generateCandidates adds the
+  // learning boost so cached scores stay valid as the user types
+  double scoreCandidate(const std::string &keys, std::string_view word,
+                        uint32_t freq) const;
+
+  // Calibrated merge of SHARK2 and key-sequence results
+  static std::vector<Candidate>
+  mergeEnsemble(const std::vector<Candidate> &shark2,
+                const std::vector<Candidate> &keySeq);
 
   std::vector<std::string> dataDirs() const;
   std::string findDataFile(const std::string &relPath) const;
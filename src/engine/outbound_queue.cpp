@@ -0,0 +1,88 @@
+/**
+ * Magic Keyboard - Outbound Message Queue Implementation
+ */
+
+#include "outbound_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace magickeyboard {
+
+size_t OutboundQueue::push(std::string msg, std::string_view coalesceKey) {
+  if (msg.empty())
+    return 0;
+
+  if (!coalesceKey.empty()) {
+    for (size_t i = firstMovable(); i < queue_.size(); ++i) {
+      if (queue_[i].key == coalesceKey) {
+        bytes_ -= queue_[i].data.size();
+        queue_.erase(queue_.begin() + i);
+        coalesced_++;
+        break; // At most one per key is ever queued
+      }
+    }
+  }
+
+  bytes_ += msg.size();
+  queue_.push_back({std::move(msg), std::string(coalesceKey)});
+
+  size_t dropped = 0;
+  while (bytes_ > outbound_config::MAX_QUEUED_BYTES &&
+         queue_.size() > firstMovable() + 1) {
+    auto victim = queue_.begin() + firstMovable();
+    bytes_ -= victim->data.size();
+    queue_.erase(victim);
+    dropped++;
+  }
+  return dropped;
+}
+
+OutboundQueue::FlushStatus OutboundQueue::flush(int fd) {
+  while (!queue_.empty()) {
+    iovec iov[outbound_config::MAX_IOV];
+    size_t count = std::min(queue_.size(), outbound_config::MAX_IOV);
+    for (size_t i = 0; i < count; ++i) {
+      size_t skip = i == 0 ? sentOffset_ : 0;
+      iov[i].iov_base = queue_[i].data.data() + skip;
+      iov[i].iov_len = queue_[i].data.size() - skip;
+    }
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return FlushStatus::Blocked;
+      return FlushStatus::Error;
+    }
+
+    // Retire fully sent messages; a partial one keeps its offset
+    size_t sent = static_cast<size_t>(n);
+    bytes_ -= sent;
+    while (sent > 0) {
+      size_t left = queue_.front().data.size() - sentOffset_;
+      if (sent < left) {
+        sentOffset_ += sent;
+        break;
+      }
+      sent -= left;
+      sentOffset_ = 0;
+      queue_.pop_front();
+    }
+  }
+  return FlushStatus::Done;
+}
+
+void OutboundQueue::clear() {
+  queue_.clear();
+  sentOffset_ = 0;
+  bytes_ = 0;
+}
+
+} // namespace magickeyboard
@@ -0,0 +1,80 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Outbound Message Queue
+ *
+ * Per-client send queue for the IPC socket. Messages are queued as they
+ * are produced and flushed together with one gathering sendmsg (writev
+ * plus MSG_NOSIGNAL), so the two or three messages a swipe or keypress
+ * produces cost one syscall. A short write keeps the unsent tail; when
+ * the socket would block the caller waits for it to become writable
+ * instead of dropping or truncating anything.
+ *
+ * Messages that only carry the latest state (the candidate list, the
+ * caret position) are pushed with a coalescing key: a newer one replaces
+ * a queued one with the same key that has not started sending yet. A UI
+ * that falls behind therefore catches up on the newest state instead of
+ * replaying every stale one.
+ */
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+
+namespace magickeyboard {
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+namespace outbound_config {
+// Messages gathered into one sendmsg
+constexpr size_t MAX_IOV = 64;
+// Bytes queued per client before the oldest messages are dropped (a UI
+// that stopped reading)
+constexpr size_t MAX_QUEUED_BYTES = 1024 * 1024;
+} // namespace outbound_config
+
+// ============================================================================
+// Outbound Queue
+// ============================================================================
+
+class OutboundQueue {
+public:
+  enum class FlushStatus {
+    Done,    // Everything sent
+    Blocked, // Socket full; flush again once it is writable
+    Error,   // errno says why; the queue is left as it was
+  };
+
+  // Queue msg. A non-empty coalesceKey replaces any queued message with
+  // the same key that has not started sending. Returns how many old
+  // messages were dropped to stay under MAX_QUEUED_BYTES.
+  size_t push(std::string msg, std::string_view coalesceKey = {});
+
+  // Send as much as the socket takes
+  FlushStatus flush(int fd);
+
+  void clear();
+  bool empty() const { return queue_.empty(); }
+  size_t bytes() const { return bytes_; }
+  unsigned long long coalesced() const { return coalesced_; }
+
+private:
+  struct Message {
+    std::string data;
+    std::string key;
+  };
+
+  // First message that may still be replaced or dropped: not the front
+  // one once part of it is on the wire
+  size_t firstMovable() const { return sentOffset_ > 0 ? 1 : 0; }
+
+  std::deque<Message> queue_;
+  size_t sentOffset_ = 0; // Bytes of the front message already sent
+  size_t bytes_ = 0;      // Unsent bytes
+  unsigned long long coalesced_ = 0;
+};
+
+} // namespace magickeyboard
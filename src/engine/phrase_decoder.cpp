@@ -0,0 +1,338 @@
+/**
+ * Magic Keyboard - Multi-Word Phrase Swipe Implementation
+ */
+
+#include "phrase_decoder.h"
+#include "decode_pool.h"
+#include "user_data.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <unordered_set>
+
+namespace magickeyboard {
+
+PhraseDecoder::PhraseDecoder(shark2::Shark2Engine &engine, DecodePool &pool)
+    : engine_(engine), pool_(pool) {}
+
+void PhraseDecoder::setSpaceKey(double x, double y, double w, double h) {
+  if (w > 0 && h > 0)
+    spaceKey_.store(std::make_shared<const SpaceKey>(SpaceKey{x, y, w, h}));
+  else
+    clearSpaceKey();
+}
+
+bool PhraseDecoder::inSpaceKey(const SpaceKey &key, const Sample &s) {
+  return s.x >= key.x && s.x <= key.x + key.w && s.y >= key.y &&
+         s.y <= key.y + key.h;
+}
+
+// ============================================================================
+// Segmentation
+// ============================================================================
+
+std::vector<PhraseDecoder::Piece>
+PhraseDecoder::split(const SpaceKey &key,
+                     const std::vector<Sample> &path) const {
+  std::vector<Piece> raw;
+  Piece cur;
+  bool open = false;
+
+  for (size_t i = 0; i < path.size(); ++i) {
+    const auto &s = path[i];
+
+    // Space key pass: close the current piece, mark a hard break
+    if (inSpaceKey(key, s)) {
+      if (open) {
+        cur.end = i;
+        raw.push_back(cur);
+        open = false;
+      }
+      if (!raw.empty())
+        raw.back().hardBreakAfter = true;
+      continue;
+    }
+
+    // Timing pause inside a letter run: soft break
+    if (open && s.t >= 0 && path[i - 1].t >= 0 &&
+        s.t - path[i - 1].t > phrase_config::PAUSE_GAP_MS) {
+      cur.end = i;
+      raw.push_back(cur);
+      open = false;
+    }
+
+    if (!open) {
+      cur = Piece{i, i, false};
+      open = true;
+    }
+  }
+  if (open) {
+    cur.end = path.size();
+    raw.push_back(cur);
+  }
+
+  // Drop noise pieces, keeping any hard break they carried
+  std::vector<Piece> pieces;
+  for (const auto &p : raw) {
+    if (p.end - p.begin < phrase_config::MIN_PIECE_POINTS) {
+      if (p.hardBreakAfter && !pieces.empty())
+        pieces.back().hardBreakAfter = true;
+      continue;
+    }
+    pieces.push_back(p);
+  }
+  if (!pieces.empty())
+    pieces.back().hardBreakAfter = false;
+
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    auto &p = pieces[i];
+    p.trimBegin = p.begin;
+    p.trimEnd = p.end;
+    if (i > 0 && pieces[i - 1].hardBreakAfter)
+      p.trimBegin = transitFromBegin(path, p.begin, p.end);
+    if (p.hardBreakAfter)
+      p.trimEnd = transitFromEnd(path, p.trimBegin, p.end);
+  }
+
+  return pieces;
+}
+
+namespace {
+
+// Angle between two step vectors in degrees (0 = same direction)
+double turnDegrees(double ax, double ay, double bx, double by) {
+  double la = std::sqrt(ax * ax + ay * ay);
+  double lb = std::sqrt(bx * bx + by * by);
+  if (la < 1e-9 || lb < 1e-9)
+    return 0.0;
+  double c = std::clamp((ax * bx + ay * by) / (la * lb), -1.0, 1.0);
+  return std::acos(c) * 180.0 / M_PI;
+}
+
+} // namespace
+
+size_t PhraseDecoder::transitFromEnd(const std::vector<Sample> &path,
+                                     size_t begin, size_t end) {
+  if (end - begin <= phrase_config::MIN_PIECE_POINTS)
+    return end;
+
+  // Reference direction: the final step into the space bar
+  const auto &a = path[end - 2];
+  const auto &b = path[end - 1];
+  double rx = b.x - a.x, ry = b.y - a.y;
+
+  size_t i = end - 1;
+  while (i > begin + phrase_config::MIN_PIECE_POINTS - 1) {
+    double sx = path[i].x - path[i - 1].x;
+    double sy = path[i].y - path[i - 1].y;
+    if (turnDegrees(rx, ry, sx, sy) > phrase_config::TRANSIT_CORNER_DEG)
+      break;
+    --i;
+  }
+  // Keep the corner sample: it sits on the word's last key
+  return i + 1;
+}
+
+size_t PhraseDecoder::transitFromBegin(const std::vector<Sample> &path,
+                                       size_t begin, size_t end) {
+  if (end - begin <= phrase_config::MIN_PIECE_POINTS)
+    return begin;
+
+  const auto &a = path[begin];
+  const auto &b = path[begin + 1];
+  double rx = b.x - a.x, ry = b.y - a.y;
+
+  size_t i = begin;
+  while (i + phrase_config::MIN_PIECE_POINTS < end) {
+    double sx = path[i + 1].x - path[i].x;
+    double sy = path[i + 1].y - path[i].y;
+    if (turnDegrees(rx, ry, sx, sy) > phrase_config::TRANSIT_CORNER_DEG)
+      break;
+    ++i;
+  }
+  return i;
+}
+
+bool PhraseDecoder::isPhrase(const std::vector<Sample> &path) const {
+  auto key = spaceKey_.load();
+  if (!key || path.size() < 2 * phrase_config::MIN_PIECE_POINTS)
+    return false;
+
+  auto pieces = split(*key, path);
+  if (pieces.size() < 2)
+    return false;
+
+  for (const auto &p : pieces) {
+    if (p.hardBreakAfter)
+      return true;
+  }
+  return false;
+}
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+std::vector<PhraseCandidate>
+PhraseDecoder::decode(const std::vector<Sample> &path,
+                      const std::string &previousWord, int maxCandidates,
+                      PhraseCancel cancel) {
+  using Clock = std::chrono::steady_clock;
+  auto deadline =
+      Clock::now() + std::chrono::milliseconds(phrase_config::LATENCY_BUDGET_MS);
+
+  auto key = spaceKey_.load();
+  if (!key)
+    return {};
+  auto pieces = split(*key, path);
+  const size_t n = pieces.size();
+  if (n < 2 || n > phrase_config::MAX_PIECES)
+    return {};
+
+  // Enumerate word hypotheses: runs of pieces not crossing a hard break,
+  // each as drawn and (if different) with the space-bar transit trimmed
+  struct Span {
+    size_t first;  // First piece
+    size_t last;   // One past last piece
+    size_t begin;  // First sample
+    size_t end;    // One past last sample
+    size_t points; // Untrimmed sample count, used for weighting
+  };
+  std::vector<Span> spans;
+  size_t totalPoints = 0;
+  for (size_t a = 0; a < n; ++a) {
+    totalPoints += pieces[a].end - pieces[a].begin;
+    size_t points = 0;
+    for (size_t b = a + 1;
+         b <= n && b - a <= phrase_config::MAX_PIECES_PER_WORD; ++b) {
+      points += pieces[b - 1].end - pieces[b - 1].begin;
+      spans.push_back({a, b, pieces[a].begin, pieces[b - 1].end, points});
+      if (pieces[a].trimBegin != pieces[a].begin ||
+          pieces[b - 1].trimEnd != pieces[b - 1].end) {
+        spans.push_back(
+            {a, b, pieces[a].trimBegin, pieces[b - 1].trimEnd, points});
+      }
+      if (pieces[b - 1].hardBreakAfter)
+        break;
+    }
+  }
+
+  // Shared with the workers so a span finishing after the deadline writes
+  // into memory that is still alive
+  struct Slot {
+    std::vector<shark2::Candidate> results;
+    std::atomic<bool> ready{false};
+  };
+  struct Batch {
+    explicit Batch(size_t n) : slots(n) {}
+    std::vector<Slot> slots;
+    TaskGroup group;
+    std::atomic<bool> abandoned{false}; // decode() stopped waiting
+  };
+  auto batch = std::make_shared<Batch>(spans.size());
+  batch->group.add(spans.size());
+
+  for (size_t i = 0; i < spans.size(); ++i) {
+    const auto &span = spans[i];
+    std::vector<shark2::Point> pts;
+    pts.reserve(span.end - span.begin);
+    for (size_t k = span.begin; k < span.end; ++k)
+      pts.emplace_back(path[k].x, path[k].y);
+
+    auto &engine = engine_;
+    pool_.submit([batch, i, &engine, deadline, pts = std::move(pts)]() {
+      // A span still queued when the phrase is out of time or abandoned
+      // would only delay the next stroke's spans
+      if (!batch->abandoned.load(std::memory_order_acquire) &&
+          Clock::now() < deadline) {
+        auto &slot = batch->slots[i];
+        slot.results = engine
+                           .recognizeWithDeadline(
+                               pts, deadline, phrase_config::SPAN_CANDIDATES)
+                           .candidates;
+        slot.ready.store(true, std::memory_order_release);
+      }
+      batch->group.done();
+    });
+  }
+
+  // Wake now and then so a superseded stroke stops waiting early; the
+  // span tasks only see the batch, never the caller's cancel
+  const auto poll = std::chrono::milliseconds(phrase_config::CANCEL_POLL_MS);
+  while (!batch->group.waitUntil(std::min(deadline, Clock::now() + poll)) &&
+         Clock::now() < deadline && !cancel.requested()) {
+  }
+  batch->abandoned.store(true, std::memory_order_release);
+  if (cancel.requested())
+    return {};
+
+  // DP over piece boundaries. best[k] holds the top partial phrases that
+  // cover pieces [0, k). Each word's score is weighted by the share of the
+  // stroke it covers so segmentations with different word counts compare.
+  struct Hyp {
+    std::vector<std::string> words;
+    double score = 0;
+  };
+  std::vector<std::vector<Hyp>> best(n + 1);
+  best[0].push_back({});
+
+  auto &learning = UserDataManager::instance();
+  size_t spanIdx = 0;
+  for (size_t a = 0; a < n; ++a) {
+    auto &from = best[a];
+    std::sort(from.begin(), from.end(),
+              [](const Hyp &x, const Hyp &y) { return x.score > y.score; });
+    if (from.size() > phrase_config::BEAM_WIDTH)
+      from.resize(phrase_config::BEAM_WIDTH);
+
+    for (; spanIdx < spans.size() && spans[spanIdx].first == a; ++spanIdx) {
+      const auto &span = spans[spanIdx];
+      const auto &slot = batch->slots[spanIdx];
+      if (from.empty() || !slot.ready.load(std::memory_order_acquire))
+        continue;
+
+      double weight =
+          static_cast<double>(span.points) / static_cast<double>(totalPoints);
+      for (const auto &cand : slot.results) {
+        for (const auto &hyp : from) {
+          const std::string &prev =
+              hyp.words.empty() ? previousWord : hyp.words.back();
+          Hyp next;
+          next.words = hyp.words;
+          next.words.push_back(cand.word);
+          next.score = hyp.score + weight * cand.score +
+                       phrase_config::BIGRAM_WEIGHT *
+                           learning.getBigramBoost(cand.word, prev);
+          best[span.last].push_back(std::move(next));
+        }
+      }
+    }
+  }
+
+  auto &done = best[n];
+  std::sort(done.begin(), done.end(),
+            [](const Hyp &x, const Hyp &y) { return x.score > y.score; });
+
+  std::vector<PhraseCandidate> results;
+  std::unordered_set<std::string> seen;
+  for (const auto &hyp : done) {
+    std::string text;
+    for (const auto &w : hyp.words) {
+      if (!text.empty())
+        text += ' ';
+      text += w;
+    }
+    if (!seen.insert(text).second)
+      continue;
+    results.push_back({text, hyp.score});
+    if (results.size() >= static_cast<size_t>(maxCandidates))
+      break;
+  }
+
+  return results;
+}
+
+} // namespace magickeyboard
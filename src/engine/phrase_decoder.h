@@ -0,0 +1,138 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Multi-Word Phrase Swipe
+ *
+ * Decodes a single stroke that spells several words. The path is cut into
+ * pieces at space-key passes (hard breaks) and at timing pauses (soft
+ * breaks). Every run of up to MAX_PIECES_PER_WORD pieces that does not
+ * cross a hard break is a word hypothesis, decoded both as drawn and with
+ * the straight transit to/from the space bar trimmed off. All hypotheses
+ * are decoded by SHARK2 in parallel and a DP over piece boundaries picks
+ * the best segmentation, combining per-word scores with user bigram
+ * context.
+ *
+ * The whole decode is bounded by LATENCY_BUDGET_MS. Each span decodes
+ * with the phrase deadline, so a late one returns its best so far; spans
+ * still queued once the deadline passes, or once the caller abandons the
+ * stroke, are skipped and simply absent from the DP.
+ */
+
+#include "shark2.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace magickeyboard {
+
+class DecodePool;
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+namespace phrase_config {
+// Gap between consecutive samples (ms) treated as a deliberate pause
+constexpr double PAUSE_GAP_MS = 160.0;
+// Pieces with fewer samples are noise (e.g. clipping a key on the way to
+// the space bar) and are dropped
+constexpr size_t MIN_PIECE_POINTS = 3;
+// Direction change (degrees) that ends the straight transit between a word
+// and the space bar
+constexpr double TRANSIT_CORNER_DEG = 25.0;
+// Soft-break pieces a single word hypothesis may span
+constexpr size_t MAX_PIECES_PER_WORD = 3;
+// Upper bound on pieces considered; longer strokes are not phrase-decoded
+constexpr size_t MAX_PIECES = 16;
+// SHARK2 candidates kept per span
+constexpr int SPAN_CANDIDATES = 4;
+// Partial phrases kept per DP boundary
+constexpr size_t BEAM_WIDTH = 6;
+// Weight of the user bigram boost between adjacent words
+constexpr double BIGRAM_WEIGHT = 0.15;
+// Wall-clock budget for the whole phrase (span decode + DP)
+constexpr int LATENCY_BUDGET_MS = 60;
+// How often a waiting decode checks whether it was cancelled
+constexpr int CANCEL_POLL_MS = 5;
+} // namespace phrase_config
+
+// ============================================================================
+// Phrase Decoder
+// ============================================================================
+
+// Cancels a decode once *generation moves off expected (a newer swipe)
+struct PhraseCancel {
+  const std::atomic<uint64_t> *generation = nullptr;
+  uint64_t expected = 0;
+
+  bool requested() const {
+    return generation &&
+           generation->load(std::memory_order_acquire) != expected;
+  }
+};
+
+struct PhraseCandidate {
+  std::string text; // Words joined with single spaces
+  double score = 0;
+};
+
+class PhraseDecoder {
+public:
+  struct Sample {
+    double x = 0;
+    double y = 0;
+    double t = -1; // ms since stroke start; negative when not provided
+  };
+
+  PhraseDecoder(shark2::Shark2Engine &engine, DecodePool &pool);
+
+  // Space key rect in layout space; phrase mode stays off until set. May
+  // be changed while decodes run: each uses the rect it started with.
+  void setSpaceKey(double x, double y, double w, double h);
+  void clearSpaceKey() { spaceKey_.store(nullptr); }
+
+  // True if the stroke crosses the space key between two letter runs
+  bool isPhrase(const std::vector<Sample> &path) const;
+
+  // Decode the stroke into ranked phrases. previousWord seeds the bigram
+  // context for the first word. Returns empty if no full segmentation was
+  // decoded within the budget, or if cancel was requested.
+  std::vector<PhraseCandidate> decode(const std::vector<Sample> &path,
+                                      const std::string &previousWord,
+                                      int maxCandidates,
+                                      PhraseCancel cancel = {});
+
+private:
+  struct Piece {
+    size_t begin = 0; // First sample index
+    size_t end = 0;   // One past last sample index
+    bool hardBreakAfter = false;
+    // Bounds with the straight transit to/from the space bar removed
+    size_t trimBegin = 0;
+    size_t trimEnd = 0;
+  };
+
+  struct SpaceKey {
+    double x = 0, y = 0, w = 0, h = 0;
+  };
+
+  static bool inSpaceKey(const SpaceKey &key, const Sample &s);
+  std::vector<Piece> split(const SpaceKey &key,
+                           const std::vector<Sample> &path) const;
+  // First sample of the straight run that ends at `end` (walking back),
+  // or the last sample of the straight run starting at `begin`
+  static size_t transitFromEnd(const std::vector<Sample> &path, size_t begin,
+                               size_t end);
+  static size_t transitFromBegin(const std::vector<Sample> &path,
+                                 size_t begin, size_t end);
+
+  shark2::Shark2Engine &engine_;
+  DecodePool &pool_;
+
+  std::atomic<std::shared_ptr<const SpaceKey>> spaceKey_;
+};
+
+} // namespace magickeyboard
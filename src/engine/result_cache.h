@@ -0,0 +1,161 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Decode Result Cache
+ *
+ * Users swipe the same handful of words over and over. A small LRU map
+ * from a decode input to its ranked result lets a repeat skip the decode.
+ * The key-sequence decoder is keyed by the collapsed key sequence and
+ * SHARK2 by a quantized gesture fingerprint. Both keys also carry the
+ * layout/dictionary version and, for SHARK2, the engine's template
+ * generation, so a stale entry is never matched; it just ages out.
+ *
+ * Each entry remembers what it cost to compute; hits add that to the
+ * saved-time counter reported by magickeyboardctl status.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace magickeyboard {
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+namespace cache_config {
+// Entries kept per decoder
+constexpr size_t KEYSEQ_ENTRIES = 256;
+constexpr size_t GESTURE_ENTRIES = 128;
+// Gesture fingerprint: path resampled to this many points, each snapped to
+// a grid of this pitch (layout px). Coarse enough for a repeat of the
+// same word to land on the same cells, fine enough to keep words apart.
+constexpr size_t FINGERPRINT_POINTS = 16;
+constexpr double FINGERPRINT_CELL_PX = 12.0;
+} // namespace cache_config
+
+// ============================================================================
+// Result Cache
+// ============================================================================
+
+// Thread-safe: decode workers read and fill it concurrently
+template <typename V> class ResultCache {
+public:
+  explicit ResultCache(size_t capacity) : capacity_(capacity) {}
+
+  // Copy the cached value into out and refresh its recency
+  bool get(const std::string &key, V &out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      misses_++;
+      return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    out = it->second->value;
+    hits_++;
+    savedUs_ += it->second->costUs;
+    return true;
+  }
+
+  // costUs: what computing value took, credited on every later hit
+  void put(const std::string &key, V value, long long costUs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      it->second->value = std::move(value);
+      it->second->costUs = costUs;
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+    }
+    lru_.push_front({key, std::move(value), costUs});
+    index_[key] = lru_.begin();
+    if (lru_.size() > capacity_) {
+      index_.erase(lru_.back().key);
+      lru_.pop_back();
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+  }
+
+  // Hit rate and saved time, as one JSON object
+  std::string statsJson() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsigned long long lookups = hits_ + misses_;
+    char buf[160];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"entries\":%zu,\"hits\":%llu,\"misses\":%llu,"
+                  "\"hit_rate\":%.3f,\"saved_us\":%lld}",
+                  lru_.size(), hits_, misses_,
+                  lookups ? static_cast<double>(hits_) / lookups : 0.0,
+                  savedUs_);
+    return buf;
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    V value;
+    long long costUs;
+  };
+
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  std::list<Entry> lru_; // Most recent first
+  std::unordered_map<std::string, typename std::list<Entry>::iterator> index_;
+  unsigned long long hits_ = 0;
+  unsigned long long misses_ = 0;
+  long long savedUs_ = 0;
+};
+
+// ============================================================================
+// Gesture Fingerprint
+// ============================================================================
+
+// Path resampled by arc length and snapped to a coarse grid. P is any point
+// type with x and y members.
+template <typename P>
+std::string gestureFingerprint(const std::vector<P> &path) {
+  std::string out;
+  if (path.size() < 2)
+    return out;
+
+  std::vector<double> cumulative(path.size(), 0.0);
+  for (size_t i = 1; i < path.size(); ++i) {
+    cumulative[i] = cumulative[i - 1] + std::hypot(path[i].x - path[i - 1].x,
+                                                   path[i].y - path[i - 1].y);
+  }
+  const double total = cumulative.back();
+
+  size_t seg = 1;
+  for (size_t k = 0; k < cache_config::FINGERPRINT_POINTS; ++k) {
+    double target = total * k / (cache_config::FINGERPRINT_POINTS - 1);
+    while (seg + 1 < path.size() && cumulative[seg] < target)
+      seg++;
+    double span = cumulative[seg] - cumulative[seg - 1];
+    double t = span > 0 ? (target - cumulative[seg - 1]) / span : 0.0;
+    t = std::clamp(t, 0.0, 1.0);
+    double x = path[seg - 1].x + (path[seg].x - path[seg - 1].x) * t;
+    double y = path[seg - 1].y + (path[seg].y - path[seg - 1].y) * t;
+
+    out += std::to_string(
+               std::lround(x / cache_config::FINGERPRINT_CELL_PX)) +
+           "," +
+           std::to_string(std::lround(y / cache_config::FINGERPRINT_CELL_PX)) +
+           ";";
+  }
+  return out;
+}
+
+} // namespace magickeyboard
@@ -118,6 +118,8 @@ bool SettingsManager::load() {
         newSettings.activeTheme = value;
       } else if (key == "active_layout") {
         newSettings.activeLayout = value;
+      } else if (key == "shadow_decoder") {
+        newSettings.shadowDecoder = value == "1" || value == "true";
       }
     } catch (...) {
       // Invalid value - skip this setting
@@ -159,7 +161,10 @@ bool SettingsManager::save() {
   file << "active_theme=" << settings_.activeTheme << "\n\n";
 
   file << "# Layout\n";
-  file << "active_layout=" << settings_.activeLayout << "\n";
+  file << "active_layout=" << settings_.activeLayout << "\n\n";
+
+  file << "# Diagnostics\n";
+  file << "shadow_decoder=" << (settings_.shadowDecoder ? 1 : 0) << "\n";
 
   return file.good();
 }
@@ -216,6 +221,8 @@ bool SettingsManager::setSingle(const std::string &key,
       current.activeTheme = value;
     } else if (key == "active_layout") {
       current.activeLayout = value;
+    } else if (key == "shadow_decoder") {
+      current.shadowDecoder = value == "1" || value == "true";
     } else {
       recognized = false;
     }
@@ -45,6 +45,10 @@ struct Settings {
   // Active keyboard layout
   std::string activeLayout = "qwerty";
 
+  // === Diagnostics ===
+  // Run the legacy decoder in shadow mode and log disagreements
+  bool shadowDecoder = false;
+
   // Equality operator for change detection
   bool operator==(const Settings &other) const {
     return swipeThresholdPx == other.swipeThresholdPx &&
@@ -55,7 +59,8 @@ struct Settings {
            windowScale == other.windowScale &&
            snapToCaretMode == other.snapToCaretMode &&
            activeTheme == other.activeTheme &&
-           activeLayout == other.activeLayout;
+           activeLayout == other.activeLayout &&
+           shadowDecoder == other.shadowDecoder;
   }
 
   bool operator!=(const Settings &other) const { return !(*this == other); }
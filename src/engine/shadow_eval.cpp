@@ -0,0 +1,246 @@
+/**
+ * Magic Keyboard - Shadow Decoder Evaluation Implementation
+ */
+
+#include "shadow_eval.h"
+#include "json_lines.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+namespace magickeyboard {
+
+namespace {
+
+// p in [0, 1]; samples is taken by value and partially reordered
+uint32_t percentile(std::vector<uint32_t> samples, double p) {
+  if (samples.empty())
+    return 0;
+  size_t k = static_cast<size_t>(p * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+// Words come from the dictionary, user data and the UI's key names, so
+// every string goes through the writer's escaping
+void wordList(ipc::MessageWriter &writer, std::string_view key,
+              const std::vector<std::string> &words) {
+  writer.beginArray(key);
+  for (const auto &word : words)
+    writer.str(word);
+  writer.endArray();
+}
+
+} // namespace
+
+// ============================================================================
+// Lifecycle
+// ============================================================================
+
+ShadowEvaluator::~ShadowEvaluator() { stop(); }
+
+void ShadowEvaluator::start(std::vector<ShadowDecoder> decoders,
+                            const std::string &logPath,
+                            const std::string &liveName) {
+  stop();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.clear();
+    Stats live;
+    live.name = liveName;
+    live.live = true;
+    stats_.push_back(std::move(live));
+    for (const auto &d : decoders) {
+      Stats s;
+      s.name = d.name;
+      stats_.push_back(std::move(s));
+    }
+    submitted_ = 0;
+    dropped_ = 0;
+    stopping_ = false;
+    running_ = true;
+  }
+
+  logPath_ = logPath;
+  struct stat st;
+  logBytes_ = stat(logPath_.c_str(), &st) == 0 ? st.st_size : 0;
+
+  worker_ = std::thread(
+      [this, decoders = std::move(decoders)]() mutable {
+        workerLoop(std::move(decoders));
+      });
+}
+
+void ShadowEvaluator::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_)
+      return;
+    stopping_ = true;
+    queue_.clear();
+  }
+  cv_.notify_all();
+
+  if (worker_.joinable())
+    worker_.join();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  running_ = false;
+}
+
+bool ShadowEvaluator::running() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_;
+}
+
+// ============================================================================
+// Live Side
+// ============================================================================
+
+void ShadowEvaluator::submit(ShadowInput input) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || stopping_)
+      return;
+
+    submitted_++;
+    stats_[0].runs++;
+    stats_[0].addLatency(input.liveUs);
+
+    if (queue_.size() >= shadow_config::MAX_PENDING) {
+      dropped_++;
+      return;
+    }
+    queue_.push_back(std::move(input));
+  }
+  cv_.notify_one();
+}
+
+std::string ShadowEvaluator::summaryJson() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  ipc::MessageWriter out;
+  out.begin("shadow_summary")
+      .boolean("enabled", running_)
+      .num("submitted", submitted_)
+      .num("dropped", dropped_)
+      .beginArray("decoders");
+
+  for (const auto &s : stats_) {
+    out.beginObject().str("name", s.name).boolean("live", s.live).num(
+        "runs", s.runs);
+    if (!s.live) {
+      char rate[32];
+      std::snprintf(rate, sizeof(rate), "%.3f",
+                    s.runs ? static_cast<double>(s.agree) / s.runs : 0.0);
+      out.raw("agree_rate", rate);
+    }
+    out.num("p50_us", percentile(s.latencyUs, 0.50))
+        .num("p95_us", percentile(s.latencyUs, 0.95))
+        .num("p99_us", percentile(s.latencyUs, 0.99))
+        .endObject();
+  }
+
+  return out.endArray().finish();
+}
+
+// ============================================================================
+// Shadow Thread
+// ============================================================================
+
+void ShadowEvaluator::Stats::addLatency(long long us) {
+  uint32_t v = static_cast<uint32_t>(std::clamp<long long>(us, 0, UINT32_MAX));
+  if (latencyUs.size() < shadow_config::LATENCY_WINDOW) {
+    latencyUs.push_back(v);
+  } else {
+    latencyUs[next] = v;
+  }
+  next = (next + 1) % shadow_config::LATENCY_WINDOW;
+}
+
+void ShadowEvaluator::workerLoop(std::vector<ShadowDecoder> decoders) {
+  // Only run when the CPU would otherwise idle so the live path never
+  // competes with us. Best effort: stays at normal priority if refused.
+  sched_param param{};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+  std::vector<bool> ready(decoders.size(), false);
+  for (size_t i = 0; i < decoders.size(); ++i) {
+    ready[i] = !decoders[i].init || decoders[i].init();
+  }
+
+  ipc::MessageWriter log; // One JSON line per decoder run
+  while (true) {
+    ShadowInput input;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_)
+        return;
+      input = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    long long ts =
+        std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    std::string liveTop = input.liveTop.empty() ? "" : input.liveTop[0];
+
+    for (size_t i = 0; i < decoders.size(); ++i) {
+      if (!ready[i])
+        continue;
+
+      auto start = std::chrono::steady_clock::now();
+      auto words = decoders[i].decode(input);
+      long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+      if (words.size() > shadow_config::TOP_K)
+        words.resize(shadow_config::TOP_K);
+
+      bool agree = !words.empty() && words[0] == liveTop;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &s = stats_[i + 1];
+        s.runs++;
+        if (agree)
+          s.agree++;
+        s.addLatency(us);
+      }
+
+      log.begin("shadow")
+          .num("ts", ts)
+          .str("keys", input.keys)
+          .num("points", input.points.size());
+      wordList(log, "live", input.liveTop);
+      log.num("live_us", input.liveUs).str("decoder", decoders[i].name);
+      wordList(log, "top", words);
+      appendLog(log.num("us", us).boolean("agree", agree).finish());
+    }
+  }
+}
+
+void ShadowEvaluator::appendLog(const std::string &line) {
+  if (logPath_.empty())
+    return;
+
+  // Keep at most two files of MAX_LOG_BYTES each
+  if (logBytes_ + line.size() > shadow_config::MAX_LOG_BYTES) {
+    std::rename(logPath_.c_str(), (logPath_ + ".1").c_str());
+    logBytes_ = 0;
+  }
+
+  std::ofstream file(logPath_, std::ios::app);
+  if (!file.is_open())
+    return;
+  file << line;
+  logBytes_ += line.size();
+}
+
+} // namespace magickeyboard
@@ -0,0 +1,119 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Shadow Decoder Evaluation
+ *
+ * Trials candidate decoders on real swipes without touching what the user
+ * sees. After the live decoder has answered, the same input is handed to a
+ * single low-priority background thread that runs every shadow decoder,
+ * compares its top-K with the live answer, and appends one JSON line per
+ * decoder to a bounded local log (shadow.log, rotated once).
+ *
+ * The live path only ever enqueues: if the shadow thread falls behind,
+ * new swipes are dropped and counted rather than queued without bound.
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace magickeyboard {
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+namespace shadow_config {
+// Swipes waiting for the shadow thread; more than this are dropped
+constexpr size_t MAX_PENDING = 8;
+// Candidates compared/logged per decoder
+constexpr size_t TOP_K = 3;
+// Latency samples kept per decoder for percentiles
+constexpr size_t LATENCY_WINDOW = 1024;
+// shadow.log is rotated to shadow.log.1 beyond this size
+constexpr size_t MAX_LOG_BYTES = 512 * 1024;
+} // namespace shadow_config
+
+// ============================================================================
+// Shadow Evaluator
+// ============================================================================
+
+// One swipe as seen by the live decoder
+struct ShadowInput {
+  std::vector<std::pair<double, double>> points; // Layout space
+  std::string keys;                              // UI key sequence, if sent
+  std::vector<std::string> liveTop;              // Live top-K words
+  long long liveUs = 0;                          // Live decode latency
+};
+
+struct ShadowDecoder {
+  std::string name;
+  // Runs once on the shadow thread before the first decode (e.g. load a
+  // dictionary); a decoder whose init fails is skipped
+  std::function<bool()> init;
+  // Ranked words for the input, best first
+  std::function<std::vector<std::string>(const ShadowInput &)> decode;
+};
+
+class ShadowEvaluator {
+public:
+  ShadowEvaluator() = default;
+  ~ShadowEvaluator();
+
+  ShadowEvaluator(const ShadowEvaluator &) = delete;
+  ShadowEvaluator &operator=(const ShadowEvaluator &) = delete;
+
+  // Start the shadow thread. liveName labels the live decoder's stats.
+  void start(std::vector<ShadowDecoder> decoders, const std::string &logPath,
+             const std::string &liveName);
+
+  // Stop and join; queued swipes are discarded
+  void stop();
+
+  bool running() const;
+
+  // Hand a decoded swipe to the shadow thread. Never blocks on decoding.
+  void submit(ShadowInput input);
+
+  // Agreement rate and latency percentiles per decoder, as one JSON line
+  std::string summaryJson() const;
+
+private:
+  struct Stats {
+    std::string name;
+    bool live = false;
+    uint64_t runs = 0;
+    uint64_t agree = 0;
+    std::vector<uint32_t> latencyUs; // Ring of LATENCY_WINDOW samples
+    size_t next = 0;
+
+    void addLatency(long long us);
+  };
+
+  void workerLoop(std::vector<ShadowDecoder> decoders);
+  void appendLog(const std::string &line);
+
+  std::thread worker_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<ShadowInput> queue_;
+  bool stopping_ = false;
+  bool running_ = false;
+
+  // Guarded by mutex_
+  std::vector<Stats> stats_;
+  uint64_t submitted_ = 0;
+  uint64_t dropped_ = 0;
+
+  // Only touched by the shadow thread
+  std::string logPath_;
+  size_t logBytes_ = 0;
+};
+
+} // namespace magickeyboard
@@ -6,18 +6,25 @@
 #include "shark2.h"
 
 #include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <limits>
+#include <mutex>
 #include <sstream>
+#include <unordered_set>
 
 namespace shark2 {
 
 // ============================================================================
 // Constructor
 // ============================================================================
-Shark2Engine::Shark2Engine() { initializeKeyboard(); }
+Shark2Engine::Shark2Engine() {
+  initializeKeyboard();
+  layoutId_.store(layoutSignature(keyCenters_));
+}
 
 // ============================================================================
 // Keyboard Layout Initialization
@@ -80,35 +87,65 @@ void Shark2Engine::setKeyboardSize(int width, int height) {
   // Could rescale key positions here if needed
 }
 
-Point Shark2Engine::getKeyCenter(char c) const {
-  c = std::tolower(c);
-  auto it = keyCenters_.find(c);
-  if (it != keyCenters_.end()) {
+Point Shark2Engine::keyCenter(const KeyCenters &centers, char c) {
+  auto it = centers.find(static_cast<char>(std::tolower(c)));
+  if (it != centers.end()) {
     return it->second;
   }
   return Point(0, 0);
 }
 
+Point Shark2Engine::getKeyCenter(char c) const {
+  std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+  return keyCenter(keyCenters_, c);
+}
+
 void Shark2Engine::setKeyCenter(char c, double x, double y) {
+  std::unique_lock<std::shared_mutex> lock(templatesMutex_);
   keyCenters_[std::tolower(c)] = Point(x, y);
+  layoutId_.store(layoutSignature(keyCenters_), std::memory_order_release);
+}
+
+uint64_t Shark2Engine::layoutSignature(const KeyCenters &centers) {
+  // FNV-1a over the keys in letter order; sub-unit jitter from scaling
+  // the same layout does not count as a change
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](int64_t v) {
+    for (int i = 0; i < 8; i++) {
+      hash ^= static_cast<uint8_t>(v >> (i * 8));
+      hash *= 1099511628211ull;
+    }
+  };
+  for (int c = 0; c < 256; c++) {
+    auto it = centers.find(static_cast<char>(c));
+    if (it == centers.end())
+      continue;
+    mix(c);
+    mix(std::llround(it->second.x));
+    mix(std::llround(it->second.y));
+  }
+  return hash;
 }
 
 // ============================================================================
 // Dictionary Loading
 // ============================================================================
+bool Shark2Engine::loadLexicon(std::shared_ptr<const Lexicon> lexicon) {
+  return buildTemplates(std::move(lexicon), false, nullptr);
+}
+
+bool Shark2Engine::loadLexicon(std::shared_ptr<const Lexicon> lexicon,
+                               KeyCenters keyCenters) {
+  return buildTemplates(std::move(lexicon), false, &keyCenters);
+}
+
 bool Shark2Engine::loadDictionary(const std::string &path) {
   std::ifstream file(path);
   if (!file.is_open()) {
     return false;
   }
 
-  templates_.clear();
-  for (auto &row : buckets_) {
-    for (auto &bucket : row) {
-      bucket.clear();
-    }
-  }
-
+  Lexicon::Builder words;
   std::string line;
   uint32_t rank = 1;
 
@@ -139,79 +176,124 @@ bool Shark2Engine::loadDictionary(const std::string &path) {
     }
 
     // Convert to lowercase
-    std::string word;
-    for (char c : line) {
-      word += std::tolower(c);
+    for (auto &c : line) {
+      c = std::tolower(c);
     }
-
-    // Generate template
-    GestureTemplate tmpl = generateTemplate(word, rank);
-    size_t idx = templates_.size();
-    templates_.push_back(std::move(tmpl));
-
-    // Add to bucket
-    int fi = word.front() - 'a';
-    int li = word.back() - 'a';
-    if (fi >= 0 && fi < 26 && li >= 0 && li < 26) {
-      buckets_[fi][li].push_back(idx);
-    }
-
+    words.add(line, rank);
     rank++;
   }
 
-  return !templates_.empty();
+  return buildTemplates(words.build(nullptr), true, nullptr);
 }
 
 bool Shark2Engine::loadDictionaryWithFrequency(
     const std::vector<std::pair<std::string, uint32_t>> &words) {
-
-  templates_.clear();
-  for (auto &row : buckets_) {
-    for (auto &bucket : row) {
-      bucket.clear();
+  Lexicon::Builder lexicon;
+  std::string lword;
+  for (const auto &[word, freq] : words) {
+    lword.clear();
+    for (char c : word) {
+      lword += std::tolower(c);
     }
+    lexicon.add(lword, freq);
   }
+  return buildTemplates(lexicon.build(nullptr), true, nullptr);
+}
 
-  for (const auto &[word, freq] : words) {
-    if (word.length() < 2)
-      continue;
+bool Shark2Engine::buildTemplates(std::shared_ptr<const Lexicon> lexicon,
+                                  bool frequencyIsRank,
+                                  const KeyCenters *keyCenters) {
+  // Generated off-lock and swapped in, as for a tier switch, so decodes on
+  // other threads keep running on the old templates meanwhile
+  KeyCenters centers;
+  size_t tier;
+  {
+    std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+    centers = keyCenters ? *keyCenters : keyCenters_;
+    tier = tier_;
+  }
 
-    // Validate all alpha
-    bool valid = true;
-    for (char c : word) {
-      if (!std::isalpha(c)) {
-        valid = false;
-        break;
+  std::vector<GestureTemplate> templates;
+  std::vector<size_t> buckets[26][26];
+  std::unordered_set<std::string_view> words;
+  auto generate = [&](int samplePoints) {
+    templates.clear();
+    templates.reserve(lexicon->size());
+    words.clear();
+    for (auto &row : buckets) {
+      for (auto &bucket : row) {
+        bucket.clear();
       }
     }
-    if (!valid)
-      continue;
 
-    // Lowercase
-    std::string lword;
-    for (char c : word) {
-      lword += std::tolower(c);
-    }
+    for (uint32_t id = 0; id < lexicon->size(); ++id) {
+      std::string_view word = lexicon->word(id);
+      if (word.length() < 2)
+        continue;
 
-    GestureTemplate tmpl = generateTemplate(lword, freq);
-    size_t idx = templates_.size();
-    templates_.push_back(std::move(tmpl));
+      // Validate all alpha
+      bool valid = true;
+      for (char c : word) {
+        if (!std::isalpha(c)) {
+          valid = false;
+          break;
+        }
+      }
+      if (!valid)
+        continue;
 
-    int fi = lword.front() - 'a';
-    int li = lword.back() - 'a';
-    if (fi >= 0 && fi < 26 && li >= 0 && li < 26) {
-      buckets_[fi][li].push_back(idx);
+      // One template per word, so removeWord() has a single slot to flag
+      if (!words.insert(word).second)
+        continue;
+
+      // Raw counts map to a rank (lower = better): higher count, lower rank
+      uint32_t rank = lexicon->frequency(id);
+      if (!frequencyIsRank) {
+        rank = rank > 0 ? 100000 / (rank + 1) : 50000;
+      }
+
+      size_t idx = templates.size();
+      templates.push_back(generateTemplate(word, rank, samplePoints, centers));
+
+      int fi = word.front() - 'a';
+      int li = word.back() - 'a';
+      if (fi >= 0 && fi < 26 && li >= 0 && li < 26) {
+        buckets[fi][li].push_back(idx);
+      }
     }
+  };
+  generate(config::QUALITY_TIERS[tier].samplePoints);
+
+  std::unique_lock<std::shared_mutex> lock(templatesMutex_);
+  while (tier != tier_) {
+    // A tier switch landed meanwhile; resample at the new tier
+    tier = tier_;
+    lock.unlock();
+    generate(config::QUALITY_TIERS[tier].samplePoints);
+    lock.lock();
   }
-
-  return !templates_.empty();
+  templates_.swap(templates);
+  for (int f = 0; f < 26; f++) {
+    for (int l = 0; l < 26; l++) {
+      buckets_[f][l].swap(buckets[f][l]);
+    }
+  }
+  keyCenters_ = std::move(centers);
+  layoutId_.store(layoutSignature(keyCenters_), std::memory_order_release);
+  lexicon_.swap(lexicon);
+  overlayWords_.clear();
+  resetOverlay();
+  bool loaded = !templates_.empty();
+  lock.unlock();
+  return loaded; // The old templates and lexicon are freed off-lock
 }
 
 // ============================================================================
 // Template Generation
 // ============================================================================
-GestureTemplate Shark2Engine::generateTemplate(const std::string &word,
-                                               uint32_t freq) {
+GestureTemplate Shark2Engine::generateTemplate(std::string_view word,
+                                               uint32_t freq, int samplePoints,
+                                               const KeyCenters &centers) {
   GestureTemplate tmpl;
   tmpl.word = word;
   tmpl.frequencyRank = freq;
@@ -220,7 +302,7 @@ GestureTemplate Shark2Engine::generateTemplate(const std::string &word,
 
   // Generate raw points by connecting letter centers
   for (char c : word) {
-    Point p = getKeyCenter(c);
+    Point p = keyCenter(centers, c);
     if (p.x != 0 || p.y != 0) { // Valid key
       tmpl.rawPoints.push_back(p);
     }
@@ -234,7 +316,7 @@ GestureTemplate Shark2Engine::generateTemplate(const std::string &word,
   tmpl.endPoint = tmpl.rawPoints.back();
 
   // Uniform sampling
-  tmpl.sampledPoints = uniformSample(tmpl.rawPoints, config::SAMPLE_POINTS);
+  tmpl.sampledPoints = uniformSample(tmpl.rawPoints, samplePoints);
 
   // Normalize for shape channel
   tmpl.normalizedShape = normalizeShape(tmpl.sampledPoints);
@@ -390,9 +472,9 @@ double Shark2Engine::locationDistance(const std::vector<Point> &a,
 // ============================================================================
 // Pruning (SHARK2 Stage 2)
 // ============================================================================
-std::vector<size_t> Shark2Engine::pruneByStartEnd(const Point &start,
-                                                  const Point &end,
-                                                  int inputLen) {
+std::vector<size_t>
+Shark2Engine::pruneByStartEnd(const Point &start, const Point &end,
+                              int inputLen, const config::QualityTier &tier) {
   std::vector<size_t> candidates;
 
   // Find keys near start and end points
@@ -418,10 +500,10 @@ std::vector<size_t> Shark2Engine::pruneByStartEnd(const Point &start,
       closestEnd = c;
     }
 
-    if (distToStart <= config::PRUNING_RADIUS) {
+    if (distToStart <= tier.pruningRadius) {
       startKeys.push_back(c);
     }
-    if (distToEnd <= config::PRUNING_RADIUS) {
+    if (distToEnd <= tier.pruningRadius) {
       endKeys.push_back(c);
     }
   }
@@ -449,23 +531,26 @@ std::vector<size_t> Shark2Engine::pruneByStartEnd(const Point &start,
   std::vector<char> expandedStart = startKeys;
   std::vector<char> expandedEnd = endKeys;
 
-  for (char c : startKeys) {
-    if (neighbors.count(c)) {
-      for (char n : neighbors.at(c)) {
-        if (std::find(expandedStart.begin(), expandedStart.end(), n) ==
-            expandedStart.end()) {
-          expandedStart.push_back(n);
+  // Lower quality tiers skip the expansion to keep the shortlist small
+  if (tier.expandNeighbors) {
+    for (char c : startKeys) {
+      if (neighbors.count(c)) {
+        for (char n : neighbors.at(c)) {
+          if (std::find(expandedStart.begin(), expandedStart.end(), n) ==
+              expandedStart.end()) {
+            expandedStart.push_back(n);
+          }
         }
       }
     }
-  }
 
-  for (char c : endKeys) {
-    if (neighbors.count(c)) {
-      for (char n : neighbors.at(c)) {
-        if (std::find(expandedEnd.begin(), expandedEnd.end(), n) ==
-            expandedEnd.end()) {
-          expandedEnd.push_back(n);
+    for (char c : endKeys) {
+      if (neighbors.count(c)) {
+        for (char n : neighbors.at(c)) {
+          if (std::find(expandedEnd.begin(), expandedEnd.end(), n) ==
+              expandedEnd.end()) {
+            expandedEnd.push_back(n);
+          }
         }
       }
     }
@@ -475,8 +560,20 @@ std::vector<size_t> Shark2Engine::pruneByStartEnd(const Point &start,
   startKeys = expandedStart;
   endKeys = expandedEnd;
 
-  // Collect templates from matching buckets
-  std::vector<bool> seen(templates_.size(), false);
+  // Collect templates from matching buckets (base, then overlay)
+  const size_t base = templates_.size();
+  std::vector<bool> seen(base + overlay_.size(), false);
+
+  auto collect = [&](size_t idx) {
+    if (seen[idx] || removed_[idx])
+      return;
+    const auto &tmpl = templateAt(idx);
+    int lenDiff = std::abs(static_cast<int>(tmpl.word.length()) - inputLen);
+    if (lenDiff <= tier.lengthTolerance) {
+      candidates.push_back(idx);
+      seen[idx] = true;
+    }
+  };
 
   for (char sc : startKeys) {
     int fi = sc - 'a';
@@ -489,15 +586,10 @@ std::vector<size_t> Shark2Engine::pruneByStartEnd(const Point &start,
         continue;
 
       for (size_t idx : buckets_[fi][li]) {
-        if (seen[idx])
-          continue;
-
-        const auto &tmpl = templates_[idx];
-        int lenDiff = std::abs(static_cast<int>(tmpl.word.length()) - inputLen);
-        if (lenDiff <= config::LENGTH_TOLERANCE) {
-          candidates.push_back(idx);
-          seen[idx] = true;
-        }
+        collect(idx);
+      }
+      for (size_t j : overlayBuckets_[fi][li]) {
+        collect(base + j);
       }
     }
   }
@@ -521,11 +613,34 @@ double Shark2Engine::frequencyToScore(uint32_t rank) {
 std::vector<Candidate>
 Shark2Engine::recognize(const std::vector<Point> &inputPoints,
                         int maxCandidates) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(config::DECODE_BUDGET_MS);
+  return recognizeWithDeadline(inputPoints, deadline, maxCandidates)
+      .candidates;
+}
 
-  if (inputPoints.size() < 2 || templates_.empty()) {
-    return {};
+RecognizeResult Shark2Engine::recognizeWithDeadline(
+    const std::vector<Point> &inputPoints,
+    std::chrono::steady_clock::time_point deadline, int maxCandidates) {
+  RecognizeResult out;
+
+  if (inputPoints.size() < 2) {
+    return out;
   }
 
+  // Personalized fast path: a confident match against how this user draws
+  // a word skips the dictionary scan entirely
+  out.candidates = matchUserTemplates(inputPoints, maxCandidates);
+  if (!out.candidates.empty()) {
+    return out;
+  }
+
+  std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+  if (templates_.empty() && overlay_.empty()) {
+    return out;
+  }
+  const auto &tier = config::QUALITY_TIERS[tier_];
+
   // Get start/end points for quick checks
   Point start = inputPoints.front();
   Point end = inputPoints.back();
@@ -543,8 +658,8 @@ Shark2Engine::recognize(const std::vector<Point> &inputPoints,
     if (word.length() < 2)
       continue;
 
-    Point expectedStart = getKeyCenter(word[0]);
-    Point expectedEnd = getKeyCenter(word.back());
+    Point expectedStart = keyCenter(keyCenters_, word[0]);
+    Point expectedEnd = keyCenter(keyCenters_, word.back());
 
     double startDist = start.distance(expectedStart);
     double endDist = end.distance(expectedEnd);
@@ -563,29 +678,53 @@ Shark2Engine::recognize(const std::vector<Point> &inputPoints,
   int estimatedLen = std::max(2, static_cast<int>(inputPoints.size() / 10));
 
   // Stage 1: Uniform sampling
-  std::vector<Point> sampled =
-      uniformSample(inputPoints, config::SAMPLE_POINTS);
+  std::vector<Point> sampled = uniformSample(inputPoints, tier.samplePoints);
 
   // Normalize for shape channel
   std::vector<Point> normalizedInput = normalizeShape(sampled);
 
   // Stage 2: Prune by start/end
   std::vector<size_t> candidateIndices =
-      pruneByStartEnd(start, end, estimatedLen);
+      pruneByStartEnd(start, end, estimatedLen, tier);
 
   // If pruning is too aggressive, expand search
   if (candidateIndices.size() < 10) {
     // Also try with doubled radius or all templates for short words
     estimatedLen = std::max(2, estimatedLen - 1);
-    candidateIndices = pruneByStartEnd(start, end, estimatedLen);
+    candidateIndices = pruneByStartEnd(start, end, estimatedLen, tier);
+  }
+
+  // Order by prior (frequency + start/end proximity) so that when the
+  // deadline cuts the scan short, the likeliest words were already scored
+  std::vector<std::pair<double, size_t>> ordered;
+  ordered.reserve(candidateIndices.size());
+  for (size_t idx : candidateIndices) {
+    const auto &tmpl = templateAt(idx);
+    double proximity = (start.distance(tmpl.startPoint) +
+                        end.distance(tmpl.endPoint)) /
+                       (2.0 * tier.pruningRadius);
+    double prior = config::FREQUENCY_WEIGHT *
+                       frequencyToScore(tmpl.frequencyRank) -
+                   std::min(1.0, proximity);
+    ordered.emplace_back(prior, idx);
   }
+  std::sort(ordered.begin(), ordered.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+  out.total = ordered.size();
 
   // Stage 3 & 4: Compute distances
   std::vector<Candidate> results;
-  results.reserve(candidateIndices.size());
+  results.reserve(ordered.size());
 
-  for (size_t idx : candidateIndices) {
-    const auto &tmpl = templates_[idx];
+  for (const auto &[prior, idx] : ordered) {
+    if (out.visited % config::DEADLINE_CHECK_INTERVAL == 0 &&
+        out.visited > 0 && std::chrono::steady_clock::now() >= deadline) {
+      out.complete = false;
+      break;
+    }
+    out.visited++;
+
+    const auto &tmpl = templateAt(idx);
     if (tmpl.normalizedShape.empty())
       continue;
 
@@ -612,8 +751,8 @@ Shark2Engine::recognize(const std::vector<Point> &inputPoints,
       char firstChar = std::tolower(tmpl.word[0]);
       char lastChar = std::tolower(tmpl.word.back());
 
-      double startDist = start.distance(getKeyCenter(firstChar));
-      double endDist = end.distance(getKeyCenter(lastChar));
+      double startDist = start.distance(keyCenter(keyCenters_, firstChar));
+      double endDist = end.distance(keyCenter(keyCenters_, lastChar));
 
       // Bonus for landing close to expected keys
       if (startDist < 40.0)
@@ -660,9 +799,501 @@ Shark2Engine::recognize(const std::vector<Point> &inputPoints,
     results.resize(maxCandidates);
   }
 
+  out.candidates = std::move(results);
+  return out;
+}
+
+// ============================================================================
+// User-Dictionary Overlay
+// ============================================================================
+void Shark2Engine::resetOverlay() {
+  // Note: templatesMutex_ already held exclusively by caller
+  overlay_.clear();
+  for (auto &row : overlayBuckets_) {
+    for (auto &bucket : row) {
+      bucket.clear();
+    }
+  }
+
+  removed_.assign(templates_.size(), false);
+  tombstones_ = 0;
+
+  wordIndex_.clear();
+  wordIndex_.reserve(templates_.size());
+  for (size_t i = 0; i < templates_.size(); i++) {
+    wordIndex_.emplace(templates_[i].word, i);
+  }
+  lexiconGeneration_++;
+}
+
+bool Shark2Engine::addWord(const std::string &word, uint32_t frequencyRank) {
+  if (word.length() < 2) {
+    return false;
+  }
+  std::string lword;
+  for (char c : word) {
+    if (!std::isalpha(static_cast<unsigned char>(c))) {
+      return false;
+    }
+    lword += std::tolower(static_cast<unsigned char>(c));
+  }
+
+  // Template generation happens under the shared lock, beside decodes;
+  // only the insert is exclusive
+  GestureTemplate tmpl;
+  uint64_t generation;
+  {
+    std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+    auto it = wordIndex_.find(lword);
+    if (it != wordIndex_.end() && !removed_[it->second]) {
+      return false;
+    }
+    generation = lexiconGeneration_;
+    tmpl = generateTemplate(lword, frequencyRank,
+                            config::QUALITY_TIERS[tier_].samplePoints,
+                            keyCenters_);
+  }
+  if (tmpl.normalizedShape.empty()) {
+    return false;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(templatesMutex_);
+  auto it = wordIndex_.find(lword);
+  if (it != wordIndex_.end()) {
+    if (!removed_[it->second]) {
+      return false;
+    }
+    // Revive the tombstoned slot; its template is still in place
+    removed_[it->second] = false;
+    tombstones_--;
+    lexiconGeneration_++;
+    return true;
+  }
+
+  if (generation != lexiconGeneration_) {
+    // Tier or key centers may have changed meanwhile
+    tmpl = generateTemplate(lword, frequencyRank,
+                            config::QUALITY_TIERS[tier_].samplePoints,
+                            keyCenters_);
+  }
+
+  size_t slot = overlay_.size();
+  int fi = lword.front() - 'a';
+  int li = lword.back() - 'a';
+  tmpl.word = overlayWords_.emplace_back(std::move(lword));
+  overlayBuckets_[fi][li].push_back(slot);
+  overlay_.push_back(std::move(tmpl));
+  removed_.push_back(false);
+  wordIndex_.emplace(overlay_.back().word, templates_.size() + slot);
+  lexiconGeneration_++;
+  return true;
+}
+
+bool Shark2Engine::hasWord(const std::string &word) const {
+  std::string lword;
+  for (char c : word) {
+    lword += std::tolower(static_cast<unsigned char>(c));
+  }
+
+  std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+  auto it = wordIndex_.find(lword);
+  return it != wordIndex_.end() && !removed_[it->second];
+}
+
+bool Shark2Engine::removeWord(const std::string &word) {
+  std::string lword;
+  for (char c : word) {
+    lword += std::tolower(static_cast<unsigned char>(c));
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(templatesMutex_);
+    auto it = wordIndex_.find(lword);
+    if (it == wordIndex_.end() || removed_[it->second]) {
+      return false;
+    }
+    removed_[it->second] = true;
+    tombstones_++;
+    lexiconGeneration_++;
+  }
+
+  // A personalized template would still propose the word
+  std::unique_lock<std::shared_mutex> lock(userMutex_);
+  auto it = userIndex_.find(lword);
+  if (it != userIndex_.end()) {
+    eraseUserTemplate(it->second);
+    userGeneration_++;
+  }
+  return true;
+}
+
+bool Shark2Engine::overlayNeedsMerge() const {
+  std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+  return overlay_.size() + tombstones_ >= config::OVERLAY_MERGE_THRESHOLD;
+}
+
+size_t Shark2Engine::getOverlaySize() const {
+  std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+  return overlay_.size();
+}
+
+bool Shark2Engine::mergeOverlay() {
+  std::vector<GestureTemplate> merged;
+  std::vector<size_t> buckets[26][26];
+  uint64_t generation;
+  {
+    std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+    if (overlay_.empty() && tombstones_ == 0) {
+      return true;
+    }
+    generation = lexiconGeneration_;
+
+    const size_t total = templates_.size() + overlay_.size();
+    merged.reserve(total - tombstones_);
+    for (size_t i = 0; i < total; i++) {
+      if (!removed_[i]) {
+        merged.push_back(templateAt(i));
+      }
+    }
+  }
+
+  // Words may point into a lexicon a concurrent load just dropped; only
+  // the cached first/last letters are read until the generation check
+  for (size_t i = 0; i < merged.size(); i++) {
+    int fi = merged[i].firstChar - 'a';
+    int li = merged[i].lastChar - 'a';
+    if (fi >= 0 && fi < 26 && li >= 0 && li < 26) {
+      buckets[fi][li].push_back(i);
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(templatesMutex_);
+  if (generation != lexiconGeneration_) {
+    return false; // Edited meanwhile; the next trigger retries
+  }
+  templates_ = std::move(merged);
+  for (int f = 0; f < 26; f++) {
+    for (int l = 0; l < 26; l++) {
+      buckets_[f][l] = std::move(buckets[f][l]);
+    }
+  }
+  resetOverlay();
+  return true;
+}
+
+// ============================================================================
+// Quality Tier
+// ============================================================================
+void Shark2Engine::setQualityTier(size_t tier) {
+  tier = std::min(tier, config::QUALITY_TIER_COUNT - 1);
+  const int samplePoints = config::QUALITY_TIERS[tier].samplePoints;
+
+  // Resample from the raw letter polylines without blocking decoders
+  std::vector<std::pair<std::vector<Point>, std::vector<Point>>> resampled;
+  uint64_t generation = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+    if (tier == tier_) {
+      return;
+    }
+    generation = lexiconGeneration_;
+    const size_t total = templates_.size() + overlay_.size();
+    resampled.reserve(total);
+    for (size_t i = 0; i < total; i++) {
+      auto sampled = uniformSample(templateAt(i).rawPoints, samplePoints);
+      auto shape = normalizeShape(sampled);
+      resampled.emplace_back(std::move(sampled), std::move(shape));
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(templatesMutex_);
+  if (generation != lexiconGeneration_) {
+    return; // Lexicon changed meanwhile; keep the current tier
+  }
+  for (size_t i = 0; i < resampled.size(); i++) {
+    auto &tmpl = i < templates_.size() ? templates_[i]
+                                       : overlay_[i - templates_.size()];
+    tmpl.sampledPoints = std::move(resampled[i].first);
+    tmpl.normalizedShape = std::move(resampled[i].second);
+  }
+  tier_ = tier;
+  lexiconGeneration_++;
+}
+
+size_t Shark2Engine::getQualityTier() const {
+  std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+  return tier_;
+}
+
+// ============================================================================
+// Personalized Templates
+// ============================================================================
+std::vector<Candidate>
+Shark2Engine::matchUserTemplates(const std::vector<Point> &input,
+                                 int maxCandidates) {
+  std::shared_lock<std::shared_mutex> lock(userMutex_);
+  if (userTemplates_.empty()) {
+    return {};
+  }
+
+  std::vector<Point> sampled =
+      uniformSample(input, config::USER_TEMPLATE_POINTS);
+  const Point &start = sampled.front();
+  const Point &end = sampled.back();
+  const uint64_t layout = layoutId();
+
+  std::vector<std::pair<double, size_t>> scored;
+  for (size_t i = 0; i < userTemplates_.size(); i++) {
+    const auto &tmpl = userTemplates_[i];
+    // Drawn on a layout that has since moved its keys
+    if (tmpl.samples < config::USER_TEMPLATE_MIN_SAMPLES ||
+        tmpl.layout != layout)
+      continue;
+    if (start.distance(tmpl.points.front()) > config::PRUNING_RADIUS ||
+        end.distance(tmpl.points.back()) > config::PRUNING_RADIUS)
+      continue;
+    scored.emplace_back(locationDistance(sampled, tmpl.points), i);
+  }
+  if (scored.empty()) {
+    return {};
+  }
+
+  std::sort(scored.begin(), scored.end());
+
+  // Accept only a close match that is clearly better than the runner-up;
+  // anything ambiguous goes through the full scan
+  double best = scored[0].first;
+  if (best > config::USER_MATCH_DISTANCE) {
+    return {};
+  }
+  if (scored.size() > 1 && scored[1].first < best * config::USER_MATCH_MARGIN) {
+    return {};
+  }
+
+  std::vector<Candidate> results;
+  for (const auto &[dist, idx] : scored) {
+    if (results.size() >= static_cast<size_t>(maxCandidates))
+      break;
+    Candidate cand;
+    cand.word = userTemplates_[idx].word;
+    cand.locationDistance = dist;
+    cand.score = 2.0 - dist / config::USER_MATCH_DISTANCE;
+    results.push_back(cand);
+  }
   return results;
 }
 
+void Shark2Engine::learnTemplate(const std::string &word,
+                                 const std::vector<Point> &inputPoints) {
+  if (word.empty() || inputPoints.size() < 2) {
+    return;
+  }
+
+  std::vector<Point> sampled =
+      uniformSample(inputPoints, config::USER_TEMPLATE_POINTS);
+  const uint64_t layout = layoutId();
+
+  std::unique_lock<std::shared_mutex> lock(userMutex_);
+  learnCounter_++;
+  userGeneration_++;
+
+  auto it = userIndex_.find(word);
+  if (it == userIndex_.end()) {
+    if (userTemplates_.size() >= config::MAX_USER_TEMPLATES) {
+      evictUserTemplate();
+    }
+    UserTemplate tmpl;
+    tmpl.word = word;
+    tmpl.points = std::move(sampled);
+    tmpl.samples = 1;
+    tmpl.lastUpdate = learnCounter_;
+    tmpl.layout = layout;
+    userIndex_[word] = userTemplates_.size();
+    userTemplates_.push_back(std::move(tmpl));
+    return;
+  }
+
+  // Running average; after the window fills it becomes an exponential
+  // average so the template follows drift in how the user draws
+  auto &tmpl = userTemplates_[it->second];
+  if (tmpl.layout != layout) {
+    // Keys moved since it was drawn: start over on the current layout
+    tmpl.points = std::move(sampled);
+    tmpl.samples = 1;
+    tmpl.lastUpdate = learnCounter_;
+    tmpl.layout = layout;
+    return;
+  }
+  if (tmpl.samples < std::numeric_limits<uint32_t>::max()) {
+    tmpl.samples++;
+  }
+  double alpha =
+      1.0 / std::min(tmpl.samples, config::USER_TEMPLATE_AVG_WINDOW);
+  for (size_t i = 0; i < tmpl.points.size(); i++) {
+    tmpl.points[i] = tmpl.points[i] * (1.0 - alpha) + sampled[i] * alpha;
+  }
+  tmpl.lastUpdate = learnCounter_;
+}
+
+void Shark2Engine::evictUserTemplate() {
+  // Note: userMutex_ already held exclusively by caller
+  if (userTemplates_.empty()) {
+    return;
+  }
+
+  // Other layouts first, then fewest samples, then least recently updated
+  const uint64_t layout = layoutId();
+  size_t victim = 0;
+  for (size_t i = 1; i < userTemplates_.size(); i++) {
+    const auto &a = userTemplates_[i];
+    const auto &b = userTemplates_[victim];
+    bool aStale = a.layout != layout;
+    bool bStale = b.layout != layout;
+    if (aStale != bStale) {
+      if (aStale)
+        victim = i;
+      continue;
+    }
+    if (a.samples < b.samples ||
+        (a.samples == b.samples && a.lastUpdate < b.lastUpdate)) {
+      victim = i;
+    }
+  }
+
+  eraseUserTemplate(victim);
+}
+
+void Shark2Engine::eraseUserTemplate(size_t idx) {
+  // Note: userMutex_ already held exclusively by caller
+  userIndex_.erase(userTemplates_[idx].word);
+  if (idx != userTemplates_.size() - 1) {
+    userTemplates_[idx] = std::move(userTemplates_.back());
+    userIndex_[userTemplates_[idx].word] = idx;
+  }
+  userTemplates_.pop_back();
+}
+
+bool Shark2Engine::loadUserTemplates(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  char magic[4];
+  file.read(magic, 4);
+  uint8_t version = 0;
+  file.read(reinterpret_cast<char *>(&version), 1);
+  uint16_t pointCount = 0;
+  file.read(reinterpret_cast<char *>(&pointCount), 2);
+  uint32_t count = 0;
+  file.read(reinterpret_cast<char *>(&count), 4);
+
+  // Stale format or different resampling: start fresh. Version 1 had no
+  // layout tag, so its templates can't be trusted to match the keys.
+  if (!file.good() || std::strncmp(magic, "MKTP", 4) != 0 || version != 2 ||
+      pointCount != config::USER_TEMPLATE_POINTS) {
+    return false;
+  }
+
+  const uint64_t layout = layoutId();
+  std::vector<UserTemplate> loaded;
+  for (uint32_t i = 0; i < count && i < config::MAX_USER_TEMPLATES; i++) {
+    uint16_t len = 0;
+    file.read(reinterpret_cast<char *>(&len), 2);
+    if (!file.good() || len == 0 || len > 100)
+      break; // Sanity check
+
+    UserTemplate tmpl;
+    tmpl.word.resize(len);
+    file.read(&tmpl.word[0], len);
+    file.read(reinterpret_cast<char *>(&tmpl.samples), 4);
+    file.read(reinterpret_cast<char *>(&tmpl.layout), 8);
+
+    tmpl.points.reserve(pointCount);
+    for (uint16_t k = 0; k < pointCount; k++) {
+      float xy[2];
+      file.read(reinterpret_cast<char *>(xy), sizeof(xy));
+      tmpl.points.emplace_back(xy[0], xy[1]);
+    }
+
+    if (!file.good())
+      break;
+    if (tmpl.layout != layout)
+      continue; // Drawn on keys that have moved since
+    loaded.push_back(std::move(tmpl));
+  }
+
+  std::unique_lock<std::shared_mutex> lock(userMutex_);
+  userTemplates_ = std::move(loaded);
+  userIndex_.clear();
+  for (size_t i = 0; i < userTemplates_.size(); i++) {
+    userIndex_[userTemplates_[i].word] = i;
+  }
+  learnCounter_ = 0;
+  userGeneration_++;
+  return true;
+}
+
+bool Shark2Engine::saveUserTemplates(const std::string &path) const {
+  std::shared_lock<std::shared_mutex> lock(userMutex_);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  file.write("MKTP", 4);
+  uint8_t version = 2;
+  file.write(reinterpret_cast<char *>(&version), 1);
+  uint16_t pointCount = config::USER_TEMPLATE_POINTS;
+  file.write(reinterpret_cast<char *>(&pointCount), 2);
+  uint32_t count = static_cast<uint32_t>(userTemplates_.size());
+  file.write(reinterpret_cast<char *>(&count), 4);
+
+  // Points stored as float pairs: 256 bytes per word at 32 points, plus
+  // the layout tag
+  for (const auto &tmpl : userTemplates_) {
+    uint16_t len = static_cast<uint16_t>(tmpl.word.length());
+    file.write(reinterpret_cast<char *>(&len), 2);
+    file.write(tmpl.word.data(), len);
+    uint32_t samples = tmpl.samples;
+    file.write(reinterpret_cast<char *>(&samples), 4);
+    uint64_t layout = tmpl.layout;
+    file.write(reinterpret_cast<char *>(&layout), 8);
+    for (const auto &p : tmpl.points) {
+      float xy[2] = {static_cast<float>(p.x), static_cast<float>(p.y)};
+      file.write(reinterpret_cast<char *>(xy), sizeof(xy));
+    }
+  }
+
+  return file.good();
+}
+
+void Shark2Engine::clearUserTemplates() {
+  std::unique_lock<std::shared_mutex> lock(userMutex_);
+  userTemplates_.clear();
+  userIndex_.clear();
+  learnCounter_ = 0;
+  userGeneration_++;
+}
+
+size_t Shark2Engine::getUserTemplateCount() const {
+  std::shared_lock<std::shared_mutex> lock(userMutex_);
+  return userTemplates_.size();
+}
+
+uint64_t Shark2Engine::generation() const {
+  // Both counters only grow, so their sum changes whenever either does.
+  // Locks taken one at a time; nothing else ever holds both.
+  uint64_t lexicon;
+  {
+    std::shared_lock<std::shared_mutex> lock(templatesMutex_);
+    lexicon = lexiconGeneration_;
+  }
+  std::shared_lock<std::shared_mutex> lock(userMutex_);
+  return lexicon + userGeneration_;
+}
+
 // Alternative API
 std::vector<std::pair<std::string, float>>
 Shark2Engine::recognize(const std::vector<std::pair<float, float>> &points,
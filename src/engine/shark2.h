@@ -11,14 +11,24 @@
  * - Uniform sampling to fixed points
  * - Start/end key pruning
  * - Frequency-weighted scoring
+ * - Personalized templates: a running average of how the user draws their
+ *   frequent words, checked before the dictionary scan
  */
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "lexicon/Lexicon.h"
+
 namespace shark2 {
 
 // ============================================================================
@@ -33,6 +43,42 @@ constexpr int MAX_CANDIDATES = 8;        // Maximum results to return
 constexpr double PRUNING_RADIUS =
     80.0;                           // Pixels tolerance for start/end (relaxed for trackpad)
 constexpr int LENGTH_TOLERANCE = 5; // Word length tolerance (relaxed)
+
+// Quality tiers, picked at runtime by startup self-calibration. Tier 0 is
+// the full-quality setting above; lower tiers trade recall for latency on
+// slow CPUs (e.g. a Steam Deck in power-save mode).
+struct QualityTier {
+  const char *name;
+  int samplePoints;     // Uniform sampling target
+  double pruningRadius; // Start/end key tolerance (px)
+  int lengthTolerance;  // Word length tolerance
+  bool expandNeighbors; // Also search buckets of adjacent start/end keys
+};
+constexpr QualityTier QUALITY_TIERS[] = {
+    {"high", SAMPLE_POINTS, PRUNING_RADIUS, LENGTH_TOLERANCE, true},
+    {"balanced", 64, 70.0, 4, true},
+    {"low", 32, 60.0, 3, false},
+};
+constexpr size_t QUALITY_TIER_COUNT =
+    sizeof(QUALITY_TIERS) / sizeof(QUALITY_TIERS[0]);
+
+// User-dictionary overlay: words added at runtime live in a small mutable
+// segment until it is merged into the base templates
+constexpr uint32_t OVERLAY_FREQUENCY_RANK = 2000; // Prior for user words
+constexpr size_t OVERLAY_MERGE_THRESHOLD = 64;    // Adds/removes per merge
+
+// Anytime decoding: candidates are scored best-prior first and the search
+// stops at the deadline with whatever it has
+constexpr int DECODE_BUDGET_MS = 8;            // Default per-swipe budget
+constexpr size_t DEADLINE_CHECK_INTERVAL = 32; // Templates per clock read
+
+// Personalized templates (learned from the user's committed swipes)
+constexpr int USER_TEMPLATE_POINTS = 32;          // Compact resampling
+constexpr size_t MAX_USER_TEMPLATES = 500;        // Bound on stored words
+constexpr uint32_t USER_TEMPLATE_MIN_SAMPLES = 3; // Samples before matching
+constexpr uint32_t USER_TEMPLATE_AVG_WINDOW = 10; // Running average window
+constexpr double USER_MATCH_DISTANCE = 18.0;      // Mean px error to accept
+constexpr double USER_MATCH_MARGIN = 1.5;         // Runner-up must be worse by
 } // namespace config
 
 // ============================================================================
@@ -61,7 +107,7 @@ struct Point {
 // Gesture Template (precomputed for each word)
 // ============================================================================
 struct GestureTemplate {
-  std::string word;
+  std::string_view word;  // Into the lexicon, or the overlay's word list
   uint32_t frequencyRank; // Lower = more common
 
   // Raw template points (connecting letter centers)
@@ -80,6 +126,17 @@ struct GestureTemplate {
   Point endPoint;
 };
 
+// ============================================================================
+// User Template (how this user actually draws a word)
+// ============================================================================
+struct UserTemplate {
+  std::string word;
+  std::vector<Point> points; // USER_TEMPLATE_POINTS, running average
+  uint32_t samples = 0;      // Committed swipes folded in
+  uint64_t lastUpdate = 0;   // Learn counter at last update, for eviction
+  uint64_t layout = 0;       // layoutId() of the keys it was drawn on
+};
+
 // ============================================================================
 // Candidate Result
 // ============================================================================
@@ -94,6 +151,21 @@ struct Candidate {
       : score(0), shapeDistance(0), locationDistance(0), frequencyScore(0) {}
 };
 
+// ============================================================================
+// Deadline-Bounded Result
+// ============================================================================
+struct RecognizeResult {
+  std::vector<Candidate> candidates;
+  bool complete = true; // False if the deadline cut the search short
+  size_t visited = 0;   // Templates scored
+  size_t total = 0;     // Templates that survived pruning
+
+  // Fraction of the pruned candidate set that was scored
+  double coverage() const {
+    return total ? static_cast<double>(visited) / total : 1.0;
+  }
+};
+
 // ============================================================================
 // SHARK2 Engine
 // ============================================================================
@@ -104,6 +176,19 @@ public:
   // Initialize with keyboard dimensions
   void setKeyboardSize(int width, int height);
 
+  using Lexicon = magickeyboard::lexicon::Lexicon;
+  using KeyCenters = std::unordered_map<char, Point>;
+
+  // Build templates over a shared lexicon (frequencies are raw counts,
+  // higher = more common). Template words point into it; it is kept alive
+  // until the next load.
+  bool loadLexicon(std::shared_ptr<const Lexicon> lexicon);
+
+  // Same, with new key centers (a layout reload). Templates are generated
+  // off-lock; decodes keep using the old set until both are swapped in.
+  bool loadLexicon(std::shared_ptr<const Lexicon> lexicon,
+                   KeyCenters keyCenters);
+
   // Load dictionary (line number = frequency rank)
   bool loadDictionary(const std::string &path);
 
@@ -111,10 +196,18 @@ public:
   bool loadDictionaryWithFrequency(
       const std::vector<std::pair<std::string, uint32_t>> &words);
 
-  // Main recognition function
+  // Main recognition function (bounded by config::DECODE_BUDGET_MS)
   std::vector<Candidate> recognize(const std::vector<Point> &inputPoints,
                                    int maxCandidates = config::MAX_CANDIDATES);
 
+  // Anytime recognition: visits candidates in descending prior (frequency
+  // plus start/end proximity) and returns the best-so-far top-K once the
+  // deadline passes
+  RecognizeResult
+  recognizeWithDeadline(const std::vector<Point> &inputPoints,
+                        std::chrono::steady_clock::time_point deadline,
+                        int maxCandidates = config::MAX_CANDIDATES);
+
   // Alternative API matching user request
   std::vector<std::pair<std::string, float>>
   recognize(const std::vector<std::pair<float, float>> &points,
@@ -123,28 +216,136 @@ public:
   // Get key center for a character
   Point getKeyCenter(char c) const;
 
-  // Set key center (to sync with layout parser)
+  // Set key center (to sync with layout parser). Templates already built
+  // keep the old position; loadLexicon() with KeyCenters replaces both.
   void setKeyCenter(char c, double x, double y);
 
   // Accessors
   size_t getTemplateCount() const { return templates_.size(); }
 
+  // ---- User-Dictionary Overlay ----
+
+  // Add a word (O(1) plus one template generation). Reviving a removed
+  // word clears its tombstone. Returns false if already present.
+  bool addWord(const std::string &word,
+               uint32_t frequencyRank = config::OVERLAY_FREQUENCY_RANK);
+
+  // Tombstone a word (base or overlay) so it is never proposed again, and
+  // drop its user template. O(1): one index lookup, no bucket scan.
+  bool removeWord(const std::string &word);
+
+  bool hasWord(const std::string &word) const;
+
+  // True once enough adds/removes piled up to be worth a merge
+  bool overlayNeedsMerge() const;
+
+  // Fold the overlay and tombstones into the base templates. Builds
+  // off-lock; gives up (returns false) if the lexicon changed meanwhile.
+  bool mergeOverlay();
+
+  size_t getOverlaySize() const;
+
+  // ---- Quality Tier ----
+
+  // Switch tier; dictionary templates are resampled off-lock and swapped
+  // in, so decodes running on other threads are never blocked for long
+  void setQualityTier(size_t tier);
+  size_t getQualityTier() const;
+
+  // ---- Personalized Templates ----
+
+  // Fold a committed swipe into the user's template for word
+  void learnTemplate(const std::string &word,
+                     const std::vector<Point> &inputPoints);
+
+  // Persist/restore user templates (binary, bounded). Points are in
+  // layout coordinates, so templates drawn on other key centers are
+  // dropped on load and ignored while matching.
+  bool loadUserTemplates(const std::string &path);
+  bool saveUserTemplates(const std::string &path) const;
+
+  void clearUserTemplates();
+  size_t getUserTemplateCount() const;
+
+  // Hash of the current key centers; changes when a layout moves a key
+  uint64_t layoutId() const {
+    return layoutId_.load(std::memory_order_acquire);
+  }
+
+  // Changes whenever a decode of the same path could change: lexicon
+  // edits, loads, tier switches and user-template updates
+  uint64_t generation() const;
+
 private:
   // Keyboard layout
   int keyboardWidth_ = 580;
   int keyboardHeight_ = 200;
-  std::unordered_map<char, Point> keyCenters_;
+  KeyCenters keyCenters_; // Guarded by templatesMutex_
+  // layoutSignature(keyCenters_), readable without templatesMutex_
+  std::atomic<uint64_t> layoutId_{0};
 
-  // Templates
+  // Templates, and the lexicon their words live in
   std::vector<GestureTemplate> templates_;
+  std::shared_ptr<const Lexicon> lexicon_;
 
   // Pruning buckets [first][last]
   std::vector<size_t> buckets_[26][26];
 
+  // User-dictionary overlay. Candidate indices >= templates_.size() refer
+  // to overlay_[idx - templates_.size()]; removed_ covers both segments.
+  std::vector<GestureTemplate> overlay_;
+  std::vector<size_t> overlayBuckets_[26][26];
+  std::vector<bool> removed_;
+  std::deque<std::string> overlayWords_; // Stable storage for added words
+  std::unordered_map<std::string_view, size_t> wordIndex_;
+  size_t tombstones_ = 0;
+  uint64_t lexiconGeneration_ = 0; // Bumped on every change, for merges
+
+  // Guards templates_, buckets_, keyCenters_, the overlay and tier_:
+  // shared while decoding, exclusive while swapping in a (re)load, editing
+  // or switching tier
+  mutable std::shared_mutex templatesMutex_;
+  size_t tier_ = 0;
+
+  const GestureTemplate &templateAt(size_t idx) const {
+    return idx < templates_.size() ? templates_[idx]
+                                   : overlay_[idx - templates_.size()];
+  }
+  // Reset overlay state after a (re)load; templatesMutex_ held exclusively
+  void resetOverlay();
+
+  // Replace the templates with the lexicon's words; ranks are either its
+  // frequencies as-is or derived from them as raw counts. keyCenters
+  // replaces the current centers if given.
+  bool buildTemplates(std::shared_ptr<const Lexicon> lexicon,
+                      bool frequencyIsRank, const KeyCenters *keyCenters);
+
+  // Center of a letter key, or (0,0); templatesMutex_ held
+  static Point keyCenter(const KeyCenters &centers, char c);
+  // Order-independent hash of the centers, rounded to whole units
+  static uint64_t layoutSignature(const KeyCenters &centers);
+
+  // User templates. recognize() may run on several decode workers at once
+  // while commits learn on the main thread.
+  mutable std::shared_mutex userMutex_;
+  std::vector<UserTemplate> userTemplates_;
+  std::unordered_map<std::string, size_t> userIndex_;
+  uint64_t learnCounter_ = 0;
+  uint64_t userGeneration_ = 0; // Bumped on every user-template change
+
+  // Confident user-template match, or empty to fall through to the scan
+  std::vector<Candidate> matchUserTemplates(const std::vector<Point> &input,
+                                            int maxCandidates);
+  void evictUserTemplate();
+  // Swap-pop one user template; userMutex_ held exclusively
+  void eraseUserTemplate(size_t idx);
+
   // ---- Core SHARK2 Algorithm ----
 
   // Generate template for a word
-  GestureTemplate generateTemplate(const std::string &word, uint32_t freq);
+  GestureTemplate generateTemplate(std::string_view word, uint32_t freq,
+                                   int samplePoints,
+                                   const KeyCenters &centers);
 
   // Uniform sampling to N points
   std::vector<Point> uniformSample(const std::vector<Point> &points, int n);
@@ -172,7 +373,8 @@ private:
 
   // Get candidate templates based on start/end points
   std::vector<size_t> pruneByStartEnd(const Point &start, const Point &end,
-                                      int inputLen);
+                                      int inputLen,
+                                      const config::QualityTier &tier);
 
   // Initialize QWERTY key positions
   void initializeKeyboard();
@@ -0,0 +1,223 @@
+/**
+ * SHARK2 Overlay Test
+ *
+ * Words added and removed at runtime: an added word decodes at once, a
+ * removed one (dictionary or overlay) stops decoding before the overlay is
+ * merged and stays gone after it.
+ * Run: g++ -std=c++20 -I. -I.. shark2_overlay_test.cpp shark2.cpp
+ * lexicon/Lexicon.cpp lexicon/Trie.cpp lexicon/BigramIndex.cpp -lpthread
+ * -o shark2_overlay_test && ./shark2_overlay_test
+ */
+
+#include "shark2.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace shark2;
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define YELLOW "\033[33m"
+#define RESET "\033[0m"
+
+int testsRun = 0;
+int testsPassed = 0;
+
+void runTest(const std::string &name, void (*fn)()) {
+  testsRun++;
+  try {
+    fn();
+    testsPassed++;
+    std::cout << GREEN << "✓ " << RESET << name << std::endl;
+  } catch (const std::exception &e) {
+    std::cout << RED << "✗ " << RESET << name << ": " << e.what() << std::endl;
+  }
+}
+
+#define ASSERT_TRUE(cond)                                                      \
+  if (!(cond))                                                                 \
+  throw std::runtime_error("Assertion failed: " #cond)
+#define ASSERT_EQ(a, b)                                                        \
+  if ((a) != (b))                                                              \
+  throw std::runtime_error("Assertion failed: " #a " == " #b)
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// A small dictionary; rank 1 is the most common word
+void loadWords(Shark2Engine &engine) {
+  engine.loadDictionaryWithFrequency({{"hello", 1},
+                                      {"world", 2},
+                                      {"help", 3},
+                                      {"word", 4},
+                                      {"would", 5},
+                                      {"held", 6}});
+}
+
+// The ideal swipe for word: straight lines through its key centers
+std::vector<Point> pathFor(const Shark2Engine &engine,
+                           const std::string &word) {
+  std::vector<Point> path;
+  for (char c : word) {
+    path.push_back(engine.getKeyCenter(c));
+  }
+  return path;
+}
+
+bool proposes(Shark2Engine &engine, const std::vector<Point> &path,
+              const std::string &word) {
+  for (const auto &cand : engine.recognize(path)) {
+    if (cand.word == word)
+      return true;
+  }
+  return false;
+}
+
+std::string top(Shark2Engine &engine, const std::string &word) {
+  auto candidates = engine.recognize(pathFor(engine, word));
+  return candidates.empty() ? "" : candidates.front().word;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+void test_addedWordDecodes() {
+  Shark2Engine engine;
+  loadWords(engine);
+  ASSERT_TRUE(top(engine, "zorgq") != "zorgq");
+
+  ASSERT_TRUE(engine.addWord("Zorgq"));
+  ASSERT_TRUE(!engine.addWord("zorgq"));
+  ASSERT_TRUE(engine.hasWord("zorgq"));
+  ASSERT_EQ(engine.getOverlaySize(), 1u);
+  ASSERT_EQ(top(engine, "zorgq"), "zorgq");
+}
+
+void test_removedOverlayWordGone() {
+  Shark2Engine engine;
+  loadWords(engine);
+  ASSERT_TRUE(engine.addWord("zorgq"));
+  auto path = pathFor(engine, "zorgq");
+  ASSERT_TRUE(proposes(engine, path, "zorgq"));
+
+  ASSERT_TRUE(engine.removeWord("zorgq"));
+  ASSERT_TRUE(!engine.hasWord("zorgq"));
+  ASSERT_TRUE(!proposes(engine, path, "zorgq")); // Before the merge
+
+  ASSERT_TRUE(engine.mergeOverlay());
+  ASSERT_EQ(engine.getOverlaySize(), 0u);
+  ASSERT_TRUE(!engine.hasWord("zorgq"));
+  ASSERT_TRUE(!proposes(engine, path, "zorgq")); // And after it
+}
+
+void test_removedDictionaryWordGone() {
+  Shark2Engine engine;
+  loadWords(engine);
+  auto path = pathFor(engine, "hello");
+  ASSERT_EQ(top(engine, "hello"), "hello");
+  const size_t count = engine.getTemplateCount();
+
+  ASSERT_TRUE(engine.removeWord("HELLO"));
+  ASSERT_TRUE(!proposes(engine, path, "hello"));
+
+  ASSERT_TRUE(engine.mergeOverlay());
+  ASSERT_EQ(engine.getTemplateCount(), count - 1);
+  ASSERT_TRUE(!proposes(engine, path, "hello"));
+  ASSERT_EQ(top(engine, "world"), "world");
+}
+
+void test_removeUnknownOrTwice() {
+  Shark2Engine engine;
+  loadWords(engine);
+  ASSERT_TRUE(!engine.removeWord("zorgq"));
+  ASSERT_TRUE(engine.removeWord("help"));
+  ASSERT_TRUE(!engine.removeWord("help"));
+}
+
+void test_reviveRemovedWord() {
+  Shark2Engine engine;
+  loadWords(engine);
+  auto path = pathFor(engine, "help");
+  ASSERT_TRUE(engine.removeWord("help"));
+  ASSERT_TRUE(!proposes(engine, path, "help"));
+
+  // Added back in place, not appended to the overlay
+  ASSERT_TRUE(engine.addWord("help"));
+  ASSERT_EQ(engine.getOverlaySize(), 0u);
+  ASSERT_TRUE(proposes(engine, path, "help"));
+
+  ASSERT_TRUE(engine.mergeOverlay());
+  ASSERT_TRUE(proposes(engine, path, "help"));
+}
+
+void test_duplicateDictionaryEntries() {
+  // A word listed twice gets one template, so one removal hides it
+  Shark2Engine engine;
+  engine.loadDictionaryWithFrequency(
+      {{"hello", 1}, {"world", 2}, {"hello", 3}});
+  ASSERT_EQ(engine.getTemplateCount(), 2u);
+  ASSERT_TRUE(engine.removeWord("hello"));
+  ASSERT_TRUE(!proposes(engine, pathFor(engine, "hello"), "hello"));
+}
+
+void test_removalDropsUserTemplate() {
+  Shark2Engine engine;
+  loadWords(engine);
+  auto path = pathFor(engine, "world");
+  engine.learnTemplate("world", path);
+  engine.learnTemplate("world", path);
+  ASSERT_EQ(engine.getUserTemplateCount(), 1u);
+
+  ASSERT_TRUE(engine.removeWord("world"));
+  ASSERT_EQ(engine.getUserTemplateCount(), 0u);
+  ASSERT_TRUE(!proposes(engine, path, "world"));
+}
+
+void test_removalsCountTowardMerge() {
+  Shark2Engine engine;
+  std::vector<std::pair<std::string, uint32_t>> words;
+  for (char a = 'a'; a <= 'z'; a++) {
+    for (char b = 'a'; b <= 'c'; b++) {
+      words.push_back({std::string{'q', a, b}, 1});
+    }
+  }
+  engine.loadDictionaryWithFrequency(words);
+
+  for (size_t i = 0; i < config::OVERLAY_MERGE_THRESHOLD; i++) {
+    ASSERT_TRUE(!engine.overlayNeedsMerge());
+    ASSERT_TRUE(engine.removeWord(words[i].first));
+  }
+  ASSERT_TRUE(engine.overlayNeedsMerge());
+  ASSERT_TRUE(engine.mergeOverlay());
+  ASSERT_TRUE(!engine.overlayNeedsMerge());
+  ASSERT_EQ(engine.getTemplateCount(),
+            words.size() - config::OVERLAY_MERGE_THRESHOLD);
+}
+
+// ============================================================================
+// Main
+// ============================================================================
+
+int main() {
+  std::cout << YELLOW << "\n=== SHARK2 Overlay Tests ===" << RESET << "\n\n";
+
+  runTest("addedWordDecodes", test_addedWordDecodes);
+  runTest("removedOverlayWordGone", test_removedOverlayWordGone);
+  runTest("removedDictionaryWordGone", test_removedDictionaryWordGone);
+  runTest("removeUnknownOrTwice", test_removeUnknownOrTwice);
+  runTest("reviveRemovedWord", test_reviveRemovedWord);
+  runTest("duplicateDictionaryEntries", test_duplicateDictionaryEntries);
+  runTest("removalDropsUserTemplate", test_removalDropsUserTemplate);
+  runTest("removalsCountTowardMerge", test_removalsCountTowardMerge);
+
+  std::cout << "\n"
+            << YELLOW << "Results: " << RESET << testsPassed << "/" << testsRun
+            << " passed\n\n";
+
+  return (testsPassed == testsRun) ? 0 : 1;
+}
@@ -6,13 +6,13 @@
  */
 
 #include "swipe_engine.h"
+#include "edit_distance.h"
 
 #include <algorithm>
 #include <cctype>
 #include <cmath>
 #include <cstdint>
 #include <fstream>
-#include <set>
 #include <sstream>
 #include <unordered_map>
 
@@ -25,6 +25,7 @@ namespace swipe {
 bool SwipeEngine::loadLayout(const std::string &layoutPath) {
   keys_.clear();
   keyIndex_.clear();
+  keyGrid_.clear();
 
   std::ifstream f(layoutPath);
   if (!f.is_open()) {
@@ -231,6 +232,29 @@ void SwipeEngine::buildNeighborMap() {
 
     neighbors_[c] = neighs;
   }
+
+  // Center distances for the spatial score, so scoring never looks keys up
+  for (auto &row : keyDistance_)
+    std::fill(std::begin(row), std::end(row), -1.0);
+  for (const auto &a : keys_) {
+    if (!a.isAlpha())
+      continue;
+    int ai = std::tolower(a.id[0]) - 'a';
+    for (const auto &b : keys_) {
+      if (!b.isAlpha())
+        continue;
+      int bi = std::tolower(b.id[0]) - 'a';
+      keyDistance_[ai][bi] = a.center.distanceTo(b.center);
+    }
+  }
+
+  std::vector<magickeyboard::gesture::KeyGrid::Box> boxes;
+  boxes.reserve(keys_.size());
+  for (const auto &k : keys_) {
+    boxes.push_back({k.bounds.x, k.bounds.y, k.bounds.w, k.bounds.h,
+                     k.center.x, k.center.y});
+  }
+  keyGrid_.build(std::move(boxes));
 }
 
 // ============================================================================
@@ -238,28 +262,18 @@ void SwipeEngine::buildNeighborMap() {
 // ============================================================================
 
 const Key *SwipeEngine::findBestKey(const Point &pt) const {
-  const Key *bestKey = nullptr;
-  double bestDistSq = 1e18;
-
-  // Priority 1: Inside bounding rect
-  for (const auto &k : keys_) {
-    if (k.bounds.contains(pt)) {
-      return &k;
-    }
-
-    double d2 = pt.distanceSquaredTo(k.center);
-    if (d2 < bestDistSq) {
-      bestDistSq = d2;
-      bestKey = &k;
-    }
+  // Priority 1: Inside bounding rect; otherwise nearest center
+  auto hit = keyGrid_.find(pt.x, pt.y);
+  if (hit.index < 0) {
+    return nullptr;
   }
 
   // Reject if too far from any key (noise filtering)
-  if (bestDistSq > 100 * 100) {
+  if (!hit.inside && hit.distSq > 100 * 100) {
     return nullptr;
   }
 
-  return bestKey;
+  return &keys_[hit.index];
 }
 
 const Key *SwipeEngine::findKeyById(const std::string &id) const {
@@ -411,72 +425,27 @@ std::vector<int> SwipeEngine::getShortlist(const std::string &keys) const {
 }
 
 // ============================================================================
-// Levenshtein Distance with Early Exit
+// Levenshtein Distance (bit-parallel, see edit_distance.h)
 // ============================================================================
 
 int SwipeEngine::levenshtein(const std::string &s1, const std::string &s2,
                              int limit) {
-  int n = static_cast<int>(s1.length());
-  int m = static_cast<int>(s2.length());
-
-  if (std::abs(n - m) > limit) {
-    return limit + 1;
-  }
-
-  std::vector<int> prev(m + 1);
-  std::vector<int> curr(m + 1);
-
-  for (int j = 0; j <= m; ++j) {
-    prev[j] = j;
-  }
-
-  for (int i = 1; i <= n; ++i) {
-    curr[0] = i;
-    int minRow = curr[0];
-
-    for (int j = 1; j <= m; ++j) {
-      int cost = (std::tolower(s1[i - 1]) == std::tolower(s2[j - 1])) ? 0 : 1;
-      curr[j] = std::min({curr[j - 1] + 1, prev[j] + 1, prev[j - 1] + cost});
-      minRow = std::min(minRow, curr[j]);
-    }
-
-    if (minRow > limit) {
-      return limit + 1; // Early exit
-    }
-
-    std::swap(prev, curr);
-  }
-
-  return prev[m];
+  return editdist::bounded(s1, s2, limit, /*foldCase=*/true);
 }
 
 // ============================================================================
 // Bigram Overlap
 // ============================================================================
 
-int SwipeEngine::countBigramOverlap(const std::string &keys,
-                                    const std::string &word) {
-  auto getBigrams = [](const std::string &s) {
-    std::set<uint16_t> result;
-    for (size_t i = 0; i + 1 < s.length(); ++i) {
-      if (std::isalpha(s[i]) && std::isalpha(s[i + 1])) {
-        result.insert(static_cast<uint16_t>((std::tolower(s[i]) - 'a') * 26 +
-                                            (std::tolower(s[i + 1]) - 'a')));
-      }
-    }
-    return result;
-  };
-
-  auto b1 = getBigrams(keys);
-  auto b2 = getBigrams(word);
-
-  int count = 0;
-  for (auto bg : b1) {
-    if (b2.count(bg)) {
-      count++;
+SwipeEngine::BigramSet SwipeEngine::collectBigrams(const std::string &s) {
+  BigramSet result;
+  for (size_t i = 0; i + 1 < s.length(); ++i) {
+    if (std::isalpha(s[i]) && std::isalpha(s[i + 1])) {
+      result.set((std::tolower(s[i]) - 'a') * 26 +
+                 (std::tolower(s[i + 1]) - 'a'));
     }
   }
-  return count;
+  return result;
 }
 
 // ============================================================================
@@ -484,7 +453,7 @@ int SwipeEngine::countBigramOverlap(const std::string &keys,
 // ============================================================================
 
 double SwipeEngine::computeSpatialScore(const std::string &keys,
-                                        const std::string &word) {
+                                        const std::string &word) const {
   // Compute average centroid distance between key sequence and word
   // Uses dynamic alignment to handle length differences
 
@@ -495,16 +464,12 @@ double SwipeEngine::computeSpatialScore(const std::string &keys,
   size_t wordIdx = 0;
 
   while (keyIdx < keys.length() && wordIdx < word.length()) {
-    // Find key centroids
-    std::string keyId(1, std::tolower(keys[keyIdx]));
-    std::string wordId(1, std::tolower(word[wordIdx]));
-
-    const Key *keyKey = findKeyById(keyId);
-    const Key *wordKey = findKeyById(wordId);
+    int ki = std::tolower(keys[keyIdx]) - 'a';
+    int wi = std::tolower(word[wordIdx]) - 'a';
 
-    if (keyKey && wordKey) {
-      double dist = keyKey->center.distanceTo(wordKey->center);
-      totalDist += dist;
+    if (ki >= 0 && ki < 26 && wi >= 0 && wi < 26 &&
+        keyDistance_[ki][wi] >= 0) {
+      totalDist += keyDistance_[ki][wi];
       pairs++;
     }
 
@@ -536,26 +501,32 @@ double SwipeEngine::computeSpatialScore(const std::string &keys,
 // Candidate Scoring
 // ============================================================================
 
-double SwipeEngine::scoreCandidate(const std::string &keys,
-                                   const DictWord &dw) {
+SwipeEngine::CandidateScore
+SwipeEngine::scoreCandidate(const std::string &keys,
+                            const BigramSet &keyBigrams, const DictWord &dw) {
+  CandidateScore cs;
+
   // Component 1: Edit distance penalty
-  int editDist = levenshtein(keys, dw.word, config::EDIT_DISTANCE_LIMIT);
+  cs.editDistance = levenshtein(keys, dw.word, config::EDIT_DISTANCE_LIMIT);
 
-  // Component 2: Bigram overlap bonus
-  int bigramOverlap = countBigramOverlap(keys, dw.word);
+  // Component 2: Bigram overlap bonus (distinct key bigrams found in word)
+  cs.bigramOverlap =
+      static_cast<int>((keyBigrams & collectBigrams(dw.word)).count());
 
   // Component 3: Frequency bonus (log scale)
   // Lower freq value = more common = higher score
   // Using inverse: if freq=1 is most common, higher freq = lower priority
-  double freqScore = std::log1p(1000.0 / (dw.freq + 1));
+  cs.freqScore = std::log1p(1000.0 / (dw.freq + 1));
 
   // Component 4: Spatial proximity bonus
-  double spatialScore = computeSpatialScore(keys, dw.word);
+  cs.spatialScore = computeSpatialScore(keys, dw.word);
 
   // Weighted combination
-  return config::W_EDIT_DISTANCE * editDist +
-         config::W_BIGRAM_OVERLAP * bigramOverlap +
-         config::W_FREQUENCY * freqScore + config::W_SPATIAL * spatialScore;
+  cs.total = config::W_EDIT_DISTANCE * cs.editDistance +
+             config::W_BIGRAM_OVERLAP * cs.bigramOverlap +
+             config::W_FREQUENCY * cs.freqScore +
+             config::W_SPATIAL * cs.spatialScore;
+  return cs;
 }
 
 // ============================================================================
@@ -572,22 +543,19 @@ SwipeEngine::generateCandidates(const std::string &keySequence) {
   std::vector<Candidate> candidates;
   candidates.reserve(shortlist.size());
 
+  const BigramSet keyBigrams = collectBigrams(keySequence);
+
   for (int idx : shortlist) {
     const auto &dw = dictionary_[idx];
-    double score = scoreCandidate(keySequence, dw);
-
-    if (score >= config::MIN_CANDIDATE_SCORE) {
-      Candidate c;
-      c.word = dw.word;
-      c.score = score;
-      c.editDistance =
-          levenshtein(keySequence, dw.word, config::EDIT_DISTANCE_LIMIT);
-      c.bigramOverlap = countBigramOverlap(keySequence, dw.word);
-      c.freqContribution =
-          config::W_FREQUENCY * std::log1p(1000.0 / (dw.freq + 1));
-      c.spatialContribution =
-          config::W_SPATIAL * computeSpatialScore(keySequence, dw.word);
-      candidates.push_back(c);
+    CandidateScore cs = scoreCandidate(keySequence, keyBigrams, dw);
+
+    if (cs.total >= config::MIN_CANDIDATE_SCORE) {
+      Candidate c(dw.word, cs.total);
+      c.editDistance = cs.editDistance;
+      c.bigramOverlap = cs.bigramOverlap;
+      c.freqContribution = config::W_FREQUENCY * cs.freqScore;
+      c.spatialContribution = config::W_SPATIAL * cs.spatialScore;
+      candidates.push_back(std::move(c));
     }
   }
 
@@ -7,6 +7,9 @@
  * See docs/SWIPE_ENGINE_SPEC.md for algorithm details.
  */
 
+#include "gesture/key_grid.h"
+
+#include <bitset>
 #include <cctype>
 #include <cmath>
 #include <cstdint>
@@ -175,6 +178,7 @@ private:
   // Layout data
   std::vector<Key> keys_;
   std::unordered_map<std::string, size_t> keyIndex_; // id -> keys_ index
+  magickeyboard::gesture::KeyGrid keyGrid_;           // Hit-test index
 
   // Dictionary data
   std::vector<DictWord> dictionary_;
@@ -183,6 +187,10 @@ private:
   // Neighbor map for spatial tolerance (precomputed)
   std::unordered_map<char, std::vector<char>> neighbors_;
 
+  // Letter key center distances [a-z][a-z], built with the neighbor map;
+  // negative where either letter has no key
+  double keyDistance_[26][26] = {};
+
   // ---- Internal algorithms ----
 
   // Find best matching key for a point
@@ -192,13 +200,28 @@ private:
   // Get shortlist of dictionary indices matching first/last char
   std::vector<int> getShortlist(const std::string &keys) const;
 
-  // Scoring components
-  int levenshtein(const std::string &s1, const std::string &s2, int limit);
-  int countBigramOverlap(const std::string &keys, const std::string &word);
-  double computeSpatialScore(const std::string &keys, const std::string &word);
-  double scoreCandidate(const std::string &keys, const DictWord &dw);
+  // Letter bigrams as bits (a * 26 + b)
+  using BigramSet = std::bitset<26 * 26>;
 
-  // Build neighbor map from layout
+  // All score components of one word, from a single pass
+  struct CandidateScore {
+    double total = 0;
+    int editDistance = 0;
+    int bigramOverlap = 0;
+    double freqScore = 0;
+    double spatialScore = 0;
+  };
+
+  // Scoring components. None of these allocate.
+  int levenshtein(const std::string &s1, const std::string &s2, int limit);
+  static BigramSet collectBigrams(const std::string &s);
+  double computeSpatialScore(const std::string &keys,
+                             const std::string &word) const;
+  CandidateScore scoreCandidate(const std::string &keys,
+                                const BigramSet &keyBigrams,
+                                const DictWord &dw);
+
+  // Build neighbor map and hit-test grid from layout
   void buildNeighborMap();
 };
 
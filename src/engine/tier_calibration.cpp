@@ -0,0 +1,192 @@
+/**
+ * Magic Keyboard - Decoder Quality Tier Self-Calibration Implementation
+ */
+
+#include "tier_calibration.h"
+#include "decode_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace magickeyboard {
+
+namespace {
+
+long long p99(std::vector<long long> samples) {
+  if (samples.empty())
+    return -1;
+  size_t k = (samples.size() - 1) * 99 / 100;
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+} // namespace
+
+TierCalibrator::TierCalibrator(shark2::Shark2Engine &engine, DecodePool &pool)
+    : engine_(engine), pool_(pool), state_(std::make_shared<State>()) {}
+
+// ============================================================================
+// Benchmark
+// ============================================================================
+
+long long TierCalibrator::benchmark(shark2::Shark2Engine &engine,
+                                    State &state) {
+  std::vector<std::string> words;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    words = state.words;
+  }
+  if (words.empty())
+    return -1;
+
+  // Fixed seed: the same synthetic load every run, so tiers compare fairly
+  std::mt19937 rng(42);
+  std::normal_distribution<double> jitter(0.0, 6.0);
+
+  std::vector<long long> latencies;
+  latencies.reserve(calib_config::BENCH_SWIPES);
+  for (size_t i = 0; i < calib_config::BENCH_SWIPES; ++i) {
+    const auto &word = words[i % words.size()];
+
+    // Letter-to-letter polyline, 8 jittered samples per segment
+    std::vector<shark2::Point> path;
+    for (size_t c = 1; c < word.size(); ++c) {
+      auto a = engine.getKeyCenter(word[c - 1]);
+      auto b = engine.getKeyCenter(word[c]);
+      for (int k = 0; k < 8; ++k) {
+        auto p = a + (b - a) * (k / 8.0);
+        path.emplace_back(p.x + jitter(rng), p.y + jitter(rng));
+      }
+    }
+    path.push_back(engine.getKeyCenter(word.back()));
+
+    // Generous deadline: we want the full cost, not the anytime cut
+    auto start = std::chrono::steady_clock::now();
+    engine.recognizeWithDeadline(path, start + std::chrono::seconds(1));
+    latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+
+  long long result = p99(std::move(latencies));
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.benchP99Us = result;
+  return result;
+}
+
+void TierCalibrator::calibrate(shark2::Shark2Engine &engine, State &state) {
+  // Step down from the current tier until the target is met
+  size_t tier = engine.getQualityTier();
+  while (benchmark(engine, state) > calib_config::TARGET_P99_US &&
+         tier + 1 < shark2::config::QUALITY_TIER_COUNT) {
+    engine.setQualityTier(tier + 1);
+    // A switch racing a lexicon change is dropped. Benchmarking the same
+    // tier again proves nothing; stay uncalibrated so recordLive() retries.
+    if (engine.getQualityTier() != tier + 1)
+      return;
+    ++tier;
+  }
+  state.calibrated = true;
+}
+
+void TierCalibrator::tryFaster(shark2::Shark2Engine &engine, State &state) {
+  size_t tier = engine.getQualityTier();
+  if (tier == 0)
+    return;
+
+  engine.setQualityTier(tier - 1);
+  if (engine.getQualityTier() != tier - 1)
+    return; // Dropped by a lexicon change; the next drift check retries
+  if (benchmark(engine, state) > calib_config::TARGET_P99_US) {
+    engine.setQualityTier(tier); // Not affordable after all
+  }
+}
+
+// ============================================================================
+// Public Interface
+// ============================================================================
+
+void TierCalibrator::start(std::vector<std::string> words) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->words = std::move(words);
+  }
+  if (state_->busy.exchange(true))
+    return;
+  launchCalibration();
+}
+
+void TierCalibrator::launchCalibration() {
+  auto state = state_;
+  auto &engine = engine_;
+  pool_.submit([state, &engine]() {
+    calibrate(engine, *state);
+    state->busy = false;
+  });
+}
+
+void TierCalibrator::recordLive(long long us) {
+  if (live_.size() < calib_config::LIVE_WINDOW) {
+    live_.push_back(us);
+  } else {
+    live_[liveNext_] = us;
+  }
+  liveNext_ = (liveNext_ + 1) % calib_config::LIVE_WINDOW;
+
+  // Evaluate drift once per full window of fresh samples
+  if (++liveSinceCheck_ < calib_config::MIN_LIVE_SAMPLES)
+    return;
+  liveSinceCheck_ = 0;
+  if (!state_->calibrated) {
+    // The last calibration was cut short (or is still running)
+    if (!state_->busy.exchange(true))
+      launchCalibration();
+    return;
+  }
+
+  long long live = liveP99();
+  const auto target = static_cast<double>(calib_config::TARGET_P99_US);
+  bool slower = live > target * calib_config::DRIFT_SLOWER;
+  bool faster = live < target * calib_config::DRIFT_FASTER;
+  if (!slower && !faster)
+    return;
+  if (state_->busy.exchange(true))
+    return;
+
+  // Samples taken at the old tier say nothing about the new one
+  live_.clear();
+  liveNext_ = 0;
+
+  auto state = state_;
+  auto &engine = engine_;
+  pool_.submit([state, &engine, slower]() {
+    if (slower) {
+      size_t tier = engine.getQualityTier();
+      if (tier + 1 < shark2::config::QUALITY_TIER_COUNT)
+        engine.setQualityTier(tier + 1);
+    } else {
+      tryFaster(engine, *state);
+    }
+    state->busy = false;
+  });
+}
+
+long long TierCalibrator::liveP99() const { return p99(live_); }
+
+void TierCalibrator::writeStatus(ipc::MessageWriter &out) const {
+  long long bench;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    bench = state_->benchP99Us;
+  }
+  size_t tier = engine_.getQualityTier();
+
+  out.str("tier", shark2::config::QUALITY_TIERS[tier].name)
+      .boolean("calibrated", state_->calibrated)
+      .num("target_p99_us", calib_config::TARGET_P99_US)
+      .num("bench_p99_us", bench)
+      .num("live_p99_us", liveP99());
+}
+
+} // namespace magickeyboard
@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * Magic Keyboard - Decoder Quality Tier Self-Calibration
+ *
+ * The same build runs on fast desktops and on a Steam Deck in power-save
+ * mode. At startup a short synthetic benchmark (SHARK2 decodes of jittered
+ * letter-to-letter paths for common words) runs on the decode pool and
+ * steps the engine down through shark2::config::QUALITY_TIERS until the
+ * p99 decode latency meets TARGET_P99_US. A step that a concurrent
+ * lexicon change drops leaves the calibrator uncalibrated, and it runs
+ * again after the next window of live samples.
+ *
+ * Afterwards live SHARK2 latencies are fed back in. If their p99 drifts
+ * well above target the tier drops one step; if it stays well below, the
+ * next tier up is re-benchmarked and kept only if it meets the target.
+ */
+
+#include "json_lines.h"
+#include "shark2.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace magickeyboard {
+
+class DecodePool;
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+namespace calib_config {
+// Decode latency the tier must meet at p99 (inside the 8ms SHARK2 budget)
+constexpr long long TARGET_P99_US = 6000;
+// Synthetic swipes per benchmark round
+constexpr size_t BENCH_SWIPES = 32;
+// Live samples kept for drift detection
+constexpr size_t LIVE_WINDOW = 128;
+// Live samples needed before drift is evaluated
+constexpr size_t MIN_LIVE_SAMPLES = 64;
+// Live p99 above TARGET * DRIFT_SLOWER drops a tier
+constexpr double DRIFT_SLOWER = 1.25;
+// Live p99 below TARGET * DRIFT_FASTER tries the next tier up
+constexpr double DRIFT_FASTER = 0.35;
+} // namespace calib_config
+
+// ============================================================================
+// Tier Calibrator
+// ============================================================================
+
+class TierCalibrator {
+public:
+  TierCalibrator(shark2::Shark2Engine &engine, DecodePool &pool);
+
+  // Benchmark in the background and pick a tier. words are common
+  // dictionary words used to synthesize swipes.
+  void start(std::vector<std::string> words);
+
+  // Feed a live SHARK2 decode latency (main thread)
+  void recordLive(long long us);
+
+  // Current tier, benchmark and live p99, as fields of out's message
+  void writeStatus(ipc::MessageWriter &out) const;
+
+private:
+  // Shared with pool tasks so a benchmark still running at shutdown never
+  // touches a destroyed calibrator
+  struct State {
+    std::mutex mutex;
+    std::vector<std::string> words;
+    long long benchP99Us = -1;
+    std::atomic<bool> busy{false};
+    std::atomic<bool> calibrated{false};
+  };
+
+  static long long benchmark(shark2::Shark2Engine &engine, State &state);
+  static void calibrate(shark2::Shark2Engine &engine, State &state);
+  static void tryFaster(shark2::Shark2Engine &engine, State &state);
+  // Run calibrate() on the pool; busy must already be claimed
+  void launchCalibration();
+
+  long long liveP99() const;
+
+  shark2::Shark2Engine &engine_;
+  DecodePool &pool_;
+  std::shared_ptr<State> state_;
+
+  // Live latency ring, main thread only
+  std::vector<long long> live_;
+  size_t liveNext_ = 0;
+  size_t liveSinceCheck_ = 0;
+};
+
+} // namespace magickeyboard
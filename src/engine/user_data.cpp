@@ -39,11 +39,12 @@ std::string UserDataManager::getDataPath() const {
 // ============================================================================
 
 bool UserDataManager::load() {
-  std::lock_guard<std::mutex> lock(mutex_);
-
+  // Parsed without the lock and swapped in, so a reload never holds up
+  // the lookups decode workers make
   std::ifstream file(getDataPath(), std::ios::binary);
   if (!file.is_open()) {
     // No learned data yet - start fresh
+    std::lock_guard<std::mutex> lock(mutex_);
     loaded_ = true;
     return true;
   }
@@ -53,6 +54,7 @@ bool UserDataManager::load() {
   file.read(magic, 4);
   if (std::strncmp(magic, "MKLD", 4) != 0) {
     // Invalid or corrupt file - start fresh
+    std::lock_guard<std::mutex> lock(mutex_);
     loaded_ = true;
     return true;
   }
@@ -62,6 +64,7 @@ bool UserDataManager::load() {
   file.read(reinterpret_cast<char *>(&version), 1);
   if (version != 1) {
     // Unknown version - start fresh
+    std::lock_guard<std::mutex> lock(mutex_);
     loaded_ = true;
     return true;
   }
@@ -71,7 +74,7 @@ bool UserDataManager::load() {
   file.read(reinterpret_cast<char *>(&unigramCount), 4);
 
   // Read unigrams
-  unigrams_.clear();
+  std::unordered_map<std::string, uint32_t> unigrams;
   for (uint32_t i = 0; i < unigramCount && file.good(); ++i) {
     uint16_t len;
     file.read(reinterpret_cast<char *>(&len), 2);
@@ -85,7 +88,7 @@ bool UserDataManager::load() {
     file.read(reinterpret_cast<char *>(&freq), 4);
 
     if (file.good()) {
-      unigrams_[word] = freq;
+      unigrams[word] = freq;
     }
   }
 
@@ -94,7 +97,7 @@ bool UserDataManager::load() {
   file.read(reinterpret_cast<char *>(&bigramCount), 4);
 
   // Read bigrams
-  bigrams_.clear();
+  std::unordered_map<std::string, uint32_t> bigrams;
   for (uint32_t i = 0; i < bigramCount && file.good(); ++i) {
     uint16_t len;
     file.read(reinterpret_cast<char *>(&len), 2);
@@ -108,19 +111,39 @@ bool UserDataManager::load() {
     file.read(reinterpret_cast<char *>(&freq), 4);
 
     if (file.good()) {
-      bigrams_[key] = freq;
+      bigrams[key] = freq;
     }
   }
 
-  // Apply decay to fade old data
-  applyDecay();
+  // Fade old data, once per session: a reload reads back counts that
+  // were already decayed
+  bool first;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    first = !loaded_;
+  }
+  if (first) {
+    applyDecay(unigrams);
+    applyDecay(bigrams);
+  }
 
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Commits since the last save are not in the file (before the first
+  // load: everything typed while it was reading)
+  for (const auto &[word, count] : unsavedUnigrams_)
+    unigrams[word] += count;
+  for (const auto &[key, count] : unsavedBigrams_)
+    bigrams[key] += count;
+  unigrams_.swap(unigrams);
+  bigrams_.swap(bigrams);
   loaded_ = true;
   return true;
 }
 
 bool UserDataManager::save() {
   std::lock_guard<std::mutex> lock(mutex_);
+  if (!loaded_)
+    return false; // Would replace the file with this session's commits only
 
   // Ensure directory exists
   SettingsManager::instance().load(); // This ensures dir exists
@@ -163,8 +186,12 @@ bool UserDataManager::save() {
     file.write(reinterpret_cast<char *>(&f), 4);
   }
 
+  if (!file.good())
+    return false;
   commitsSinceLastSave_ = 0;
-  return file.good();
+  unsavedUnigrams_.clear();
+  unsavedBigrams_.clear();
+  return true;
 }
 
 // ============================================================================
@@ -187,6 +214,7 @@ void UserDataManager::recordCommit(const std::string &word,
 
     // Record unigram
     unigrams_[normalizedWord]++;
+    unsavedUnigrams_[normalizedWord]++;
 
     // Record bigram if we have context
     std::string prev = previousWord;
@@ -201,6 +229,7 @@ void UserDataManager::recordCommit(const std::string &word,
       }
       std::string bigramKey = normalizedPrev + "|" + normalizedWord;
       bigrams_[bigramKey]++;
+      unsavedBigrams_[bigramKey]++;
     }
 
     lastWord_ = normalizedWord;
@@ -236,6 +265,28 @@ double UserDataManager::getUnigramBoost(const std::string &word) const {
          learn_config::UNIGRAM_WEIGHT;
 }
 
+uint32_t UserDataManager::getWordCount(const std::string &word) const {
+  std::string normalized = word;
+  for (char &c : normalized) {
+    c = std::tolower(static_cast<unsigned char>(c));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = unigrams_.find(normalized);
+  return it == unigrams_.end() ? 0 : it->second;
+}
+
+std::vector<std::string>
+UserDataManager::getWordsWithCount(uint32_t minCount) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> words;
+  for (const auto &[word, count] : unigrams_) {
+    if (count >= minCount)
+      words.push_back(word);
+  }
+  return words;
+}
+
 double UserDataManager::getBigramBoost(const std::string &word,
                                        const std::string &previousWord) const {
   if (word.empty() || previousWord.empty())
@@ -286,10 +337,51 @@ std::string UserDataManager::getLastWord() const {
   return lastWord_;
 }
 
+bool UserDataManager::forgetWord(const std::string &word) {
+  std::string normalized = word;
+  for (char &c : normalized) {
+    c = std::tolower(static_cast<unsigned char>(c));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool found = unigrams_.erase(normalized) > 0;
+    unsavedUnigrams_.erase(normalized);
+
+    auto mentions = [&](const std::string &key) {
+      size_t bar = key.find('|');
+      return bar != std::string::npos &&
+             (key.compare(0, bar, normalized) == 0 ||
+              key.compare(bar + 1, std::string::npos, normalized) == 0);
+    };
+    for (auto *table : {&bigrams_, &unsavedBigrams_}) {
+      for (auto it = table->begin(); it != table->end();) {
+        if (mentions(it->first)) {
+          found = true;
+          it = table->erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    if (lastWord_ == normalized) {
+      lastWord_.clear();
+    }
+    if (!found) {
+      return false;
+    }
+  }
+
+  save();
+  return true;
+}
+
 void UserDataManager::reset() {
   std::lock_guard<std::mutex> lock(mutex_);
   unigrams_.clear();
   bigrams_.clear();
+  unsavedUnigrams_.clear();
+  unsavedBigrams_.clear();
   lastWord_.clear();
   commitsSinceLastSave_ = 0;
 
@@ -344,33 +436,18 @@ void UserDataManager::pruneIfNeeded() {
   }
 }
 
-void UserDataManager::applyDecay() {
-  // Note: mutex already held by caller (load)
-
-  for (auto &[word, freq] : unigrams_) {
+void UserDataManager::applyDecay(
+    std::unordered_map<std::string, uint32_t> &counts) {
+  for (auto &[key, freq] : counts) {
     freq = static_cast<uint32_t>(freq * learn_config::DECAY_FACTOR);
     if (freq == 0)
       freq = 1; // Keep entry but minimal
   }
 
-  for (auto &[key, freq] : bigrams_) {
-    freq = static_cast<uint32_t>(freq * learn_config::DECAY_FACTOR);
-    if (freq == 0)
-      freq = 1;
-  }
-
   // Remove entries that decayed to minimal
-  for (auto it = unigrams_.begin(); it != unigrams_.end();) {
-    if (it->second <= 1) {
-      it = unigrams_.erase(it);
-    } else {
-      ++it;
-    }
-  }
-
-  for (auto it = bigrams_.begin(); it != bigrams_.end();) {
+  for (auto it = counts.begin(); it != counts.end();) {
     if (it->second <= 1) {
-      it = bigrams_.erase(it);
+      it = counts.erase(it);
     } else {
       ++it;
     }
@@ -15,6 +15,7 @@
  * - No neural networks, no background training
  */
 
+#include <cstdint>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -37,8 +38,13 @@ constexpr double UNIGRAM_WEIGHT = 2.5;
 constexpr double BIGRAM_WEIGHT = 1.8;
 // Auto-save interval (number of commits between saves)
 constexpr int AUTO_SAVE_INTERVAL = 10;
-// Decay factor for old entries (applied on load to fade stale data)
+// Decay factor for old entries (applied on the first load of a session
+// to fade stale data)
 constexpr double DECAY_FACTOR = 0.95;
+// Commits of a word before its swipes are learned as a personal template
+constexpr uint32_t TEMPLATE_MIN_COMMITS = 3;
+// Commits of an out-of-dictionary word before it becomes swipeable
+constexpr uint32_t OVERLAY_MIN_COMMITS = 2;
 } // namespace learn_config
 
 // ============================================================================
@@ -50,10 +56,13 @@ public:
   // Get singleton instance
   static UserDataManager &instance();
 
-  // Load user data from disk
+  // Load user data from disk, replacing what is in memory. Commits not
+  // yet saved are added on top, and stale counts are decayed on the
+  // first load only, so calling it again to pick up an edited file loses
+  // nothing.
   bool load();
 
-  // Save user data to disk
+  // Save user data to disk (refused until the first load)
   bool save();
 
   // Called when a word is explicitly committed by the user
@@ -64,6 +73,12 @@ public:
   // Get unigram boost score for a word (0.0 if unknown)
   double getUnigramBoost(const std::string &word) const;
 
+  // Raw commit count for a word (0 if unknown)
+  uint32_t getWordCount(const std::string &word) const;
+
+  // Words committed at least minCount times
+  std::vector<std::string> getWordsWithCount(uint32_t minCount) const;
+
   // Get bigram boost score for word given previous context
   double getBigramBoost(const std::string &word,
                         const std::string &previousWord) const;
@@ -75,6 +90,10 @@ public:
   // Get the last committed word (for bigram context)
   std::string getLastWord() const;
 
+  // Drop a word's counts and every bigram it is part of, and save so a
+  // reload does not bring it back. Returns false if it was never learned.
+  bool forgetWord(const std::string &word);
+
   // Reset all learned data
   void reset();
 
@@ -93,8 +112,8 @@ private:
   // Prune old entries if over limit
   void pruneIfNeeded();
 
-  // Apply decay to all entries
-  void applyDecay();
+  // Apply decay to all entries of a unigram or bigram table
+  static void applyDecay(std::unordered_map<std::string, uint32_t> &counts);
 
   mutable std::mutex mutex_;
 
@@ -106,6 +125,10 @@ private:
   // Last committed word for context
   std::string lastWord_;
 
+  // Counts recorded since the last save, added back over a load
+  std::unordered_map<std::string, uint32_t> unsavedUnigrams_;
+  std::unordered_map<std::string, uint32_t> unsavedBigrams_;
+
   // Dirty flag and commit counter for auto-save
   int commitsSinceLastSave_ = 0;
   bool loaded_ = false;
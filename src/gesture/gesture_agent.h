@@ -8,6 +8,8 @@
  */
 #pragma once
 
+#include "key_grid.h"
+
 #include <chrono>
 #include <cmath>
 #include <functional>
@@ -214,6 +216,7 @@ private:
 
   // Key layout
   std::vector<Key> keys_;
+  KeyGrid keyGrid_; // Hit-test index over keys_
 
   // Current state
   GestureState state_ = GestureState::Idle;
@@ -253,6 +256,14 @@ inline void GestureAgent::setConfig(const GestureConfig &config) {
 
 inline void GestureAgent::setKeys(const std::vector<Key> &keys) {
   keys_ = keys;
+
+  std::vector<KeyGrid::Box> boxes;
+  boxes.reserve(keys_.size());
+  for (const auto &k : keys_) {
+    boxes.push_back({k.rect.x, k.rect.y, k.rect.w, k.rect.h, k.center.x,
+                     k.center.y});
+  }
+  keyGrid_.build(std::move(boxes));
 }
 
 inline void GestureAgent::pointerDown(const Point &windowPos,
@@ -384,26 +395,9 @@ inline bool GestureAgent::shouldAddSample(const PathPoint &candidate) const {
 }
 
 inline const Key *GestureAgent::findNearestKey(const Point &p) const {
-  const Key *best = nullptr;
-  double bestDistSq = 1e18;
-
-  // Priority 1: Inside rect
-  for (const auto &k : keys_) {
-    if (k.rect.contains(p)) {
-      return &k;
-    }
-  }
-
-  // Priority 2: Nearest center
-  for (const auto &k : keys_) {
-    double d2 = k.center.distanceSquaredTo(p);
-    if (d2 < bestDistSq) {
-      bestDistSq = d2;
-      best = &k;
-    }
-  }
-
-  return best;
+  // Priority 1: Inside rect; Priority 2: Nearest center
+  auto hit = keyGrid_.find(p.x, p.y);
+  return hit.index < 0 ? nullptr : &keys_[hit.index];
 }
 
 inline bool GestureAgent::shouldSwitchKey(const Key *current,
@@ -0,0 +1,187 @@
+/**
+ * Magic Keyboard - Key Hit-Test Grid
+ *
+ * Answers "which key contains this point, or else whose center is nearest"
+ * for the path mappers (GestureAgent, swipe::SwipeEngine and the engine's
+ * key-sequence decoder) without scanning every key for every sample.
+ *
+ * The layout bounding box, plus a margin, is cut into uniform cells about
+ * half a key across. Each cell lists, in layout order, the keys whose rect
+ * touches it and every key that can be the nearest center for some point
+ * in it. A key whose center is further from the cell than another key's
+ * farthest-corner distance can never win there, so it is left out. A
+ * lookup returns exactly what a full scan would while checking a handful
+ * of keys. Points outside the grid fall back to the full scan.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace magickeyboard {
+namespace gesture {
+
+class KeyGrid {
+public:
+  // Key geometry in layout space
+  struct Box {
+    double x = 0, y = 0, w = 0, h = 0; // Hit rect
+    double cx = 0, cy = 0;             // Center used for distances
+  };
+
+  struct Hit {
+    int index = -1;      // Into the boxes given to build(); -1 if no keys
+    bool inside = false; // Point lies in the key's rect
+    double distSq = 0;   // Squared distance to the key's center
+  };
+
+  // Build from keys in layout order; rebuild whenever the layout changes
+  void build(std::vector<Box> boxes);
+  void clear() { build({}); }
+
+  bool empty() const { return boxes_.empty(); }
+
+  // First key (layout order) whose rect contains the point; otherwise the
+  // nearest center, the earlier key winning ties
+  Hit find(double x, double y) const;
+
+private:
+  // Cells are capped so a layout with tiny keys cannot blow up the table
+  static constexpr int MAX_CELLS = 4096;
+
+  Hit scan(double x, double y, const uint16_t *begin,
+           const uint16_t *end) const;
+
+  std::vector<Box> boxes_;
+  std::vector<uint16_t> allKeys_; // Fallback list: every key
+
+  // Per-cell key lists, flattened: cell i is
+  // cellKeys_[cellStart_[i] .. cellStart_[i + 1])
+  std::vector<uint32_t> cellStart_;
+  std::vector<uint16_t> cellKeys_;
+
+  double originX_ = 0, originY_ = 0, cellSize_ = 1;
+  int cols_ = 0, rows_ = 0;
+};
+
+// ============================================================================
+// Implementation
+// ============================================================================
+
+inline void KeyGrid::build(std::vector<Box> boxes) {
+  boxes_ = std::move(boxes);
+  allKeys_.clear();
+  cellStart_.assign(1, 0);
+  cellKeys_.clear();
+  cols_ = rows_ = 0;
+  if (boxes_.empty())
+    return;
+
+  for (size_t i = 0; i < boxes_.size(); ++i)
+    allKeys_.push_back(static_cast<uint16_t>(i));
+
+  double minX = boxes_[0].x, minY = boxes_[0].y;
+  double maxX = boxes_[0].x + boxes_[0].w, maxY = boxes_[0].y + boxes_[0].h;
+  double smallest = std::min(boxes_[0].w, boxes_[0].h);
+  double largest = std::max(boxes_[0].w, boxes_[0].h);
+  for (const auto &b : boxes_) {
+    minX = std::min(minX, b.x);
+    minY = std::min(minY, b.y);
+    maxX = std::max(maxX, b.x + b.w);
+    maxY = std::max(maxY, b.y + b.h);
+    smallest = std::min(smallest, std::min(b.w, b.h));
+    largest = std::max(largest, std::max(b.w, b.h));
+  }
+
+  // Samples just off the keyboard edge are common; one key of margin
+  double margin = std::max(largest, 1.0);
+  originX_ = minX - margin;
+  originY_ = minY - margin;
+  double spanX = maxX - minX + 2 * margin;
+  double spanY = maxY - minY + 2 * margin;
+
+  cellSize_ = std::max(smallest / 2, 1.0);
+  while (std::ceil(spanX / cellSize_) * std::ceil(spanY / cellSize_) >
+         MAX_CELLS)
+    cellSize_ *= 2;
+  cols_ = static_cast<int>(std::ceil(spanX / cellSize_));
+  rows_ = static_cast<int>(std::ceil(spanY / cellSize_));
+
+  cellStart_.reserve(static_cast<size_t>(cols_) * rows_ + 1);
+  for (int row = 0; row < rows_; ++row) {
+    for (int col = 0; col < cols_; ++col) {
+      double x0 = originX_ + col * cellSize_, x1 = x0 + cellSize_;
+      double y0 = originY_ + row * cellSize_, y1 = y0 + cellSize_;
+
+      // Nearest center can be no further than the best worst case
+      double bound = 1e300;
+      for (const auto &b : boxes_) {
+        double dx = std::max(std::abs(b.cx - x0), std::abs(b.cx - x1));
+        double dy = std::max(std::abs(b.cy - y0), std::abs(b.cy - y1));
+        bound = std::min(bound, dx * dx + dy * dy);
+      }
+
+      for (size_t i = 0; i < boxes_.size(); ++i) {
+        const auto &b = boxes_[i];
+        bool touches =
+            b.x <= x1 && b.x + b.w >= x0 && b.y <= y1 && b.y + b.h >= y0;
+        // A key covering the whole cell answers every point in it; no
+        // later key can matter
+        if (b.x <= x0 && b.x + b.w >= x1 && b.y <= y0 && b.y + b.h >= y1) {
+          size_t first = cellStart_.back();
+          cellKeys_.erase(
+              std::remove_if(cellKeys_.begin() + first, cellKeys_.end(),
+                             [&](uint16_t k) {
+                               const auto &o = boxes_[k];
+                               return !(o.x <= x1 && o.x + o.w >= x0 &&
+                                        o.y <= y1 && o.y + o.h >= y0);
+                             }),
+              cellKeys_.end());
+          cellKeys_.push_back(static_cast<uint16_t>(i));
+          break;
+        }
+        double dx = std::max({x0 - b.cx, 0.0, b.cx - x1});
+        double dy = std::max({y0 - b.cy, 0.0, b.cy - y1});
+        if (touches || dx * dx + dy * dy <= bound * (1 + 1e-9))
+          cellKeys_.push_back(static_cast<uint16_t>(i));
+      }
+      cellStart_.push_back(static_cast<uint32_t>(cellKeys_.size()));
+    }
+  }
+}
+
+inline KeyGrid::Hit KeyGrid::scan(double x, double y, const uint16_t *begin,
+                                  const uint16_t *end) const {
+  Hit hit;
+  for (const uint16_t *it = begin; it != end; ++it) {
+    const auto &b = boxes_[*it];
+    if (x >= b.x && x <= b.x + b.w && y >= b.y && y <= b.y + b.h) {
+      double dx = b.cx - x, dy = b.cy - y;
+      return {*it, true, dx * dx + dy * dy};
+    }
+  }
+  for (const uint16_t *it = begin; it != end; ++it) {
+    const auto &b = boxes_[*it];
+    double dx = b.cx - x, dy = b.cy - y;
+    double d2 = dx * dx + dy * dy;
+    if (hit.index < 0 || d2 < hit.distSq)
+      hit = {*it, false, d2};
+  }
+  return hit;
+}
+
+inline KeyGrid::Hit KeyGrid::find(double x, double y) const {
+  int col = static_cast<int>(std::floor((x - originX_) / cellSize_));
+  int row = static_cast<int>(std::floor((y - originY_) / cellSize_));
+  if (col < 0 || col >= cols_ || row < 0 || row >= rows_) {
+    return scan(x, y, allKeys_.data(), allKeys_.data() + allKeys_.size());
+  }
+  size_t cell = static_cast<size_t>(row) * cols_ + col;
+  return scan(x, y, cellKeys_.data() + cellStart_[cell],
+              cellKeys_.data() + cellStart_[cell + 1]);
+}
+
+} // namespace gesture
+} // namespace magickeyboard
@@ -0,0 +1,311 @@
+#pragma once
+
+/**
+ * Magic Keyboard IPC - Binary Frames
+ *
+ * Compact encodings for the two high-rate UI → engine messages, key taps
+ * and swipe paths. A swipe as JSON is ~30 bytes per point that the UI
+ * formats and the engine parses back; as a frame it is 4-6 bytes per
+ * point copied in and out.
+ *
+ * Frames share the socket with JSON lines. Every frame starts with MARK,
+ * a byte that can begin neither a JSON object nor any UTF-8 text, so the
+ * reader tells them apart by the first byte. All integers and floats are
+ * little-endian.
+ *
+ * Negotiation: the UI offers {"type":"hello","role":"ui","frames":1}; an
+ * engine that understands frames answers {"type":"frames","version":1}
+ * and from then on accepts them from that client. Until the answer
+ * arrives, or if it never does (older engine), the UI keeps sending JSON.
+ * Anything a frame cannot carry (a key with no code, an oversized swipe)
+ * is still sent as JSON.
+ *
+ * Key frame (4 bytes):
+ *   MARK, Type::Key, key code, 0
+ *   Codes 0x20-0x7E are that single character; 0x80 and up are the named
+ *   keys in keyNames().
+ *
+ * Swipe frame (12-byte header, points, keys):
+ *   0  MARK
+ *   1  Type::SwipeF32 or Type::SwipeI16
+ *   2  layout id (layoutName())
+ *   3  flags (HAS_TIMES)
+ *   4  u32 seq
+ *   8  u16 point count
+ *   10 u8  key count
+ *   11 0
+ *   12 points: x, y[, t] per point
+ *      SwipeF32: float32 layout px / ms
+ *      SwipeI16: int16 deltas from the previous point (the first from
+ *                zero), x and y in 1/I16_SCALE px, t in whole ms
+ *   .. keys: one ASCII byte each (the UI's key trail, "ui_keys")
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_lines.h"
+
+namespace magickeyboard::ipc::frame {
+
+constexpr int VERSION = 1;
+constexpr uint8_t MARK = 0xFE;
+
+enum class Type : uint8_t { Key = 1, SwipeF32 = 2, SwipeI16 = 3 };
+
+constexpr uint8_t HAS_TIMES = 0x01;
+
+constexpr size_t KEY_BYTES = 4;
+constexpr size_t SWIPE_HEADER_BYTES = 12;
+constexpr size_t MAX_POINTS = 0xFFFF;
+constexpr size_t MAX_KEYS = 0xFF;
+constexpr double I16_SCALE = 4.0; // Quarter-pixel steps
+
+// Returned by frameSize() for bytes that are not a valid frame
+constexpr size_t INVALID = std::numeric_limits<size_t>::max();
+
+// ============================================================================
+// Tables
+// ============================================================================
+
+inline const std::vector<std::string_view>& keyNames() {
+    static const std::vector<std::string_view> names = {
+        "space", "backspace", "enter", "tab", "left", "right", "up", "down"};
+    return names;
+}
+
+// Index 0 means "not given"
+inline const std::vector<std::string_view>& layoutNames() {
+    static const std::vector<std::string_view> names = {"", "qwerty",
+                                                        "qwerty-pointer"};
+    return names;
+}
+
+inline uint8_t layoutId(std::string_view name) {
+    const auto& names = layoutNames();
+    for (size_t i = 1; i < names.size(); ++i)
+        if (names[i] == name)
+            return static_cast<uint8_t>(i);
+    return 0;
+}
+
+inline std::string_view layoutName(uint8_t id) {
+    const auto& names = layoutNames();
+    return id < names.size() ? names[id] : std::string_view();
+}
+
+// ============================================================================
+// Byte helpers
+// ============================================================================
+
+namespace detail {
+
+inline void putU16(std::string& out, uint16_t v) {
+    out += static_cast<char>(v & 0xFF);
+    out += static_cast<char>(v >> 8);
+}
+
+inline void putU32(std::string& out, uint32_t v) {
+    for (int shift = 0; shift < 32; shift += 8)
+        out += static_cast<char>((v >> shift) & 0xFF);
+}
+
+inline void putF32(std::string& out, double v) {
+    float f = static_cast<float>(v);
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    putU32(out, bits);
+}
+
+inline uint16_t getU16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t getU32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline float getF32(const unsigned char* p) {
+    uint32_t bits = getU32(p);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline size_t pointBytes(Type type, uint8_t flags) {
+    size_t fields = (flags & HAS_TIMES) ? 3 : 2;
+    return fields * (type == Type::SwipeF32 ? 4 : 2);
+}
+
+} // namespace detail
+
+// ============================================================================
+// Encoders
+// ============================================================================
+
+// Append a key frame. False (nothing appended) if the key has no code.
+inline bool encodeKey(std::string& out, std::string_view key) {
+    uint8_t code = 0;
+    if (key.size() == 1 && key[0] >= 0x20 && key[0] <= 0x7E) {
+        code = static_cast<uint8_t>(key[0]);
+    } else {
+        const auto& names = keyNames();
+        for (size_t i = 0; i < names.size(); ++i)
+            if (names[i] == key)
+                code = static_cast<uint8_t>(0x80 + i);
+    }
+    if (!code)
+        return false;
+    out += static_cast<char>(MARK);
+    out += static_cast<char>(Type::Key);
+    out += static_cast<char>(code);
+    out += '\0';
+    return true;
+}
+
+// Append a swipe frame. Times are sent when every sample has one. keys is
+// the UI's key trail; only single ASCII bytes fit. False (nothing appended)
+// if the swipe does not fit the encoding: too many points or keys, or for
+// SwipeI16 a step too long for an int16.
+inline bool encodeSwipe(std::string& out, Type type, uint32_t seq,
+                        uint8_t layout, const std::vector<PathSample>& points,
+                        std::string_view keys) {
+    if (type == Type::Key || points.size() > MAX_POINTS ||
+        keys.size() > MAX_KEYS)
+        return false;
+    bool hasTimes = !points.empty();
+    for (const auto& p : points)
+        hasTimes = hasTimes && p.t >= 0;
+    uint8_t flags = hasTimes ? HAS_TIMES : 0;
+
+    const size_t start = out.size();
+    out.reserve(start + SWIPE_HEADER_BYTES +
+                points.size() * detail::pointBytes(type, flags) + keys.size());
+    out += static_cast<char>(MARK);
+    out += static_cast<char>(type);
+    out += static_cast<char>(layout);
+    out += static_cast<char>(flags);
+    detail::putU32(out, seq);
+    detail::putU16(out, static_cast<uint16_t>(points.size()));
+    out += static_cast<char>(keys.size());
+    out += '\0';
+
+    if (type == Type::SwipeF32) {
+        for (const auto& p : points) {
+            detail::putF32(out, p.x);
+            detail::putF32(out, p.y);
+            if (hasTimes)
+                detail::putF32(out, p.t);
+        }
+    } else {
+        // Deltas of the quantized values, so rounding never accumulates
+        long prev[3] = {0, 0, 0};
+        for (const auto& p : points) {
+            long q[3] = {std::lround(p.x * I16_SCALE),
+                         std::lround(p.y * I16_SCALE), std::lround(p.t)};
+            for (int f = 0; f < (hasTimes ? 3 : 2); ++f) {
+                long d = q[f] - prev[f];
+                if (d < std::numeric_limits<int16_t>::min() ||
+                    d > std::numeric_limits<int16_t>::max()) {
+                    out.resize(start);
+                    return false;
+                }
+                detail::putU16(out,
+                               static_cast<uint16_t>(static_cast<int16_t>(d)));
+                prev[f] = q[f];
+            }
+        }
+    }
+    out.append(keys.data(), keys.size());
+    return true;
+}
+
+// ============================================================================
+// Decoders
+// ============================================================================
+
+// Size of the frame at the start of data: 0 if more bytes are needed to
+// tell, INVALID if data does not start with a frame.
+inline size_t frameSize(std::string_view data) {
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+    if (data.empty())
+        return 0;
+    if (p[0] != MARK)
+        return INVALID;
+    if (data.size() < 2)
+        return 0;
+    auto type = static_cast<Type>(p[1]);
+    if (type == Type::Key)
+        return KEY_BYTES;
+    if (type != Type::SwipeF32 && type != Type::SwipeI16)
+        return INVALID;
+    if (data.size() < SWIPE_HEADER_BYTES)
+        return 0;
+    return SWIPE_HEADER_BYTES +
+           detail::getU16(p + 8) * detail::pointBytes(type, p[3]) + p[10];
+}
+
+// Key name of a complete key frame, empty if the code is unknown
+inline std::string_view decodeKey(std::string_view frame) {
+    if (frame.size() < KEY_BYTES)
+        return {};
+    auto code = static_cast<uint8_t>(frame[2]);
+    if (code >= 0x20 && code <= 0x7E)
+        return frame.substr(2, 1);
+    const auto& names = keyNames();
+    if (code >= 0x80 && code - 0x80u < names.size())
+        return names[code - 0x80];
+    return {};
+}
+
+struct Swipe {
+    uint32_t seq = 0;
+    uint8_t layout = 0;
+    std::vector<PathSample> points; // t = -1 when not sent
+    std::string keys;
+};
+
+// Decode a complete swipe frame (frameSize() bytes), reusing out's buffers
+inline bool decodeSwipe(std::string_view frame, Swipe& out) {
+    const auto* p = reinterpret_cast<const unsigned char*>(frame.data());
+    if (frame.size() < SWIPE_HEADER_BYTES || frameSize(frame) != frame.size())
+        return false;
+    auto type = static_cast<Type>(p[1]);
+    bool hasTimes = p[3] & HAS_TIMES;
+    size_t count = detail::getU16(p + 8);
+    size_t stride = detail::pointBytes(type, p[3]);
+    out.seq = detail::getU32(p + 4);
+    out.layout = p[2];
+    out.points.resize(count);
+
+    const unsigned char* q = p + SWIPE_HEADER_BYTES;
+    if (type == Type::SwipeF32) {
+        for (auto& s : out.points) {
+            s.x = detail::getF32(q);
+            s.y = detail::getF32(q + 4);
+            s.t = hasTimes ? detail::getF32(q + 8) : -1.0;
+            q += stride;
+        }
+    } else {
+        long acc[3] = {0, 0, 0};
+        for (auto& s : out.points) {
+            for (int f = 0; f < (hasTimes ? 3 : 2); ++f)
+                acc[f] += static_cast<int16_t>(detail::getU16(q + 2 * f));
+            s.x = acc[0] / I16_SCALE;
+            s.y = acc[1] / I16_SCALE;
+            s.t = hasTimes ? static_cast<double>(acc[2]) : -1.0;
+            q += stride;
+        }
+    }
+    out.keys.assign(reinterpret_cast<const char*>(q), p[10]);
+    return true;
+}
+
+} // namespace magickeyboard::ipc::frame
@@ -0,0 +1,205 @@
+/**
+ * Binary Frames Benchmark
+ *
+ * Bytes and CPU per swipe for the three ways the UI can send a path:
+ * a swipe_path JSON line (formatted the way QString::arg() does, parsed
+ * with MessageReader) and the float32 and int16-delta swipe frames.
+ * Paths are smoothed random walks with fractional coordinates, like the
+ * UI's. Also checks that frames round-trip within their precision.
+ * Run: g++ -O2 -std=c++17 binary_frames_bench.cpp -o binary_frames_bench
+ * && ./binary_frames_bench
+ */
+
+#include "binary_frames.h"
+#include "json_lines.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace magickeyboard::ipc;
+
+namespace {
+
+constexpr int SWIPES = 64;
+constexpr int ROUNDS = 50;
+constexpr size_t POINTS_MIN = 60;
+constexpr size_t POINTS_MAX = 500;
+
+std::vector<PathSample> makePath(std::mt19937 &rng) {
+  std::uniform_int_distribution<size_t> length(POINTS_MIN, POINTS_MAX);
+  std::uniform_real_distribution<double> start(50.0, 950.0);
+  std::normal_distribution<double> turn(0.0, 0.15);
+  std::vector<PathSample> path(length(rng));
+  double x = start(rng), y = start(rng) / 3, heading = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    heading += turn(rng);
+    x = std::clamp(x + 4.0 * std::cos(heading), 0.0, 1000.0);
+    y = std::clamp(y + 4.0 * std::sin(heading), 0.0, 330.0);
+    path[i] = {x, y, static_cast<double>(i * 8)};
+  }
+  return path;
+}
+
+// Shortest round-trip formatting, as QString::arg(double) produces
+void appendNumber(std::string &out, double v) {
+  char buf[32];
+  auto res = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, res.ptr);
+}
+
+void encodeJson(std::string &out, long long seq,
+                const std::vector<PathSample> &path) {
+  out = "{\"type\":\"swipe_path\",\"seq\":" + std::to_string(seq) +
+        ",\"layout\":\"qwerty\",\"ui_keys\":[\"h\",\"e\",\"l\",\"o\"],"
+        "\"points\":[";
+  for (size_t i = 0; i < path.size(); ++i) {
+    if (i)
+      out += ',';
+    out += "{\"x\":";
+    appendNumber(out, path[i].x);
+    out += ",\"y\":";
+    appendNumber(out, path[i].y);
+    out += ",\"t\":";
+    appendNumber(out, path[i].t);
+    out += '}';
+  }
+  out += "]}\n";
+}
+
+bool decodeJson(MessageReader &reader, std::string_view line,
+                std::vector<PathSample> &out) {
+  if (!reader.parse(line.substr(0, line.size() - 1)))
+    return false;
+  const auto *points = reader.find("points");
+  return points && parsePoints(points->value, out);
+}
+
+struct Result {
+  double bytes = 0;
+  double encodeUs = 0;
+  double decodeUs = 0;
+  double maxError = 0;
+};
+
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+double maxError(const std::vector<PathSample> &a,
+                const std::vector<PathSample> &b) {
+  if (a.size() != b.size())
+    return INFINITY;
+  double err = 0;
+  for (size_t i = 0; i < a.size(); ++i)
+    err = std::max({err, std::abs(a[i].x - b[i].x), std::abs(a[i].y - b[i].y),
+                    std::abs(a[i].t - b[i].t)});
+  return err;
+}
+
+template <typename Encode, typename Decode>
+Result measure(const std::vector<std::vector<PathSample>> &paths,
+               Encode encode, Decode decode) {
+  Result r;
+  std::vector<std::string> wire(paths.size());
+  std::vector<PathSample> decoded;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; ++round)
+    for (size_t i = 0; i < paths.size(); ++i)
+      encode(wire[i], i, paths[i]);
+  r.encodeUs = elapsedUs(start) / (ROUNDS * paths.size());
+
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; ++round)
+    for (const auto &w : wire)
+      decode(w, decoded);
+  r.decodeUs = elapsedUs(start) / (ROUNDS * paths.size());
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    r.bytes += wire[i].size();
+    if (!decode(wire[i], decoded))
+      r.maxError = INFINITY;
+    else
+      r.maxError = std::max(r.maxError, maxError(paths[i], decoded));
+  }
+  r.bytes /= paths.size();
+  return r;
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(42);
+  std::vector<std::vector<PathSample>> paths;
+  size_t totalPoints = 0;
+  for (int i = 0; i < SWIPES; ++i) {
+    paths.push_back(makePath(rng));
+    totalPoints += paths.back().size();
+  }
+
+  MessageReader reader;
+  Result json = measure(
+      paths,
+      [](std::string &out, size_t seq, const std::vector<PathSample> &p) {
+        encodeJson(out, seq, p);
+      },
+      [&reader](const std::string &in, std::vector<PathSample> &out) {
+        return decodeJson(reader, in, out);
+      });
+
+  frame::Swipe swipe;
+  auto frameDecoder = [&swipe](const std::string &in,
+                               std::vector<PathSample> &out) {
+    if (frame::frameSize(in) != in.size() || !frame::decodeSwipe(in, swipe))
+      return false;
+    out.swap(swipe.points);
+    return true;
+  };
+  auto frameEncoder = [](frame::Type type) {
+    return [type](std::string &out, size_t seq,
+                  const std::vector<PathSample> &p) {
+      out.clear();
+      frame::encodeSwipe(out, type, static_cast<uint32_t>(seq),
+                         frame::layoutId("qwerty"), p, "helo");
+    };
+  };
+  Result f32 = measure(paths, frameEncoder(frame::Type::SwipeF32),
+                       frameDecoder);
+  Result i16 = measure(paths, frameEncoder(frame::Type::SwipeI16),
+                       frameDecoder);
+
+  std::printf("%d swipes, %.0f points on average\n", SWIPES,
+              static_cast<double>(totalPoints) / SWIPES);
+  std::printf("  %-12s %8s %10s %10s %10s\n", "format", "bytes", "encode us",
+              "decode us", "max error");
+  auto row = [&](const char *name, const Result &r) {
+    std::printf("  %-12s %8.0f %10.2f %10.2f %10.4f\n", name, r.bytes,
+                r.encodeUs, r.decodeUs, r.maxError);
+  };
+  row("json", json);
+  row("frame f32", f32);
+  row("frame i16", i16);
+
+  // Key taps
+  std::string keyFrame;
+  frame::encodeKey(keyFrame, "backspace");
+  bool keyOk = frame::frameSize(keyFrame) == keyFrame.size() &&
+               frame::decodeKey(keyFrame) == "backspace";
+  std::printf("  key tap: %zu bytes as JSON, %zu as a frame\n",
+              std::string("{\"type\":\"key\",\"text\":\"a\"}\n").size(),
+              keyFrame.size());
+
+  // float32 keeps ~5e-5 px here; int16 deltas round to 1/(2*I16_SCALE)
+  bool ok = keyOk && json.maxError == 0 && f32.maxError < 1e-3 &&
+            i16.maxError <= 0.5 / frame::I16_SCALE + 1e-9;
+  std::printf("  round trip: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,509 @@
+#pragma once
+
+/**
+ * Magic Keyboard IPC - JSON Lines Reader and Writer
+ *
+ * Every message on the socket is one flat JSON object per line.
+ *
+ * MessageReader tokenizes a line in a single pass and records each
+ * top-level field as a view into the line. Nested arrays and objects are
+ * skipped over and kept as raw spans for the handler that wants them
+ * (swipe points, key lists). Numbers go through std::from_chars. Nothing
+ * is copied except strings that need unescaping. A reader is meant to be
+ * reused, so after the first few messages it stops allocating.
+ *
+ * MessageWriter builds outgoing lines in one reusable buffer and escapes
+ * every string it is given.
+ */
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace magickeyboard::ipc {
+
+// ============================================================================
+// Scanning helpers
+// ============================================================================
+
+namespace json {
+
+inline size_t skipSpace(std::string_view s, size_t i) {
+    while (i < s.size() &&
+           (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n'))
+        i++;
+    return i;
+}
+
+// s[i] is the opening quote. Returns the index just past the closing
+// quote, or npos if unterminated; sets escaped if a backslash was seen.
+inline size_t scanString(std::string_view s, size_t i, bool& escaped) {
+    escaped = false;
+    for (++i; i < s.size(); ++i) {
+        if (s[i] == '\\') {
+            escaped = true;
+            ++i;
+        } else if (s[i] == '"') {
+            return i + 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Index just past the value starting at s[i], or npos if malformed.
+// Arrays and objects are matched by depth, minding strings inside them.
+inline size_t scanValue(std::string_view s, size_t i) {
+    if (i >= s.size())
+        return std::string_view::npos;
+    bool escaped;
+    if (s[i] == '"')
+        return scanString(s, i, escaped);
+    if (s[i] == '[' || s[i] == '{') {
+        int depth = 0;
+        for (; i < s.size(); ++i) {
+            char c = s[i];
+            if (c == '"') {
+                i = scanString(s, i, escaped);
+                if (i == std::string_view::npos)
+                    return i;
+                --i;
+            } else if (c == '[' || c == '{') {
+                depth++;
+            } else if (c == ']' || c == '}') {
+                if (--depth == 0)
+                    return i + 1;
+            }
+        }
+        return std::string_view::npos;
+    }
+    // Number or literal: up to the next delimiter
+    size_t start = i;
+    while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']' &&
+           s[i] != ' ' && s[i] != '\t' && s[i] != '\r' && s[i] != '\n')
+        i++;
+    return i > start ? i : std::string_view::npos;
+}
+
+inline void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xc0 | cp >> 6);
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xe0 | cp >> 12);
+        out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | cp >> 18);
+        out += static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+        out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+}
+
+// Decode the escapes in a string body (without its quotes)
+inline void unescape(std::string_view raw, std::string& out) {
+    out.clear();
+    out.reserve(raw.size());
+    auto hex4 = [&raw](size_t at, uint32_t& v) {
+        if (at + 4 > raw.size())
+            return false;
+        auto r = std::from_chars(raw.data() + at, raw.data() + at + 4, v, 16);
+        return r.ec == std::errc() && r.ptr == raw.data() + at + 4;
+    };
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\' || i + 1 == raw.size()) {
+            out += raw[i];
+            continue;
+        }
+        char e = raw[++i];
+        switch (e) {
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': {
+            uint32_t cp;
+            if (!hex4(i + 1, cp)) {
+                out += e;
+                break;
+            }
+            i += 4;
+            uint32_t low;
+            if (cp >= 0xd800 && cp < 0xdc00 && i + 2 < raw.size() &&
+                raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+                hex4(i + 3, low) && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default: out += e; // \" \\ \/ and anything unknown
+        }
+    }
+}
+
+template <typename T> bool parseNumber(std::string_view raw, T& out) {
+    if (!raw.empty() && raw.front() == '+')
+        raw.remove_prefix(1);
+    T v;
+    auto r = std::from_chars(raw.data(), raw.data() + raw.size(), v);
+    if (r.ec != std::errc() || r.ptr != raw.data() + raw.size())
+        return false;
+    out = v;
+    return true;
+}
+
+} // namespace json
+
+// ============================================================================
+// Reader
+// ============================================================================
+
+class MessageReader {
+public:
+    enum class Kind { String, Number, Literal, Array, Object };
+
+    struct Field {
+        std::string_view key;   // Raw key, without quotes
+        std::string_view value; // String body without quotes, else as-is
+        Kind kind;
+        bool escaped;           // String contains escapes
+    };
+
+    // Tokenize one line. False (and no fields) unless it is an object.
+    bool parse(std::string_view line) {
+        fields_.clear();
+        line_ = line;
+        size_t i = json::skipSpace(line, 0);
+        if (i >= line.size() || line[i] != '{')
+            return false;
+        i = json::skipSpace(line, i + 1);
+        if (i < line.size() && line[i] == '}')
+            return true;
+
+        while (i < line.size()) {
+            if (line[i] != '"')
+                return fail();
+            bool keyEscaped;
+            size_t keyEnd = json::scanString(line, i, keyEscaped);
+            if (keyEnd == std::string_view::npos)
+                return fail();
+            std::string_view key = line.substr(i + 1, keyEnd - i - 2);
+
+            i = json::skipSpace(line, keyEnd);
+            if (i >= line.size() || line[i] != ':')
+                return fail();
+            i = json::skipSpace(line, i + 1);
+
+            size_t valueEnd = json::scanValue(line, i);
+            if (valueEnd == std::string_view::npos)
+                return fail();
+            Field f{key, line.substr(i, valueEnd - i), Kind::Literal, false};
+            switch (line[i]) {
+            case '"':
+                f.kind = Kind::String;
+                f.value = line.substr(i + 1, valueEnd - i - 2);
+                f.escaped = f.value.find('\\') != std::string_view::npos;
+                break;
+            case '[': f.kind = Kind::Array; break;
+            case '{': f.kind = Kind::Object; break;
+            case 't':
+            case 'f':
+            case 'n': f.kind = Kind::Literal; break;
+            default: f.kind = Kind::Number;
+            }
+            fields_.push_back(f);
+
+            i = json::skipSpace(line, valueEnd);
+            if (i < line.size() && line[i] == ',') {
+                i = json::skipSpace(line, i + 1);
+            } else if (i < line.size() && line[i] == '}') {
+                return true;
+            } else {
+                return fail();
+            }
+        }
+        return fail();
+    }
+
+    std::string_view line() const { return line_; }
+    const std::vector<Field>& fields() const { return fields_; }
+
+    // Messages have a handful of fields; a linear scan beats hashing
+    const Field* find(std::string_view key) const {
+        for (const auto& f : fields_) {
+            if (f.key == key)
+                return &f;
+        }
+        return nullptr;
+    }
+
+    // "type" as written (types never need escapes); empty if absent
+    std::string_view type() const {
+        const Field* f = find("type");
+        return f && f->kind == Kind::String ? f->value : std::string_view();
+    }
+
+    // Unescaped string field; false if missing or not a string
+    bool string(std::string_view key, std::string& out) const {
+        const Field* f = find(key);
+        if (!f || f->kind != Kind::String)
+            return false;
+        if (f->escaped)
+            json::unescape(f->value, out);
+        else
+            out.assign(f->value);
+        return true;
+    }
+
+    template <typename T> bool number(std::string_view key, T& out) const {
+        static_assert(std::is_arithmetic_v<T>);
+        const Field* f = find(key);
+        return f && f->kind == Kind::Number && json::parseNumber(f->value, out);
+    }
+
+private:
+    bool fail() {
+        fields_.clear();
+        return false;
+    }
+
+    std::string_view line_;
+    std::vector<Field> fields_;
+};
+
+// ============================================================================
+// Array helpers
+// ============================================================================
+
+// One swipe sample; t (ms since stroke start) is -1 when not sent
+struct PathSample {
+    double x = 0, y = 0, t = -1;
+};
+
+// Parse [{"x":..,"y":..,"t":..},...] into out, reusing its capacity. Other
+// members of the point objects are skipped. False if malformed or a point
+// lacks x or y; out then holds the points before the bad one.
+inline bool parsePoints(std::string_view array,
+                        std::vector<PathSample>& out) {
+    out.clear();
+    size_t i = json::skipSpace(array, 0);
+    if (i >= array.size() || array[i] != '[')
+        return false;
+    i = json::skipSpace(array, i + 1);
+    if (i < array.size() && array[i] == ']')
+        return true;
+
+    while (i < array.size()) {
+        if (array[i] != '{')
+            return false;
+        i = json::skipSpace(array, i + 1);
+        PathSample p;
+        bool hasX = false, hasY = false;
+        while (i < array.size() && array[i] != '}') {
+            if (array[i] != '"')
+                return false;
+            bool escaped;
+            size_t keyEnd = json::scanString(array, i, escaped);
+            if (keyEnd == std::string_view::npos)
+                return false;
+            std::string_view key = array.substr(i + 1, keyEnd - i - 2);
+            i = json::skipSpace(array, keyEnd);
+            if (i >= array.size() || array[i] != ':')
+                return false;
+            i = json::skipSpace(array, i + 1);
+            size_t valueEnd = json::scanValue(array, i);
+            if (valueEnd == std::string_view::npos)
+                return false;
+            std::string_view value = array.substr(i, valueEnd - i);
+            if (key == "x")
+                hasX = json::parseNumber(value, p.x);
+            else if (key == "y")
+                hasY = json::parseNumber(value, p.y);
+            else if (key == "t" && !json::parseNumber(value, p.t))
+                p.t = -1;
+            i = json::skipSpace(array, valueEnd);
+            if (i < array.size() && array[i] == ',')
+                i = json::skipSpace(array, i + 1);
+        }
+        if (i >= array.size() || !hasX || !hasY)
+            return false;
+        out.push_back(p);
+
+        i = json::skipSpace(array, i + 1);
+        if (i < array.size() && array[i] == ',')
+            i = json::skipSpace(array, i + 1);
+        else if (i < array.size() && array[i] == ']')
+            return true;
+        else
+            return false;
+    }
+    return false;
+}
+
+// Raw (still escaped) bodies of the strings in a ["a","b"] array
+inline bool parseStrings(std::string_view array,
+                         std::vector<std::string_view>& out) {
+    out.clear();
+    size_t i = json::skipSpace(array, 0);
+    if (i >= array.size() || array[i] != '[')
+        return false;
+    i = json::skipSpace(array, i + 1);
+    while (i < array.size() && array[i] != ']') {
+        size_t end = json::scanValue(array, i);
+        if (end == std::string_view::npos)
+            return false;
+        if (array[i] == '"')
+            out.push_back(array.substr(i + 1, end - i - 2));
+        i = json::skipSpace(array, end);
+        if (i < array.size() && array[i] == ',')
+            i = json::skipSpace(array, i + 1);
+    }
+    return i < array.size();
+}
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+// Builds one line at a time:
+//   writer.begin("swipe_keys").num("seq", 7).beginArray("keys")
+//         .str("h").str("i").endArray().finish()
+// Calls without a key are array elements.
+class MessageWriter {
+public:
+    MessageWriter& begin(std::string_view type) {
+        buf_.clear();
+        buf_ += '{';
+        needComma_ = false;
+        return str("type", type);
+    }
+
+    MessageWriter& str(std::string_view key, std::string_view value) {
+        this->key(key);
+        quote(value);
+        return *this;
+    }
+    MessageWriter& str(std::string_view value) {
+        separate();
+        quote(value);
+        return *this;
+    }
+
+    template <typename T>
+    MessageWriter& num(std::string_view key, T value) {
+        static_assert(std::is_arithmetic_v<T>);
+        this->key(key);
+        if constexpr (std::is_floating_point_v<T>) {
+            if (!std::isfinite(value)) {
+                buf_ += "null"; // JSON has no inf or nan
+                return *this;
+            }
+        }
+        char tmp[32];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        buf_.append(tmp, r.ptr);
+        return *this;
+    }
+
+    MessageWriter& boolean(std::string_view key, bool value) {
+        this->key(key);
+        buf_ += value ? "true" : "false";
+        return *this;
+    }
+
+    // Value that is already JSON
+    MessageWriter& raw(std::string_view key, std::string_view json) {
+        this->key(key);
+        buf_ += json;
+        return *this;
+    }
+
+    MessageWriter& beginArray(std::string_view key) {
+        this->key(key);
+        buf_ += '[';
+        needComma_ = false;
+        return *this;
+    }
+    MessageWriter& endArray() {
+        buf_ += ']';
+        needComma_ = true;
+        return *this;
+    }
+
+    // Object as an array element
+    MessageWriter& beginObject() {
+        separate();
+        buf_ += '{';
+        needComma_ = false;
+        return *this;
+    }
+    // Object as a field
+    MessageWriter& beginObject(std::string_view key) {
+        this->key(key);
+        buf_ += '{';
+        needComma_ = false;
+        return *this;
+    }
+    MessageWriter& endObject() {
+        buf_ += '}';
+        needComma_ = true;
+        return *this;
+    }
+
+    // Close the message; the line (with '\n') stays valid until begin()
+    const std::string& finish() {
+        buf_ += "}\n";
+        return buf_;
+    }
+
+private:
+    void separate() {
+        if (needComma_)
+            buf_ += ',';
+        needComma_ = true;
+    }
+
+    void key(std::string_view k) {
+        separate();
+        quote(k);
+        buf_ += ':';
+    }
+
+    void quote(std::string_view s) {
+        static constexpr char HEX[] = "0123456789abcdef";
+        buf_ += '"';
+        for (char c : s) {
+            switch (c) {
+            case '"': buf_ += "\\\""; break;
+            case '\\': buf_ += "\\\\"; break;
+            case '\n': buf_ += "\\n"; break;
+            case '\r': buf_ += "\\r"; break;
+            case '\t': buf_ += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    buf_ += "\\u00";
+                    buf_ += HEX[c >> 4];
+                    buf_ += HEX[c & 0xf];
+                } else {
+                    buf_ += c;
+                }
+            }
+        }
+        buf_ += '"';
+    }
+
+    std::string buf_;
+    bool needComma_ = false;
+};
+
+} // namespace magickeyboard::ipc
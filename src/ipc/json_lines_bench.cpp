@@ -0,0 +1,225 @@
+/**
+ * JSON Lines Benchmark
+ *
+ * Compares the single-pass MessageReader against the find/substr/stod
+ * scanning it replaced, on swipe_path lines shaped like the UI's (500
+ * timed points plus ui_keys), and string concatenation against
+ * MessageWriter for the swipe_candidates reply. Checks that both parsers
+ * recover the same points first.
+ * Run: g++ -O2 -std=c++17 json_lines_bench.cpp -o json_lines_bench
+ * && ./json_lines_bench
+ */
+
+#include "json_lines.h"
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace magickeyboard::ipc;
+
+namespace {
+
+constexpr int POINTS = 500;
+constexpr int MESSAGES = 64;
+constexpr int ROUNDS = 50;
+
+struct Parsed {
+  long long seq = 0;
+  std::vector<PathSample> points;
+  std::string keys;
+};
+
+// The scanning the engine used before MessageReader
+void parseOld(const std::string &line, Parsed &out) {
+  out.points.clear();
+  out.keys.clear();
+  size_t seqPos = line.find("\"seq\":");
+  if (seqPos != std::string::npos) {
+    size_t start = seqPos + 6, end = start;
+    while (end < line.size() && std::isdigit(line[end]))
+      end++;
+    out.seq = std::stoll(line.substr(start, end - start));
+  }
+  size_t ptsPos = line.find("\"points\":[");
+  if (ptsPos != std::string::npos) {
+    size_t search = ptsPos + 10;
+    while (true) {
+      size_t objStart = line.find('{', search);
+      if (objStart == std::string::npos)
+        break;
+      size_t xPos = line.find("\"x\":", objStart);
+      size_t yPos = line.find("\"y\":", objStart);
+      if (xPos == std::string::npos || yPos == std::string::npos)
+        break;
+      PathSample p;
+      p.x = std::stod(line.substr(xPos + 4));
+      p.y = std::stod(line.substr(yPos + 4));
+      size_t objEnd = line.find('}', yPos);
+      size_t tPos = line.find("\"t\":", objStart);
+      if (tPos != std::string::npos && tPos < objEnd)
+        p.t = std::stod(line.substr(tPos + 4));
+      out.points.push_back(p);
+      search = objEnd;
+      if (search == std::string::npos)
+        break;
+    }
+  }
+  size_t keysPos = line.find("\"ui_keys\":[");
+  if (keysPos != std::string::npos) {
+    size_t start = keysPos + 11;
+    size_t end = line.find(']', start);
+    std::string arr = line.substr(start, end - start);
+    size_t pos = 0;
+    while ((pos = arr.find('"', pos)) != std::string::npos) {
+      size_t close = arr.find('"', pos + 1);
+      if (close == std::string::npos)
+        break;
+      std::string key = arr.substr(pos + 1, close - pos - 1);
+      if (key.size() == 1)
+        out.keys += key[0];
+      pos = close + 1;
+    }
+  }
+}
+
+void parseNew(MessageReader &reader, std::string_view line,
+              std::vector<std::string_view> &keyViews, Parsed &out) {
+  out.keys.clear();
+  reader.parse(line);
+  reader.number("seq", out.seq);
+  if (const auto *points = reader.find("points"))
+    parsePoints(points->value, out.points);
+  if (const auto *keys = reader.find("ui_keys")) {
+    parseStrings(keys->value, keyViews);
+    for (auto k : keyViews)
+      if (k.size() == 1)
+        out.keys += k[0];
+  }
+}
+
+std::string makeMessage(long long seq, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> coord(0.0, 900.0);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  char num[64];
+  std::string line = "{\"type\":\"swipe_path\",\"seq\":" +
+                     std::to_string(seq) +
+                     ",\"layout\":\"qwerty\",\"space\":\"layout\","
+                     "\"points\":[";
+  for (int i = 0; i < POINTS; ++i) {
+    std::snprintf(num, sizeof(num), "{\"x\":%.4g,\"y\":%.4g,\"t\":%d}",
+                  coord(rng), coord(rng), i * 8);
+    if (i)
+      line += ',';
+    line += num;
+  }
+  line += "],\"ui_keys\":[";
+  for (int i = 0; i < 8; ++i) {
+    if (i)
+      line += ',';
+    line += '"';
+    line += static_cast<char>(letter(rng));
+    line += '"';
+  }
+  line += "]}";
+  return line;
+}
+
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(42);
+  std::vector<std::string> lines;
+  for (int i = 0; i < MESSAGES; ++i)
+    lines.push_back(makeMessage(i, rng));
+
+  // Correctness: same seq, points and keys from both parsers
+  MessageReader reader;
+  std::vector<std::string_view> keyViews;
+  Parsed a, b;
+  size_t mismatches = 0;
+  for (const auto &line : lines) {
+    parseOld(line, a);
+    parseNew(reader, line, keyViews, b);
+    bool same = a.seq == b.seq && a.keys == b.keys &&
+                a.points.size() == b.points.size();
+    for (size_t i = 0; same && i < a.points.size(); ++i)
+      same = a.points[i].x == b.points[i].x &&
+             a.points[i].y == b.points[i].y &&
+             a.points[i].t == b.points[i].t;
+    if (!same)
+      mismatches++;
+  }
+
+  double sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; ++r)
+    for (const auto &line : lines) {
+      parseOld(line, a);
+      sink += a.points.back().x;
+    }
+  double oldUs = elapsedUs(start) / (ROUNDS * MESSAGES);
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; ++r)
+    for (const auto &line : lines) {
+      parseNew(reader, line, keyViews, b);
+      sink += b.points.back().x;
+    }
+  double newUs = elapsedUs(start) / (ROUNDS * MESSAGES);
+
+  // Reply: eight candidates, as the engine sends after a swipe
+  const std::vector<std::pair<std::string, double>> candidates = {
+      {"hello", 0.91}, {"help", 0.82}, {"helm", 0.41}, {"hell", 0.37},
+      {"held", 0.22},  {"hero", 0.18}, {"heel", 0.12}, {"halo", 0.05}};
+  constexpr int REPLIES = 20000;
+  size_t bytes = 0;
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPLIES; ++r) {
+    std::string msg = "{\"type\":\"swipe_candidates\",\"seq\":" +
+                      std::to_string(r) + ",\"candidates\":[";
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      msg += "{\"word\":\"" + candidates[i].first +
+             "\",\"score\":" + std::to_string(candidates[i].second) + "}";
+      if (i < candidates.size() - 1)
+        msg += ",";
+    }
+    msg += "]}\n";
+    bytes += msg.size();
+  }
+  double concatUs = elapsedUs(start) / REPLIES;
+
+  MessageWriter writer;
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPLIES; ++r) {
+    writer.begin("swipe_candidates").num("seq", r).beginArray("candidates");
+    for (const auto &c : candidates)
+      writer.beginObject().str("word", c.first).num("score", c.second)
+          .endObject();
+    bytes += writer.endArray().finish().size();
+  }
+  double writerUs = elapsedUs(start) / REPLIES;
+
+  std::printf("%d swipe_path lines, %d points, %zu bytes each\n", MESSAGES,
+              POINTS, lines[0].size());
+  std::printf("  find/substr/stod: %7.2f us/line\n", oldUs);
+  std::printf("  MessageReader:    %7.2f us/line (%.1fx)\n", newUs,
+              oldUs / newUs);
+  std::printf("swipe_candidates reply, %zu candidates\n", candidates.size());
+  std::printf("  concatenation:    %7.3f us/line\n", concatUs);
+  std::printf("  MessageWriter:    %7.3f us/line (%.1fx)\n", writerUs,
+              concatUs / writerUs);
+  std::printf("  mismatches:       %zu (checksum %.0f, %zu bytes)\n",
+              mismatches, sink, bytes);
+  return mismatches == 0 ? 0 : 1;
+}
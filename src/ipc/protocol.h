@@ -7,12 +7,26 @@
  * magickeyboard-ui (Qt6/QML process).
  * 
  * Transport: Unix Domain Socket
- * Format: JSON Lines (one JSON object per line, newline-delimited)
+ * Format: JSON Lines (one JSON object per line, newline-delimited), plus
+ *         binary frames for keys and swipes once negotiated in "hello"
+ *         (see binary_frames.h)
+ * Lanes:  the stream socket carries everything. A UI that offers "lanes"
+ *         in its hello is told about a second, SOCK_SEQPACKET socket (one
+ *         message per datagram) for key and action messages only. The
+ *         engine reads that lane before every message on the stream, but
+ *         applies a tap in order: after the stream messages already
+ *         buffered when it arrived, and after a swipe still decoding. The
+ *         UI flushes the stream before using the lane (or keeps the key on
+ *         the stream), so whatever it sent earlier is buffered by then.
+ *         The lane also carries the one-time setup of the shared-memory
+ *         swipe sample ring (see sample_ring.h).
  * 
  * This is intentionally simple for v0.1. May migrate to protobuf/capnproto
  * if performance becomes an issue.
  */
 
+#include <cstddef>
+#include <cstdlib>
 #include <string>
 #include <string_view>
 
@@ -20,6 +34,12 @@ namespace magickeyboard::ipc {
 
 // Socket path (in XDG_RUNTIME_DIR)
 constexpr std::string_view SOCKET_NAME = "magic-keyboard.sock";
+// Priority lane for keys and actions (SOCK_SEQPACKET, same directory)
+constexpr std::string_view PRIORITY_SOCKET_NAME = "magic-keyboard-keys.sock";
+constexpr int LANES_VERSION = 1;
+// Largest datagram accepted on the priority lane; key and action messages
+// are a few dozen bytes
+constexpr size_t PRIORITY_MESSAGE_MAX = 512;
 
 /**
  * Message Types
@@ -48,6 +68,9 @@ namespace msg_type {
     constexpr std::string_view CANDIDATE_SELECT = "candidate_select";
     constexpr std::string_view SETTING_UPDATE = "setting_update";
     constexpr std::string_view SETTINGS_REQUEST = "settings_request";
+    constexpr std::string_view SHADOW_SUMMARY = "shadow_summary";
+    constexpr std::string_view STATUS = "status";
+    constexpr std::string_view RELOAD = "reload";
 }
 
 // Engine → UI message types
@@ -88,14 +111,21 @@ namespace action {
  *   {"type":"preedit","text":"hel","cursor":3}
  */
 
-// Helper: get socket path
-inline std::string getSocketPath() {
+// Helper: path of a socket in the runtime directory
+inline std::string getRuntimePath(std::string_view name) {
     const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
     if (runtime_dir) {
-        return std::string(runtime_dir) + "/" + std::string(SOCKET_NAME);
+        return std::string(runtime_dir) + "/" + std::string(name);
     }
     // Fallback to /tmp (less secure but works)
-    return "/tmp/" + std::string(SOCKET_NAME);
+    return "/tmp/" + std::string(name);
+}
+
+// Helper: get socket path
+inline std::string getSocketPath() { return getRuntimePath(SOCKET_NAME); }
+
+inline std::string getPrioritySocketPath() {
+    return getRuntimePath(PRIORITY_SOCKET_NAME);
 }
 
 } // namespace magickeyboard::ipc
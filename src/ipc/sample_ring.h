@@ -0,0 +1,362 @@
+#pragma once
+
+/**
+ * Magic Keyboard IPC - Shared-Memory Sample Ring
+ *
+ * Streams swipe samples from the UI to the engine while the finger is
+ * still moving, without a socket write per pointer event. The UI owns a
+ * single-producer/single-consumer ring in a sealed memfd; the engine maps
+ * the same pages and reads samples in place.
+ *
+ * Wakeups: the engine arms the ring (waiting = 1) only after it has drained
+ * it, and the UI signals the eventfd only when it finds the ring armed. A
+ * burst of samples therefore costs one wakeup however many arrive before
+ * the engine gets to them.
+ *
+ * Setup: once the priority lane is open, the UI sends
+ * {"type":"sample_ring","version":1} on it with the memfd and the eventfd
+ * attached (SCM_RIGHTS). The engine answers {"type":"sample_ring",
+ * "version":1} on the stream socket once it has mapped them; until then
+ * the UI sends swipes as before. At the end of a stroke the UI sends
+ * {"type":"swipe_ring","seq":N,"count":C} on the stream socket instead of
+ * the path, and the engine decodes the samples it collected for stroke N.
+ *
+ * Fallback: if the engine drops the ring (rejected, or found corrupt) it
+ * sends {"type":"sample_ring","version":0}, and the UI goes back to
+ * sending paths. A swipe_ring it can no longer decode is answered with
+ * {"type":"swipe_resend","seq":N}; the UI then sends that stroke's path,
+ * unless it has sent a newer swipe since.
+ *
+ * The engine does not trust the ring's contents: indices are bounds
+ * checked, and the memfd must be sealed against shrinking so the mapping
+ * cannot be truncated under it.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace magickeyboard::ipc {
+
+namespace sample_ring {
+
+constexpr int VERSION = 1;
+constexpr uint32_t MAGIC = 0x4d4b5352; // "MKSR"
+// Samples buffered before the UI falls back to sending the whole path;
+// four seconds at 1000 Hz
+constexpr uint32_t DEFAULT_CAPACITY = 4096;
+constexpr uint32_t MAX_CAPACITY = 1u << 20;
+
+// One pointer sample: layout px, ms since the press, and the swipe seq of
+// the stroke it belongs to
+struct Sample {
+    float x;
+    float y;
+    float t;
+    uint32_t stroke;
+};
+static_assert(sizeof(Sample) == 16);
+
+// Start of the shared mapping; the samples follow it. Producer and
+// consumer indices live on separate cache lines.
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity; // Power of two
+    uint32_t sampleBytes;
+    alignas(64) std::atomic<uint32_t> head; // Next slot the UI writes
+    alignas(64) std::atomic<uint32_t> tail; // Next slot the engine reads
+    std::atomic<uint32_t> waiting;          // Engine asked for a wakeup
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+inline size_t mappingBytes(uint32_t capacity) {
+    return sizeof(Header) + size_t(capacity) * sizeof(Sample);
+}
+
+} // namespace sample_ring
+
+// ============================================================================
+// Producer (UI)
+// ============================================================================
+
+class SampleRingWriter {
+public:
+    SampleRingWriter() = default;
+    SampleRingWriter(const SampleRingWriter&) = delete;
+    SampleRingWriter& operator=(const SampleRingWriter&) = delete;
+    ~SampleRingWriter() { close(); }
+
+    // Create the memfd and eventfd; capacity must be a power of two
+    bool create(uint32_t capacity = sample_ring::DEFAULT_CAPACITY) {
+        close();
+        if (capacity == 0 || (capacity & (capacity - 1)) ||
+            capacity > sample_ring::MAX_CAPACITY)
+            return false;
+        size_t bytes = sample_ring::mappingBytes(capacity);
+
+        memfd_ = memfd_create("magic-keyboard-samples",
+                              MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (memfd_ < 0 || ftruncate(memfd_, bytes) < 0 ||
+            fcntl(memfd_, F_ADD_SEALS,
+                  F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+            close();
+            return false;
+        }
+        void* map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         memfd_, 0);
+        wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (map == MAP_FAILED || wakeFd_ < 0) {
+            if (map != MAP_FAILED)
+                munmap(map, bytes);
+            close();
+            return false;
+        }
+
+        header_ = new (map) sample_ring::Header{};
+        header_->magic = sample_ring::MAGIC;
+        header_->version = sample_ring::VERSION;
+        header_->capacity = capacity;
+        header_->sampleBytes = sizeof(sample_ring::Sample);
+        samples_ = reinterpret_cast<sample_ring::Sample*>(header_ + 1);
+        bytes_ = bytes;
+        head_ = 0;
+        return true;
+    }
+
+    void close() {
+        if (header_)
+            munmap(header_, bytes_);
+        if (memfd_ >= 0)
+            ::close(memfd_);
+        if (wakeFd_ >= 0)
+            ::close(wakeFd_);
+        header_ = nullptr;
+        samples_ = nullptr;
+        memfd_ = wakeFd_ = -1;
+    }
+
+    bool valid() const { return header_ != nullptr; }
+    int memfd() const { return memfd_; }
+    int wakeFd() const { return wakeFd_; }
+
+    // Write one sample; false if the ring is full (the engine fell behind)
+    bool push(const sample_ring::Sample& s) {
+        uint32_t tail = header_->tail.load(std::memory_order_acquire);
+        if (head_ - tail >= header_->capacity)
+            return false;
+        samples_[head_ & (header_->capacity - 1)] = s;
+        head_++;
+        return true;
+    }
+
+    // Make pushed samples visible, waking the engine if it is waiting
+    // (true if it was). The seq_cst pair with SampleRingReader::arm()
+    // ensures one side sees the other: either the engine finds the
+    // samples or we find it armed.
+    bool publish() {
+        header_->head.store(head_, std::memory_order_seq_cst);
+        if (!header_->waiting.exchange(0, std::memory_order_seq_cst))
+            return false;
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t n = write(wakeFd_, &one, sizeof(one));
+        return true;
+    }
+
+private:
+    sample_ring::Header* header_ = nullptr;
+    sample_ring::Sample* samples_ = nullptr;
+    size_t bytes_ = 0;
+    uint32_t head_ = 0;
+    int memfd_ = -1;
+    int wakeFd_ = -1;
+};
+
+// ============================================================================
+// Consumer (engine)
+// ============================================================================
+
+class SampleRingReader {
+public:
+    SampleRingReader() = default;
+    SampleRingReader(const SampleRingReader&) = delete;
+    SampleRingReader& operator=(const SampleRingReader&) = delete;
+    ~SampleRingReader() { detach(); }
+
+    // Map a ring created by SampleRingWriter. Takes ownership of both fds
+    // (they are closed on failure).
+    bool attach(int memfd, int wakeFd) {
+        detach();
+        memfd_ = memfd;
+        wakeFd_ = wakeFd;
+
+        struct stat st;
+        int seals = fcntl(memfd, F_GET_SEALS);
+        if (fstat(memfd, &st) < 0 || seals < 0 || !(seals & F_SEAL_SHRINK) ||
+            size_t(st.st_size) < sizeof(sample_ring::Header)) {
+            detach();
+            return false;
+        }
+        size_t bytes = size_t(st.st_size);
+        void* map =
+            mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (map == MAP_FAILED) {
+            detach();
+            return false;
+        }
+        header_ = static_cast<sample_ring::Header*>(map);
+        bytes_ = bytes;
+
+        // Copy the geometry once; the UI could rewrite it later
+        capacity_ = header_->capacity;
+        if (header_->magic != sample_ring::MAGIC ||
+            header_->version != sample_ring::VERSION ||
+            header_->sampleBytes != sizeof(sample_ring::Sample) ||
+            capacity_ == 0 || (capacity_ & (capacity_ - 1)) ||
+            capacity_ > sample_ring::MAX_CAPACITY ||
+            sample_ring::mappingBytes(capacity_) != bytes) {
+            detach();
+            return false;
+        }
+        samples_ = reinterpret_cast<const sample_ring::Sample*>(header_ + 1);
+        tail_ = header_->tail.load(std::memory_order_acquire);
+        corrupt_ = false;
+        return true;
+    }
+
+    void detach() {
+        if (header_)
+            munmap(header_, bytes_);
+        if (memfd_ >= 0)
+            ::close(memfd_);
+        if (wakeFd_ >= 0)
+            ::close(wakeFd_);
+        header_ = nullptr;
+        samples_ = nullptr;
+        memfd_ = wakeFd_ = -1;
+    }
+
+    bool attached() const { return header_ != nullptr; }
+    int wakeFd() const { return wakeFd_; }
+    // The producer published an impossible head; detach
+    bool corrupt() const { return corrupt_; }
+
+    // Hand the available samples to fn(const Sample*, size_t) where they
+    // lie in the mapping (at most two runs), then return their slots to
+    // the producer. Returns the number of samples consumed.
+    template <typename Fn>
+    size_t consume(Fn&& fn) {
+        if (!header_ || corrupt_)
+            return 0;
+        uint32_t head = header_->head.load(std::memory_order_acquire);
+        uint32_t avail = head - tail_;
+        if (avail > capacity_) {
+            corrupt_ = true;
+            return 0;
+        }
+        if (avail == 0)
+            return 0;
+        uint32_t start = tail_ & (capacity_ - 1);
+        uint32_t first = std::min(avail, capacity_ - start);
+        fn(samples_ + start, size_t(first));
+        if (avail > first)
+            fn(samples_, size_t(avail - first));
+        tail_ = head;
+        header_->tail.store(tail_, std::memory_order_release);
+        return avail;
+    }
+
+    // Ask for a wakeup on the next publish(). False if samples arrived
+    // since the last consume(): consume again instead of sleeping.
+    bool arm() {
+        if (!header_ || corrupt_)
+            return true;
+        header_->waiting.store(1, std::memory_order_seq_cst);
+        return header_->head.load(std::memory_order_seq_cst) == tail_;
+    }
+
+    // Reset the eventfd after a wakeup
+    void clearWake() {
+        uint64_t count;
+        [[maybe_unused]] ssize_t n = read(wakeFd_, &count, sizeof(count));
+    }
+
+private:
+    sample_ring::Header* header_ = nullptr;
+    const sample_ring::Sample* samples_ = nullptr;
+    size_t bytes_ = 0;
+    uint32_t capacity_ = 0;
+    uint32_t tail_ = 0;
+    bool corrupt_ = false;
+    int memfd_ = -1;
+    int wakeFd_ = -1;
+};
+
+// ============================================================================
+// Descriptor passing
+// ============================================================================
+
+// Send data as one message with fds attached (SCM_RIGHTS)
+inline bool sendWithFds(int sock, std::string_view data, const int* fds,
+                        size_t count) {
+    constexpr size_t MAX_FDS = 4;
+    if (count > MAX_FDS)
+        return false;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)] = {};
+    iovec iov{const_cast<char*>(data.data()), data.size()};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    return sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) ==
+           ssize_t(data.size());
+}
+
+// Receive one message into buf, appending any attached fds to fds (the
+// caller owns them). truncated is set if the message or its fds did not
+// fit. Returns what recvmsg() returns.
+inline ssize_t recvWithFds(int sock, char* buf, size_t size,
+                           std::vector<int>& fds, bool& truncated) {
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 4)];
+    iovec iov{buf, size};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n < 0)
+        return n;
+    truncated = msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC);
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            fds.push_back(fd);
+        }
+    }
+    return n;
+}
+
+} // namespace magickeyboard::ipc
@@ -0,0 +1,227 @@
+/**
+ * Sample Ring Benchmark
+ *
+ * Streaming a swipe while it is drawn: 1000 Hz pointer samples delivered
+ * the way Qt does, a few per frame. Compares one swipe_move JSON line
+ * written to the socket per sample against the shared-memory sample ring
+ * (attached over a SOCK_SEQPACKET pair with SCM_RIGHTS, as on the
+ * priority lane). Counts the syscalls the UI makes, the times the engine
+ * wakes up, and checks every sample arrives in order.
+ * Run: g++ -O2 -std=c++17 -pthread sample_ring_bench.cpp
+ * -o sample_ring_bench && ./sample_ring_bench
+ */
+
+#include "json_lines.h"
+#include "sample_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace magickeyboard::ipc;
+
+namespace {
+
+constexpr int STROKES = 20;
+constexpr int SAMPLES_PER_STROKE = 600; // 0.6 s at 1000 Hz
+constexpr int SAMPLES_PER_FRAME = 8;    // Delivered per 8 ms frame
+constexpr auto FRAME = std::chrono::milliseconds(8);
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  long producerSyscalls = 0;
+  long consumerWakeups = 0;
+  double consumerCpuUs = 0; // Time spent handling wakeups
+  bool ok = true;
+};
+
+sample_ring::Sample sampleAt(int stroke, int i) {
+  return {float(100 + i * 0.5), float(50 + std::sin(i * 0.05) * 20),
+          float(i), uint32_t(stroke)};
+}
+
+// Samples are floats on both transports
+bool matches(const PathSample &p, const sample_ring::Sample &s) {
+  return float(p.x) == s.x && float(p.y) == s.y && float(p.t) == s.t;
+}
+
+double elapsedUs(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count();
+}
+
+// Producer paced like pointer events: a frame's worth at a time
+template <typename Emit> void produce(Emit emit) {
+  auto next = Clock::now();
+  for (int stroke = 1; stroke <= STROKES; ++stroke) {
+    for (int i = 0; i < SAMPLES_PER_STROKE; i += SAMPLES_PER_FRAME) {
+      next += FRAME;
+      std::this_thread::sleep_until(next);
+      for (int k = i; k < i + SAMPLES_PER_FRAME; ++k)
+        emit(stroke, k);
+    }
+  }
+}
+
+Result runSocket() {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  Result r;
+  std::thread engine([&] {
+    std::vector<PathSample> path;
+    MessageReader reader;
+    std::string buf;
+    char chunk[4096];
+    int stroke = 0;
+    pollfd pfd{sv[1], POLLIN, 0};
+    while (poll(&pfd, 1, -1) > 0) {
+      auto start = Clock::now();
+      ssize_t n = read(sv[1], chunk, sizeof(chunk));
+      if (n <= 0)
+        break;
+      r.consumerWakeups++;
+      buf.append(chunk, n);
+      size_t begin = 0, nl;
+      while ((nl = buf.find('\n', begin)) != std::string::npos) {
+        reader.parse(std::string_view(buf).substr(begin, nl - begin));
+        int s = 0;
+        PathSample p;
+        reader.number("stroke", s);
+        reader.number("x", p.x);
+        reader.number("y", p.y);
+        reader.number("t", p.t);
+        if (s != stroke) {
+          stroke = s;
+          path.clear();
+        }
+        path.push_back(p);
+        if (!matches(p, sampleAt(stroke, int(path.size()) - 1)))
+          r.ok = false;
+        begin = nl + 1;
+      }
+      buf.erase(0, begin);
+      r.consumerCpuUs += elapsedUs(start);
+    }
+    r.ok = r.ok && path.size() == SAMPLES_PER_STROKE;
+  });
+
+  char line[128];
+  produce([&](int stroke, int i) {
+    sample_ring::Sample s = sampleAt(stroke, i);
+    int len = std::snprintf(line, sizeof(line),
+                            "{\"type\":\"swipe_move\",\"stroke\":%d,"
+                            "\"x\":%.9g,\"y\":%.9g,\"t\":%.9g}\n",
+                            stroke, s.x, s.y, s.t);
+    if (write(sv[0], line, len) != len)
+      r.ok = false;
+    r.producerSyscalls++;
+  });
+  close(sv[0]);
+  engine.join();
+  close(sv[1]);
+  return r;
+}
+
+Result runRing() {
+  Result r;
+  SampleRingWriter writer;
+  SampleRingReader reader;
+  if (!writer.create()) {
+    r.ok = false;
+    return r;
+  }
+
+  // Setup as on the priority lane: the fds travel with the message
+  int lane[2];
+  socketpair(AF_UNIX, SOCK_SEQPACKET, 0, lane);
+  int fds[2] = {writer.memfd(), writer.wakeFd()};
+  char buf[512];
+  std::vector<int> got;
+  bool truncated = false;
+  bool attached =
+      sendWithFds(lane[0], "{\"type\":\"sample_ring\",\"version\":1}\n",
+                  fds, 2) &&
+      recvWithFds(lane[1], buf, sizeof(buf), got, truncated) > 0 &&
+      !truncated && got.size() == 2 && reader.attach(got[0], got[1]);
+  close(lane[0]);
+  close(lane[1]);
+  if (!attached) {
+    r.ok = false;
+    return r;
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<long> published{0};
+  std::thread engine([&] {
+    std::vector<PathSample> path;
+    uint32_t stroke = 0;
+    long received = 0;
+    auto take = [&](const sample_ring::Sample *s, size_t n) {
+      for (size_t i = 0; i < n; ++i) {
+        if (s[i].stroke != stroke) {
+          stroke = s[i].stroke;
+          path.clear();
+        }
+        path.push_back({s[i].x, s[i].y, s[i].t});
+        if (!matches(path.back(), sampleAt(stroke, int(path.size()) - 1)))
+          r.ok = false;
+      }
+      received += n;
+    };
+    auto drain = [&] {
+      do {
+        reader.consume(take);
+      } while (!reader.arm());
+    };
+
+    drain();
+    pollfd pfd{reader.wakeFd(), POLLIN, 0};
+    while (!done.load() || received < published.load()) {
+      if (poll(&pfd, 1, 20) <= 0)
+        continue;
+      auto start = Clock::now();
+      r.consumerWakeups++;
+      reader.clearWake();
+      drain();
+      r.consumerCpuUs += elapsedUs(start);
+    }
+    r.ok = r.ok && !reader.corrupt() && path.size() == SAMPLES_PER_STROKE &&
+           received == long(STROKES) * SAMPLES_PER_STROKE;
+  });
+
+  produce([&](int stroke, int i) {
+    if (!writer.push(sampleAt(stroke, i)))
+      r.ok = false;
+    published.fetch_add(1);
+    if (writer.publish())
+      r.producerSyscalls++; // The eventfd write
+  });
+  done.store(true);
+  engine.join();
+  return r;
+}
+
+} // namespace
+
+int main() {
+  std::printf("%d strokes x %d samples, %d per %lld ms frame\n", STROKES,
+              SAMPLES_PER_STROKE, SAMPLES_PER_FRAME,
+              static_cast<long long>(FRAME.count()));
+  std::printf("  %-12s %12s %15s %14s %7s\n", "transport", "UI syscalls",
+              "engine wakeups", "engine cpu us", "check");
+  auto row = [](const char *name, const Result &r) {
+    std::printf("  %-12s %12ld %15ld %14.0f %7s\n", name, r.producerSyscalls,
+                r.consumerWakeups, r.consumerCpuUs, r.ok ? "ok" : "FAILED");
+  };
+  Result socket = runSocket();
+  row("swipe_move", socket);
+  Result ring = runRing();
+  row("sample ring", ring);
+  return socket.ok && ring.ok ? 0 : 1;
+}
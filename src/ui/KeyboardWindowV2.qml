@@ -390,7 +390,8 @@ Window {
                         if (keyboard.activeKey) keyboard.activeKey.isPressed = false;
                         
                         let lp = keysContainer.mapFromItem(masterMouse, mouse.x, mouse.y);
-                        keyboard.currentPath = [{wx: mouse.x, wy: mouse.y, x: lp.x, y: lp.y}];
+                        keyboard.currentPath = [{wx: mouse.x, wy: mouse.y, x: lp.x, y: lp.y, t: dt}];
+                        bridge.swipeSample(lp.x / keyboard.scaleFactor, lp.y / keyboard.scaleFactor, dt, true);
                         trailCanvas.requestPaint();
                     }
                 } else {
@@ -403,7 +404,8 @@ Window {
                     
                     if (rdist >= keyboard.resampleDist) {
                         let nlp = keysContainer.mapFromItem(masterMouse, nwx, nwy);
-                        keyboard.currentPath.push({wx: nwx, wy: nwy, x: nlp.x, y: nlp.y});
+                        keyboard.currentPath.push({wx: nwx, wy: nwy, x: nlp.x, y: nlp.y, t: dt});
+                        bridge.swipeSample(nlp.x / keyboard.scaleFactor, nlp.y / keyboard.scaleFactor, dt, false);
                         trailCanvas.requestPaint();
                     }
                 }
@@ -447,7 +449,8 @@ Window {
                 for (let p of keyboard.currentPath) {
                     enginePath.push({
                         x: p.x / keyboard.scaleFactor, 
-                        y: p.y / keyboard.scaleFactor
+                        y: p.y / keyboard.scaleFactor,
+                        t: p.t  // ms since press; engine uses gaps as word breaks
                     });
                 }
                 
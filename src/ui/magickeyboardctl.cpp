@@ -1,4 +1,5 @@
 #include "protocol.h"
+#include <cctype>
 #include <chrono>
 #include <cstdlib>
 #include <cstring>
@@ -12,7 +13,9 @@
 #include <unistd.h>
 
 static void usage() {
-  std::cerr << "Usage: magickeyboardctl [show|hide|toggle|kill-ui|ui-intent]"
+  std::cerr << "Usage: magickeyboardctl "
+               "[show|hide|toggle|kill-ui|ui-intent|status|shadow-summary|"
+               "reload|forget <word>]"
             << std::endl;
 }
 
@@ -52,6 +55,26 @@ int main(int argc, char *argv[]) {
     msg = "{\"type\":\"ui_hide\"}\n";
   } else if (cmd == "toggle") {
     msg = "{\"type\":\"ui_toggle\"}\n";
+  } else if (cmd == "status") {
+    msg = "{\"type\":\"status\"}\n";
+  } else if (cmd == "shadow-summary") {
+    msg = "{\"type\":\"shadow_summary\"}\n";
+  } else if (cmd == "reload") {
+    msg = "{\"type\":\"reload\"}\n";
+  } else if (cmd == "forget") {
+    if (argc < 3) {
+      usage();
+      return 2;
+    }
+    // Swipe words are letters only, which also keeps the JSON trivial
+    std::string word = argv[2];
+    for (char c : word) {
+      if (!std::isalpha(static_cast<unsigned char>(c))) {
+        std::cerr << "Not a word: " << word << std::endl;
+        return 2;
+      }
+    }
+    msg = "{\"type\":\"forget_word\",\"word\":\"" + word + "\"}\n";
   } else if (cmd == "ui-intent") {
     int argOffset = 0;
     // Optional: --delay-ms N (must appear before intent type)
@@ -166,6 +189,26 @@ int main(int argc, char *argv[]) {
   struct pollfd pfd;
   pfd.fd = fd;
   pfd.events = POLLIN;
+
+  // Diagnostic replies carry data: read one full line and print it
+  if (cmd == "status" || cmd == "shadow-summary") {
+    std::string reply;
+    char buf[1024];
+    while (reply.find('\n') == std::string::npos && poll(&pfd, 1, 1000) > 0) {
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0)
+        break;
+      reply.append(buf, n);
+    }
+    close(fd);
+    if (reply.empty()) {
+      std::cerr << "No reply from engine" << std::endl;
+      return 1;
+    }
+    std::cout << reply.substr(0, reply.find('\n')) << std::endl;
+    return 0;
+  }
+
   int pr = poll(&pfd, 1, 100);
   if (pr > 0) {
     char buf[128];
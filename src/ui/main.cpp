@@ -19,13 +19,44 @@
 #include <QScreen>
 #include <QTimer>
 
+#include "binary_frames.h"
 #include "protocol.h"
+#include "sample_ring.h"
 #include <QElapsedTimer>
 #include <QTimer>
 #include <algorithm>
+#include <cerrno>
 #include <cmath>
 #include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// String body for a JSON message: the engine parses real JSON, so quotes,
+// backslashes and control characters must be escaped
+static QString jsonEscape(const QString &text) {
+  QString escaped;
+  escaped.reserve(text.size());
+  for (QChar c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else if (c == '\r') {
+      escaped += "\\r";
+    } else if (c == '\t') {
+      escaped += "\\t";
+    } else if (c.unicode() < 0x20) {
+      escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
 
 class KeyboardBridge : public QObject {
   Q_OBJECT
@@ -94,13 +125,22 @@ public:
       // Reset backoff on successful connection
       reconnectDelayMs_ = kInitialReconnectDelayMs;
 
-      // Identify as UI
-      socket_->write("{\"type\":\"hello\",\"role\":\"ui\"}\n");
+      // Identify as UI and offer binary frames and the priority lane;
+      // JSON on this socket until the engine accepts
+      framesVersion_ = 0;
+      closeLane();
+      socket_->write(QString("{\"type\":\"hello\",\"role\":\"ui\","
+                             "\"frames\":%1,\"lanes\":%2}\n")
+                         .arg(ipc::frame::VERSION)
+                         .arg(ipc::LANES_VERSION)
+                         .toUtf8());
       socket_->flush();
     });
 
     connect(socket_, &QLocalSocket::disconnected, this, [this]() {
       qDebug() << "Disconnected from engine";
+      framesVersion_ = 0;
+      closeLane();
       scheduleReconnect();
     });
 
@@ -124,6 +164,8 @@ public:
     loadTheme("default");
   }
 
+  ~KeyboardBridge() override { closeLane(); }
+
   State state() const { return state_; }
 
   // Settings getters
@@ -207,8 +249,8 @@ public:
     QString msg =
         QString(
             "{\"type\":\"setting_update\",\"key\":\"%1\",\"value\":\"%2\"}\n")
-            .arg(key)
-            .arg(value);
+            .arg(jsonEscape(key))
+            .arg(jsonEscape(value));
     socket_->write(msg.toUtf8());
     socket_->flush();
     qDebug() << "Sent setting update:" << key << "=" << value;
@@ -279,8 +321,12 @@ public slots:
 
     if (socket_->state() != QLocalSocket::ConnectedState)
       return;
-    QString msg = QString("{\"type\":\"key\",\"text\":\"%1\"}\n").arg(key);
-    if (socket_->write(msg.toUtf8()) > 0) {
+    if (sendKeyFrame(key))
+      return;
+    QByteArray msg = QString("{\"type\":\"key\",\"text\":\"%1\"}\n")
+                         .arg(jsonEscape(key))
+                         .toUtf8();
+    if (sendOnLane(msg.constData(), msg.size()) || socket_->write(msg) > 0) {
       socket_->flush();
       qDebug() << "Sent key text=" << key;
     }
@@ -313,9 +359,16 @@ public slots:
 
     if (socket_->state() != QLocalSocket::ConnectedState)
       return;
-    QString msg =
-        QString("{\"type\":\"action\",\"action\":\"%1\"}\n").arg(action);
-    if (socket_->write(msg.toUtf8()) > 0) {
+    // The engine treats these actions as key presses
+    if ((action == "backspace" || action == "enter" || action == "space" ||
+         action == "tab" || action == "left" || action == "right") &&
+        sendKeyFrame(action))
+      return;
+    QByteArray msg =
+        QString("{\"type\":\"action\",\"action\":\"%1\"}\n")
+            .arg(action)
+            .toUtf8();
+    if (sendOnLane(msg.constData(), msg.size()) || socket_->write(msg) > 0) {
       socket_->flush();
       qDebug() << "Sent action type=" << action;
     }
@@ -347,16 +400,8 @@ public slots:
       return;
     }
 
-    // Escape text for JSON: handle quotes, backslashes, newlines
-    QString escaped = text;
-    escaped.replace("\\", "\\\\");
-    escaped.replace("\"", "\\\"");
-    escaped.replace("\n", "\\n");
-    escaped.replace("\r", "\\r");
-    escaped.replace("\t", "\\t");
-
-    QString msg =
-        QString("{\"type\":\"commit_text\",\"text\":\"%1\"}\n").arg(escaped);
+    QString msg = QString("{\"type\":\"commit_text\",\"text\":\"%1\"}\n")
+                      .arg(jsonEscape(text));
     if (socket_->write(msg.toUtf8()) > 0) {
       socket_->flush();
       qDebug() << "Sent commit_text len=" << text.length();
@@ -368,13 +413,27 @@ public slots:
 
     if (socket_->state() != QLocalSocket::ConnectedState)
       return;
+    if (sendSwipeRing(path.size())) {
+      ringPath_ = path; // Resent if the engine lost the samples
+      return;
+    }
+    if (sendSwipeFrame(path, {}))
+      return;
 
     QString pointsJson = "[";
     for (int i = 0; i < path.size(); ++i) {
       QVariantMap pt = path[i].toMap();
-      pointsJson += QString("{\"x\":%1,\"y\":%2}")
-                        .arg(pt["x"].toReal())
-                        .arg(pt["y"].toReal());
+      if (pt.contains("t")) {
+        // Timestamps let the engine split phrase swipes at pauses
+        pointsJson += QString("{\"x\":%1,\"y\":%2,\"t\":%3}")
+                          .arg(pt["x"].toReal())
+                          .arg(pt["y"].toReal())
+                          .arg(pt["t"].toReal());
+      } else {
+        pointsJson += QString("{\"x\":%1,\"y\":%2}")
+                          .arg(pt["x"].toReal())
+                          .arg(pt["y"].toReal());
+      }
       if (i < path.size() - 1)
         pointsJson += ",";
     }
@@ -392,17 +451,41 @@ public slots:
              << "layout=qwerty points=" << path.size();
   }
 
+  // One resampled point of the swipe in progress (layout px, ms since the
+  // press). Streams into the sample ring when the engine has one mapped.
+  Q_INVOKABLE void swipeSample(double x, double y, double t, bool begin) {
+    if (!sampleRingReady_)
+      return;
+    if (begin) {
+      ringStroke_ = static_cast<uint32_t>(swipeSeq_);
+      ringStreaming_ = true;
+      ringCount_ = 0;
+    }
+    if (!ringStreaming_)
+      return;
+    // A full ring means the engine stalled; this stroke goes as a path
+    ringStreaming_ = sampleRing_.push({static_cast<float>(x),
+                                       static_cast<float>(y),
+                                       static_cast<float>(t), ringStroke_});
+    if (ringStreaming_) {
+      ringCount_++;
+      sampleRing_.publish();
+    }
+  }
+
   Q_INVOKABLE void sendSwipeWithKeys(const QVariantList &path,
                                      const QVariantList &keys) {
     promoteIfPassive("intent_swipe");
 
     if (socket_->state() != QLocalSocket::ConnectedState)
       return;
+    if (sendSwipeFrame(path, keys))
+      return;
 
     // Build keys JSON array
     QString keysJson = "[";
     for (int i = 0; i < keys.size(); ++i) {
-      keysJson += QString("\"%1\"").arg(keys[i].toString());
+      keysJson += QString("\"%1\"").arg(jsonEscape(keys[i].toString()));
       if (i < keys.size() - 1)
         keysJson += ",";
     }
@@ -433,6 +516,173 @@ public slots:
              << "ui_keys=" << keys.size() << "points=" << path.size();
   }
 
+private:
+  // Key tap as a binary frame, if the engine accepted frames and the key
+  // has a code. False means the caller sends JSON instead.
+  bool sendKeyFrame(const QString &key) {
+    if (framesVersion_ < ipc::frame::VERSION)
+      return false;
+    std::string frame;
+    if (!ipc::frame::encodeKey(frame, key.toStdString()))
+      return false;
+    if (!sendOnLane(frame.data(), frame.size()) &&
+        socket_->write(frame.data(), frame.size()) <= 0)
+      return false;
+    socket_->flush();
+    qDebug() << "Sent key frame text=" << key;
+    return true;
+  }
+
+  // Open the priority lane the engine advertised. Keys keep using the
+  // stream socket if it cannot be reached.
+  void openLane(const QString &path) {
+    closeLane();
+    QByteArray name = path.toLocal8Bit();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (name.isEmpty() || name.size() >= int(sizeof(addr.sun_path)))
+      return;
+    memcpy(addr.sun_path, name.constData(), name.size());
+
+    // Non-blocking: a busy engine must not stall the UI thread
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      0);
+    if (fd < 0)
+      return;
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      qWarning() << "Priority lane unavailable:" << strerror(errno);
+      ::close(fd);
+      return;
+    }
+    laneFd_ = fd;
+    qDebug() << "Keys use the priority lane" << path;
+    offerSampleRing();
+  }
+
+  void closeLane() {
+    if (laneFd_ >= 0)
+      ::close(laneFd_);
+    laneFd_ = -1;
+    sampleRingReady_ = false;
+    ringStreaming_ = false;
+    sampleRing_.close();
+  }
+
+  // Hand the engine a fresh sample ring over the lane; swipes stream
+  // through it once the engine confirms
+  void offerSampleRing() {
+    if (!sampleRing_.create()) {
+      qWarning() << "Sample ring unavailable:" << strerror(errno);
+      return;
+    }
+    std::string msg = QString("{\"type\":\"sample_ring\",\"version\":%1}\n")
+                          .arg(ipc::sample_ring::VERSION)
+                          .toStdString();
+    int fds[2] = {sampleRing_.memfd(), sampleRing_.wakeFd()};
+    if (!ipc::sendWithFds(laneFd_, msg, fds, 2))
+      sampleRing_.close();
+  }
+
+  // End a stroke that streamed completely through the sample ring. False
+  // means the caller sends the whole path instead.
+  bool sendSwipeRing(int count) {
+    bool complete = sampleRingReady_ && ringStreaming_ &&
+                    ringStroke_ == static_cast<uint32_t>(swipeSeq_) &&
+                    ringCount_ == count;
+    ringStreaming_ = false;
+    if (!complete)
+      return false;
+
+    lastSwipeSeqSent_ = swipeSeq_++;
+    QString msg = QString("{\"type\":\"swipe_ring\",\"seq\":%1,\"count\":%2}\n")
+                      .arg(lastSwipeSeqSent_)
+                      .arg(count);
+    socket_->write(msg.toUtf8());
+    socket_->flush();
+    lastSwipeSentTimer_.restart();
+    qDebug() << "Sent swipe_ring seq=" << lastSwipeSeqSent_
+             << "points=" << count;
+    return true;
+  }
+
+  // The engine lost the samples of a swipe_ring stroke; send its path,
+  // unless a newer swipe already went out (it would be overtaken)
+  void resendRingSwipe(uint64_t seq) {
+    if (seq != lastSwipeSeqSent_ || ringPath_.isEmpty()) {
+      qDebug() << "swipe_resend seq=" << seq << "ignored";
+      return;
+    }
+    QVariantList path;
+    path.swap(ringPath_);
+    ringStreaming_ = false; // Not through the ring again
+    qDebug() << "Resending swipe seq=" << seq << "as a path";
+    sendSwipePath(path);
+  }
+
+  // Send one key or action message on the priority lane. False (nothing
+  // sent) means the caller uses the stream socket; a lane that fails once
+  // is closed, and the engine still reads what it had queued first.
+  bool sendOnLane(const char *data, size_t size) {
+    if (laneFd_ < 0)
+      return false;
+    // The engine keeps a lane key behind stream messages it has already
+    // received; ones still in Qt's write buffer it cannot know about, so
+    // push those out first, or keep the key on the stream behind them
+    if (socket_->bytesToWrite() > 0) {
+      socket_->flush();
+      if (socket_->bytesToWrite() > 0)
+        return false;
+    }
+    if (::send(laneFd_, data, size, MSG_NOSIGNAL | MSG_DONTWAIT) ==
+        static_cast<ssize_t>(size))
+      return true;
+    qWarning() << "Priority lane send failed:" << strerror(errno);
+    closeLane();
+    return false;
+  }
+
+  // Swipe as a binary frame: int16 deltas, or float32 when a step is too
+  // long for them. False (nothing sent) means the caller sends JSON.
+  bool sendSwipeFrame(const QVariantList &path, const QVariantList &keys) {
+    if (framesVersion_ < ipc::frame::VERSION)
+      return false;
+    framePoints_.clear();
+    for (const auto &v : path) {
+      QVariantMap pt = v.toMap();
+      ipc::PathSample s;
+      s.x = pt["x"].toDouble();
+      s.y = pt["y"].toDouble();
+      if (pt.contains("t"))
+        s.t = pt["t"].toDouble();
+      framePoints_.push_back(s);
+    }
+    std::string trail;
+    for (const auto &k : keys) {
+      QString key = k.toString();
+      if (key.size() == 1 && key[0].unicode() < 0x80)
+        trail += static_cast<char>(key[0].unicode());
+    }
+
+    uint64_t seq = swipeSeq_;
+    uint8_t layout = ipc::frame::layoutId("qwerty");
+    std::string frame;
+    if (!ipc::frame::encodeSwipe(frame, ipc::frame::Type::SwipeI16, seq,
+                                 layout, framePoints_, trail) &&
+        !ipc::frame::encodeSwipe(frame, ipc::frame::Type::SwipeF32, seq,
+                                 layout, framePoints_, trail))
+      return false;
+
+    lastSwipeSeqSent_ = swipeSeq_++;
+    socket_->write(frame.data(), frame.size());
+    socket_->flush();
+    lastSwipeSentTimer_.restart();
+    qDebug() << "Sent swipe frame seq=" << lastSwipeSeqSent_
+             << "ui_keys=" << keys.size() << "points=" << path.size()
+             << "bytes=" << frame.size();
+    return true;
+  }
+
 private slots:
   void tryConnect() {
     // Only connect if in unconnected state
@@ -577,7 +827,26 @@ private slots:
       } else {
         // Handle other message types via JSON or substring fallback
         QString type = obj.value("type").toString();
-        if (type == "ui_show" || type == "show" ||
+        if (type == "frames") {
+          framesVersion_ = obj.value("version").toInt();
+          qDebug() << "Engine accepted binary frames v" << framesVersion_;
+        } else if (type == "lanes") {
+          if (obj.value("version").toInt() >= ipc::LANES_VERSION)
+            openLane(obj.value("priority").toString());
+        } else if (type == "sample_ring") {
+          sampleRingReady_ =
+              sampleRing_.valid() &&
+              obj.value("version").toInt() >= ipc::sample_ring::VERSION;
+          if (!sampleRingReady_) {
+            // Dropped by the engine: swipes go as paths from now on
+            ringStreaming_ = false;
+            sampleRing_.close();
+          }
+          qDebug() << "Swipes stream through shared memory:"
+                   << sampleRingReady_;
+        } else if (type == "swipe_resend") {
+          resendRingSwipe(obj.value("seq").toVariant().toULongLong());
+        } else if (type == "ui_show" || type == "show" ||
             msg.contains("\"type\":\"show\"") ||
             msg.contains("\"type\":\"ui_show\"")) {
           qDebug() << "Received: show -> Passive";
@@ -788,7 +1057,8 @@ public slots:
     if (socket_->state() != QLocalSocket::ConnectedState)
       return;
     QString msg =
-        QString("{\"type\":\"commit_candidate\",\"text\":\"%1\"}\n").arg(word);
+        QString("{\"type\":\"commit_candidate\",\"text\":\"%1\"}\n")
+            .arg(jsonEscape(word));
     socket_->write(msg.toUtf8());
     socket_->flush();
   }
@@ -810,6 +1080,16 @@ private:
   QElapsedTimer lastSwipeSentTimer_; // For latency tracking
   uint64_t swipeSeq_ = 1;
   uint64_t lastSwipeSeqSent_ = 0;
+  int framesVersion_ = 0; // Binary frame version the engine accepted
+  int laneFd_ = -1;       // Priority lane for keys and actions, if open
+  // Shared-memory swipe samples (sample_ring.h), offered over the lane
+  ipc::SampleRingWriter sampleRing_;
+  bool sampleRingReady_ = false; // Engine mapped the ring
+  bool ringStreaming_ = false;   // Current stroke is complete in the ring
+  uint32_t ringStroke_ = 0;
+  int ringCount_ = 0;
+  QVariantList ringPath_; // Last stroke sent as swipe_ring
+  std::vector<ipc::PathSample> framePoints_; // Reused by sendSwipeFrame
   int toggleCount_ = 0; // Toggles in current 1s window
 
   // Backspace repeat state